@@ -0,0 +1,307 @@
+/*
+ *  analysis.h
+ *
+ *  -------------------------------------------------------------------
+ *  Worker pool behind the "ANALYZE <ms>" request: a score for each of
+ *  the seven columns from analyzePosition() (search.h), so players can
+ *  ask for hints mid-game. It also plays the server's --ai moves.
+ *
+ *  A search can take up to ANALYZE_MAX_MS, far too long to run on a
+ *  reactor thread, so the reactor only does the cheap parts:
+ *
+ *    1. lookupAnalysis(): a result cached for the same position with at
+ *       least the same budget (or already solved) is sent straight back.
+ *    2. submitAnalysis(): otherwise the position goes on the pool's
+ *       queue. The queue is bounded (ANALYZE_QUEUE); when it's full the
+ *       client gets "ANALYSIS BUSY" instead of waiting behind everyone.
+ *    3. A pool thread runs the search, caches the result, appends it to
+ *       the requesting reactor's AnalysisInbox and pokes the inbox's
+ *       eventfd, which sits in that reactor's epoll set.
+ *    4. The reactor takes the results out of its inbox and replies.
+ *
+ *  The server's own moves (--ai) take the same route through their own
+ *  queue and their own threads, one per reactor (submitMove()), so a
+ *  search never stalls a reactor's other games and never waits behind
+ *  an ANALYZE. That queue needs no bound: a game has at most one move
+ *  out at a time. A move's --ai budget runs from when it was queued, so
+ *  when more games are waiting than there are threads, the backlog costs
+ *  them search depth rather than reply time.
+ *
+ *  Two tables are involved. The pool threads search with the server's
+ *  shared position cache (sharedTable() in search.h), the same one
+ *  every --ai move uses: lock-free, its slots XOR-checked, with a
+ *  depth-preferred and an always-replace slot per bucket. The pool's
+ *  own result cache (ANALYSIS_CACHE finished answers, see steps 1 and
+ *  3) is direct-mapped by position key behind the pool's mutex:
+ *  lookups are a hash and a copy, far rarer than moves.
+ *
+ *  Results carry the session's fd, its channel (for a game multiplexed
+ *  on that connection, see reactor.h) and a request id. The reactor
+ *  drops any result whose session is gone, has moved on, or has since
+ *  been replaced by a new connection on the same fd or a new game on
+ *  the same channel. A move is addressed to its game id instead, since
+ *  the game may change connections (RESUME) while it's being searched.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "search.h"
+
+const int ANALYZE_MAX_MS = 5000;   // Longer budgets are cut to this.
+const size_t ANALYZE_QUEUE = 64;   // Requests waiting for a pool thread.
+const size_t ANALYSIS_CACHE = 4096; // Cached positions; a power of two.
+
+enum SearchKind {
+    SEARCH_ANALYZE, // Scores for every column, for a client.
+    SEARCH_MOVE     // The server's own move.
+};
+
+struct AnalysisDone {
+    SearchKind kind;
+    int fd;
+    uint32_t channel; // 0 = the connection's own game.
+    uint64_t gameId;  // SEARCH_MOVE: the game it's for; fd and channel are unused.
+    uint64_t id;
+    Analysis analysis;
+    SearchResult move;
+};
+
+// One per reactor: finished analyses waiting to be sent.
+struct AnalysisInbox {
+    int eventfd;
+    std::mutex lock;
+    std::vector<AnalysisDone> done;
+    std::atomic<int> pending; // Submitted, not posted back yet: the reactor mustn't go away. Drops under `lock`.
+};
+
+struct AnalysisJob {
+    SearchKind kind;
+    AnalysisInbox *inbox;
+    int fd;
+    uint32_t channel;
+    uint64_t gameId;
+    uint64_t id;
+    Board board;
+    int budgetMs;
+    int threads; // SEARCH_MOVE: lazy-SMP threads, --threads...
+    uint64_t queuedNs; // ...and when its budget started running.
+};
+
+struct CachedAnalysis {
+    uint64_t key; // positionKey(), 0 = empty.
+    int budgetMs;
+    Analysis analysis;
+};
+
+struct AnalysisPool {
+    std::mutex lock; // Guards `queue`, `moves`, `running`, `moveThreads` and `cache`.
+    std::condition_variable ready;
+    std::condition_variable moveReady;
+    std::deque<AnalysisJob> queue;
+    std::deque<AnalysisJob> moves; // SEARCH_MOVE jobs, for the move threads only.
+    bool running;
+    int moveThreads;
+    std::vector<CachedAnalysis> cache;
+    std::vector<std::thread> threads;
+};
+
+inline AnalysisPool &analysisPool() {
+    static AnalysisPool pool;
+    return pool;
+}
+
+inline bool initInbox(AnalysisInbox &inbox) {
+    inbox.pending.store(0, std::memory_order_relaxed);
+    inbox.eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return inbox.eventfd != -1;
+}
+
+/*
+ * Function: lookupAnalysis
+ *
+ * Copies a cached analysis of `board` into `out` if there is one that
+ * searched at least budgetMs or is already solved.
+ */
+inline bool lookupAnalysis(const Board &board, int budgetMs, Analysis &out) {
+    AnalysisPool &pool = analysisPool();
+    uint64_t key = positionKey(board);
+    std::lock_guard<std::mutex> guard(pool.lock);
+    if (pool.cache.empty())
+        return false;
+    const CachedAnalysis &slot = pool.cache[((key * 0x9E3779B97F4A7C15ULL) >> 32) & (ANALYSIS_CACHE - 1)];
+    if (slot.key != key || (slot.budgetMs < budgetMs && !slot.analysis.solved))
+        return false;
+    out = slot.analysis;
+    return true;
+}
+
+inline void storeAnalysis(const Board &board, int budgetMs, const Analysis &analysis) {
+    AnalysisPool &pool = analysisPool();
+    uint64_t key = positionKey(board);
+    std::lock_guard<std::mutex> guard(pool.lock);
+    CachedAnalysis &slot = pool.cache[((key * 0x9E3779B97F4A7C15ULL) >> 32) & (ANALYSIS_CACHE - 1)];
+    if (slot.key == key && slot.budgetMs > budgetMs && !analysis.solved)
+        return; // Keep the deeper result already there.
+    slot.key = key;
+    slot.budgetMs = budgetMs;
+    slot.analysis = analysis;
+}
+
+/*
+ * Function: submitAnalysis
+ *
+ * Queues a search for a pool thread. Returns false if the pool isn't
+ * running or the queue is full.
+ */
+inline bool submitAnalysis(AnalysisInbox &inbox, int fd, uint32_t channel, uint64_t id, const Board &board, int budgetMs) {
+    AnalysisPool &pool = analysisPool();
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        if (!pool.running || pool.queue.size() >= ANALYZE_QUEUE)
+            return false;
+        pool.queue.push_back(AnalysisJob{ SEARCH_ANALYZE, &inbox, fd, channel, 0, id, board, budgetMs, 1, 0 });
+        inbox.pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    pool.ready.notify_one();
+    return true;
+}
+
+/*
+ * Function: submitMove
+ *
+ * Queues a search for the server's move in game `gameId` on a move
+ * thread. Returns false if there are none, or the pool isn't running.
+ */
+inline bool submitMove(AnalysisInbox &inbox, uint64_t gameId, uint64_t id, const Board &board, int budgetMs, int threads) {
+    AnalysisPool &pool = analysisPool();
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        if (!pool.running || pool.moveThreads == 0)
+            return false;
+        pool.moves.push_back(AnalysisJob{ SEARCH_MOVE, &inbox, -1, 0, gameId, id, board, budgetMs, threads,
+                                         monotonicNs() });
+        inbox.pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    pool.moveReady.notify_one();
+    return true;
+}
+
+// Takes everything out of a reactor's inbox and clears its eventfd.
+inline void takeAnalyses(AnalysisInbox &inbox, std::vector<AnalysisDone> &out) {
+    uint64_t wakeups;
+    while (read(inbox.eventfd, &wakeups, sizeof(wakeups)) > 0) {
+    }
+    out.clear();
+    std::lock_guard<std::mutex> guard(inbox.lock);
+    out.swap(inbox.done);
+}
+
+// One pool thread: ANALYZE requests, or with `moves` the server's moves.
+// A move's metrics are the reactor's to record, with the rest of its game's.
+inline void runAnalysisWorker(bool moves) {
+    AnalysisPool &pool = analysisPool();
+    Metrics *metrics = newThreadMetrics();
+    std::deque<AnalysisJob> &queue = moves ? pool.moves : pool.queue;
+    std::condition_variable &ready = moves ? pool.moveReady : pool.ready;
+    while (true) {
+        AnalysisJob job;
+        {
+            std::unique_lock<std::mutex> guard(pool.lock);
+            ready.wait(guard, [&pool, &queue]() { return !queue.empty() || !pool.running; });
+            if (!pool.running)
+                return;
+            job = queue.front();
+            queue.pop_front();
+        }
+        AnalysisDone done = { job.kind, job.fd, job.channel, job.gameId, job.id, Analysis(), SearchResult() };
+        if (job.kind == SEARCH_MOVE) {
+            int waitedMs = (int)((monotonicNs() - job.queuedNs) / 1000000);
+            done.move = searchMove(sharedTable(), job.board, std::max(1, job.budgetMs - waitedMs), job.threads);
+        } else {
+            done.analysis = analyzePosition(sharedTable(), job.board, job.budgetMs);
+            record(*metrics, HIST_ANALYSIS, (uint64_t)(done.analysis.ms * 1e6));
+            count(*metrics, COUNT_TT_PROBES, done.analysis.probes);
+            count(*metrics, COUNT_TT_HITS, done.analysis.hits);
+            storeAnalysis(job.board, job.budgetMs, done.analysis);
+        }
+        // All under the lock, so a reactor that wakes and takes the
+        // result also sees `pending` drop, and can only go once we're done.
+        std::lock_guard<std::mutex> guard(job.inbox->lock);
+        job.inbox->done.push_back(done);
+        uint64_t one = 1;
+        ssize_t n = write(job.inbox->eventfd, &one, sizeof(one));
+        (void)n; // Only fails if the counter is about to overflow, i.e. already readable.
+        job.inbox->pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// Starts `threads` ANALYZE threads and `moveThreads` threads for the
+// server's moves, which run until stopAnalysis(). sharedTable() must
+// already be allocated.
+inline void startAnalysis(int threads, int moveThreads) {
+    AnalysisPool &pool = analysisPool();
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        pool.cache.assign(ANALYSIS_CACHE, CachedAnalysis());
+        pool.running = true;
+        pool.moveThreads = moveThreads;
+    }
+    for (int t = 0; t < threads; t++)
+        pool.threads.emplace_back(runAnalysisWorker, false);
+    for (int t = 0; t < moveThreads; t++)
+        pool.threads.emplace_back(runAnalysisWorker, true);
+}
+
+// Stops the pool threads once the reactors are gone; queued requests are dropped.
+inline void stopAnalysis() {
+    AnalysisPool &pool = analysisPool();
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        pool.running = false;
+        pool.queue.clear();
+        pool.moves.clear();
+    }
+    pool.ready.notify_all();
+    pool.moveReady.notify_all();
+    for (size_t t = 0; t < pool.threads.size(); t++)
+        pool.threads[t].join();
+    pool.threads.clear();
+}
+
+/*
+ * Function: analysisWireScores
+ *
+ * Turns engine scores into the protocol's column scores (protocol.h):
+ * wins and losses become distances from the current move.
+ */
+inline void analysisWireScores(const Analysis &analysis, int moves, int16_t out[COLS]) {
+    for (int c = 0; c < COLS; c++) {
+        int score = analysis.scores[c];
+        if (score == NO_SCORE)
+            out[c] = ANALYSIS_FULL;
+        else if (score >= WIN_SCORE)
+            out[c] = (int16_t)(ANALYSIS_WIN - (ROWS * COLS - (score - WIN_SCORE) - moves));
+        else if (score <= -WIN_SCORE)
+            out[c] = (int16_t)-(ANALYSIS_WIN - (ROWS * COLS - (-score - WIN_SCORE) - moves));
+        else
+            out[c] = (int16_t)score;
+    }
+}
+
+#endif // ANALYSIS_H
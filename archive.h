@@ -0,0 +1,405 @@
+/*
+ *  archive.h
+ *
+ *  -------------------------------------------------------------------
+ *  Append-only archive of every game the server plays (--archive
+ *  <file>), for analysing play offline and for reproducing bugs.
+ *  replay.cpp reads it back.
+ *
+ *  File layout (little-endian, like book.h: map it and index it):
+ *
+ *      ArchiveHeader  16 bytes: magic "C4GAMES1", record size
+ *      GameRecord[]   32 bytes each, in the order the games ended
+ *
+ *  A GameRecord is fixed-size so a reader can jump to game n, or split
+ *  the file across threads, without parsing what comes before it:
+ *
+ *      startSec    when the connection was accepted (Unix seconds)
+ *      durationMs  accept -> close
+ *      peerAddr    client IPv4 address, network order
+ *      peerPort    client port, host order
+ *      result      a GameResult
+ *      moveCount   0-42 plies, the client's first
+ *      moves[2]    3 bits per move (column 0-6); move i is bits
+ *                  3*(i%21) .. 3*(i%21)+2 of moves[i/21]
+ *
+ *  Game threads never touch the file. closeSession() copies the
+ *  finished record onto its thread's single-producer ring and moves
+ *  on; the archiver thread (startArchiver()) drains every ring each
+ *  ARCHIVE_COMMIT_MS and group-commits the lot with one write() and
+ *  one fdatasync(), so a burst of games costs one disk flush, not one
+ *  each. A crash loses at most the games of the last commit window; a
+ *  record torn by one is cut off the next time the file is opened. As
+ *  with the logger, a full ring drops the game (and counts it) rather
+ *  than stall the reactor.
+ *
+ *  The reading side, mapArchive() and replayGame(), is here too so the
+ *  format lives in one file.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <iostream>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "log.h"
+
+const char ARCHIVE_MAGIC[8] = { 'C', '4', 'G', 'A', 'M', 'E', 'S', '1' };
+
+const int MOVE_BITS = 3;
+const int MOVES_PER_WORD = 64 / MOVE_BITS; // 21; two words hold all 42 plies.
+const size_t ARCHIVE_RING = 1024;          // Records per thread; a power of two.
+const int ARCHIVE_COMMIT_MS = 50;          // Group commit window.
+
+enum GameResult : uint8_t {
+    RESULT_CLIENT_WIN,
+    RESULT_SERVER_WIN,
+    RESULT_TIE,
+    RESULT_TIMEOUT,   // The client ran out of time and forfeited.
+    RESULT_ABANDONED, // Disconnected, dropped or never finished.
+    RESULT_COUNT
+};
+
+const char *const RESULT_NAMES[RESULT_COUNT] = { "client_win", "server_win", "tie", "timeout", "abandoned" };
+
+struct ArchiveHeader {
+    char     magic[8];
+    uint32_t recordSize;
+    uint32_t reserved;
+};
+
+struct GameRecord {
+    uint32_t startSec;
+    uint32_t durationMs;
+    uint32_t peerAddr;
+    uint16_t peerPort;
+    uint8_t  result;
+    uint8_t  moveCount;
+    uint64_t moves[2];
+};
+
+static_assert(sizeof(ArchiveHeader) == 16 && sizeof(GameRecord) == 32, "archive layout changed");
+
+inline void beginRecord(GameRecord &rec, uint32_t peerAddr, uint16_t peerPort) {
+    memset(&rec, 0, sizeof(rec));
+    rec.startSec = (uint32_t)time(nullptr);
+    rec.peerAddr = peerAddr;
+    rec.peerPort = peerPort;
+    rec.result = RESULT_ABANDONED;
+}
+
+// Appends a 0-based column. Moves past the 42nd can't happen and are ignored.
+inline void recordMove(GameRecord &rec, int col) {
+    if (rec.moveCount >= 2 * MOVES_PER_WORD)
+        return;
+    int i = rec.moveCount++;
+    rec.moves[i / MOVES_PER_WORD] |= uint64_t(col) << (MOVE_BITS * (i % MOVES_PER_WORD));
+}
+
+inline int recordedMove(const GameRecord &rec, int i) {
+    return (int)((rec.moves[i / MOVES_PER_WORD] >> (MOVE_BITS * (i % MOVES_PER_WORD))) & 7);
+}
+
+// Single producer (the owning reactor), single consumer (the archiver).
+struct ArchiveRing {
+    alignas(64) std::atomic<uint64_t> head; // Next record to read.
+    alignas(64) std::atomic<uint64_t> tail; // Next record to write.
+    std::atomic<uint64_t> dropped;
+    GameRecord records[ARCHIVE_RING];
+};
+
+struct Archiver {
+    int fd; // -1 until openArchive().
+    std::mutex lock; // Guards `rings`.
+    std::vector<ArchiveRing*> rings;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<bool> stopping;
+    uint64_t written; // Archiver thread only.
+};
+
+inline Archiver &archiver() {
+    static Archiver instance { -1, {}, {}, {}, {false}, {false}, 0 };
+    return instance;
+}
+
+inline bool archiveEnabled() {
+    return archiver().fd != -1;
+}
+
+// This thread's ring, created and registered on first use.
+inline ArchiveRing &threadArchiveRing() {
+    thread_local ArchiveRing *ring = nullptr;
+    if (ring == nullptr) {
+        ring = new ArchiveRing();
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->tail.store(0, std::memory_order_relaxed);
+        ring->dropped.store(0, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> guard(archiver().lock);
+        archiver().rings.push_back(ring);
+    }
+    return *ring;
+}
+
+/*
+ * Function: archiveGame
+ *
+ * Queues a finished game for the archiver. Never blocks; drops the
+ * record if this thread's ring is full. A no-op without --archive.
+ */
+inline void archiveGame(const GameRecord &rec) {
+    if (!archiveEnabled())
+        return;
+    ArchiveRing &ring = threadArchiveRing();
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (tail - ring.head.load(std::memory_order_acquire) >= ARCHIVE_RING) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring.records[tail & (ARCHIVE_RING - 1)] = rec;
+    ring.tail.store(tail + 1, std::memory_order_release);
+}
+
+/*
+ * Function: openArchive
+ *
+ * Opens (or creates) the archive for appending. A new file gets its
+ * header; an existing one must have a matching header, and any torn
+ * record a crash left at the end is truncated away. Returns false with
+ * the error printed.
+ */
+inline bool openArchive(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        std::cerr << "[ERROR] open(" << path << "): " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::cerr << "[ERROR] fstat(" << path << "): " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        ArchiveHeader header = {};
+        memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+        header.recordSize = sizeof(GameRecord);
+        if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            std::cerr << "[ERROR] write(" << path << "): " << strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+    } else {
+        ArchiveHeader header;
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+            || memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0
+            || header.recordSize != sizeof(GameRecord)) {
+            std::cerr << "[ERROR] " << path << " is not a game archive." << std::endl;
+            close(fd);
+            return false;
+        }
+        off_t whole = sizeof(header) + (st.st_size - sizeof(header)) / sizeof(GameRecord) * sizeof(GameRecord);
+        if (whole != st.st_size) {
+            std::cerr << "[WARN] " << path << ": dropping a torn record at the end." << std::endl;
+            if (ftruncate(fd, whole) != 0) {
+                std::cerr << "[ERROR] ftruncate(" << path << "): " << strerror(errno) << std::endl;
+                close(fd);
+                return false;
+            }
+        }
+    }
+    archiver().fd = fd;
+    return true;
+}
+
+/*
+ * Function: commitArchive
+ *
+ * Takes everything queued on every ring and appends it with one write()
+ * and one fdatasync(). Returns how many games it wrote.
+ */
+inline size_t commitArchive(std::vector<GameRecord> &batch) {
+    Archiver &a = archiver();
+    batch.clear();
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> guard(a.lock);
+        for (size_t i = 0; i < a.rings.size(); i++) {
+            ArchiveRing &ring = *a.rings[i];
+            uint64_t head = ring.head.load(std::memory_order_relaxed);
+            uint64_t tail = ring.tail.load(std::memory_order_acquire);
+            for (; head != tail; head++)
+                batch.push_back(ring.records[head & (ARCHIVE_RING - 1)]);
+            ring.head.store(head, std::memory_order_release);
+            dropped += ring.dropped.exchange(0, std::memory_order_relaxed);
+        }
+    }
+    if (dropped)
+        logMessage(LOG_WARN, "[WARN] Archiver fell behind, dropped {} games.", dropped);
+    if (batch.empty())
+        return 0;
+
+    const char *data = (const char*)batch.data();
+    size_t length = batch.size() * sizeof(GameRecord), done = 0;
+    while (done < length) {
+        ssize_t n = write(a.fd, data + done, length - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            logMessage(LOG_ERROR, "[ERROR] archive write(): {}", LogErrno{errno});
+            return 0;
+        }
+        done += n;
+    }
+    if (fdatasync(a.fd) != 0)
+        logMessage(LOG_ERROR, "[ERROR] archive fdatasync(): {}", LogErrno{errno});
+    a.written += batch.size();
+    return batch.size();
+}
+
+inline void runArchiver() {
+    std::vector<GameRecord> batch;
+    batch.reserve(ARCHIVE_RING);
+    while (!archiver().stopping.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ARCHIVE_COMMIT_MS));
+        commitArchive(batch);
+    }
+    commitArchive(batch);
+}
+
+// Starts the archiver thread, if openArchive() succeeded.
+inline void startArchiver() {
+    Archiver &a = archiver();
+    if (!archiveEnabled() || a.running.exchange(true))
+        return;
+    a.stopping.store(false);
+    a.thread = std::thread(runArchiver);
+}
+
+// Commits whatever is still queued, stops the thread and closes the file.
+inline void stopArchiver() {
+    Archiver &a = archiver();
+    if (!a.running.exchange(false))
+        return;
+    a.stopping.store(true);
+    a.thread.join();
+    logMessage(LOG_INFO, "[INFO] Archived {} games.", a.written);
+    close(a.fd);
+    a.fd = -1;
+}
+
+struct MappedArchive {
+    const GameRecord *games; // nullptr when nothing is mapped.
+    uint64_t count;
+    void *mapped;
+    size_t mappedBytes;
+};
+
+inline void unmapArchive(MappedArchive &archive) {
+    if (archive.mapped)
+        munmap(archive.mapped, archive.mappedBytes);
+    archive.games = nullptr;
+    archive.count = 0;
+    archive.mapped = nullptr;
+    archive.mappedBytes = 0;
+}
+
+/*
+ * Function: mapArchive
+ *
+ * Maps an archive read-only for the replay tool. A torn record at the
+ * end (the server is still writing, or crashed) is left out of count.
+ * Returns false with the error printed.
+ */
+inline bool mapArchive(MappedArchive &archive, const char *path) {
+    archive.games = nullptr;
+    archive.count = 0;
+    archive.mapped = nullptr;
+    archive.mappedBytes = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "[ERROR] open(" << path << "): " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ArchiveHeader)) {
+        std::cerr << "[ERROR] " << path << " is not a game archive." << std::endl;
+        close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file alive.
+    if (mapped == MAP_FAILED) {
+        std::cerr << "[ERROR] mmap(" << path << "): " << strerror(errno) << std::endl;
+        return false;
+    }
+    const ArchiveHeader *header = (const ArchiveHeader*)mapped;
+    if (memcmp(header->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0
+        || header->recordSize != sizeof(GameRecord)) {
+        std::cerr << "[ERROR] " << path << " is not a game archive." << std::endl;
+        munmap(mapped, st.st_size);
+        return false;
+    }
+    madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+    archive.games = (const GameRecord*)(header + 1);
+    archive.count = (st.st_size - sizeof(ArchiveHeader)) / sizeof(GameRecord);
+    archive.mapped = mapped;
+    archive.mappedBytes = st.st_size;
+    return true;
+}
+
+/*
+ * Function: replayGame
+ *
+ * Plays a record's moves through the rule engine into `board` and
+ * checks the record is a game the server could have played: every
+ * move legal, nothing after a four-in-a-row, unused move bits zero,
+ * and the stored result the one the final position calls for (a win
+ * for whoever made four, a tie on a full board, otherwise a timeout
+ * or an abandoned game). Returns false at the first thing wrong.
+ */
+inline bool replayGame(const GameRecord &rec, Board &board) {
+    initBoard(board);
+    if (rec.result >= RESULT_COUNT || rec.moveCount > ROWS * COLS)
+        return false;
+    int winner = -1;
+    for (int i = 0; i < rec.moveCount; i++) {
+        int col = recordedMove(rec, i);
+        int side = i & 1; // The client always moves first.
+        if (winner != -1 || dropPiece(board, col, side ? 'S' : 'C') == -1)
+            return false;
+        if (hasFour(board.pieces[side]))
+            winner = side;
+    }
+    int used = rec.moveCount * MOVE_BITS;
+    for (int w = 0; w < 2; w++) {
+        int bits = used - w * MOVES_PER_WORD * MOVE_BITS;
+        uint64_t spare = bits <= 0 ? ~uint64_t(0) : bits >= 64 ? 0 : ~uint64_t(0) << bits;
+        if (rec.moves[w] & spare)
+            return false;
+    }
+    switch (rec.result) {
+    case RESULT_CLIENT_WIN: return winner == 0;
+    case RESULT_SERVER_WIN: return winner == 1;
+    case RESULT_TIE:        return winner == -1 && checkTie(board);
+    default:                return winner == -1 && !checkTie(board);
+    }
+}
+
+#endif // ARCHIVE_H
@@ -0,0 +1,243 @@
+/*
+ *  batch.h
+ *
+ *  -------------------------------------------------------------------
+ *  Batch game simulator: thousands of random games held in
+ *  structure-of-arrays form and advanced one ply per step, for
+ *  self-play statistics and raw rule throughput (simulate.cpp).
+ *
+ *  Each lane is one game, stored as the side to move's stones and the
+ *  other side's stones (the bitboard layout from bitboard.h), the ply
+ *  count, the first move played after the opening and a per-lane
+ *  xorshift RNG. A step picks a random column for every lane, drops
+ *  the piece with the carry trick ((all + bottom) & column), tests the
+ *  mover for four in a row with the same shift-and-AND as hasFour()
+ *  and swaps sides. Finished games are tallied and the lane restarts
+ *  from the opening position.
+ *
+ *  stepAvx2() does four lanes per instruction and is picked at run
+ *  time when the CPU has AVX2; stepScalar() is the fallback. Both draw
+ *  the same random numbers in the same order, so for a given seed they
+ *  play exactly the same games.
+ *
+ *  Random moves: column = (rand * 7) >> 32; if that column is full the
+ *  next non-full one to the right (wrapping) is taken. That's a little
+ *  biased once columns fill up, which doesn't matter for throughput
+ *  tests or for comparing first moves against each other.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "bitboard.h"
+
+const int MAX_PLIES = ROWS * COLS;
+const size_t LANE_GROUP = 4; // Lanes per AVX2 register; batches come in multiples of it.
+
+enum SimOutcome {
+    OUTCOME_FIRST_WINS = 0, // The player who moved first (the client).
+    OUTCOME_SECOND_WINS,
+    OUTCOME_DRAW,
+    OUTCOME_COUNT
+};
+
+struct SimStats {
+    uint64_t games;
+    uint64_t moves;
+    uint64_t byFirstMove[COLS][OUTCOME_COUNT];
+    uint64_t lengths[MAX_PLIES + 1]; // Games by total plies on the board at the end.
+};
+
+struct GameBatch {
+    size_t lanes;
+    std::vector<uint64_t> toMove;  // Stones of the side to move.
+    std::vector<uint64_t> waiting; // Stones of the side that just moved.
+    std::vector<uint64_t> plies;
+    std::vector<uint64_t> first;   // Column of the first move after the opening.
+    std::vector<uint64_t> rng;
+    // Every game starts from here (the empty board unless an opening was given).
+    uint64_t startToMove, startWaiting, startPlies;
+};
+
+inline uint64_t nextLaneRandom(uint64_t &x) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+/*
+ * Function: initBatch
+ *
+ * Sets up `lanes` games (rounded up to a multiple of LANE_GROUP) at
+ * `start`, which must not be finished, and seeds every lane's RNG
+ * from `seed`.
+ */
+inline void initBatch(GameBatch &batch, size_t lanes, const Board &start, uint64_t seed) {
+    lanes = (lanes + LANE_GROUP - 1) / LANE_GROUP * LANE_GROUP;
+    batch.lanes = lanes;
+    batch.startToMove = start.pieces[start.moves & 1];
+    batch.startWaiting = start.pieces[(start.moves & 1) ^ 1];
+    batch.startPlies = start.moves;
+    batch.toMove.assign(lanes, batch.startToMove);
+    batch.waiting.assign(lanes, batch.startWaiting);
+    batch.plies.assign(lanes, batch.startPlies);
+    batch.first.assign(lanes, COLS);
+    batch.rng.resize(lanes);
+    uint64_t s = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < lanes; i++) {
+        // splitmix64, so neighbouring lanes don't start correlated.
+        s += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = s;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        batch.rng[i] = (z ^ (z >> 31)) | 1;
+    }
+}
+
+/*
+ * Function: finishLane
+ *
+ * Tallies lane i's game, which just ended on the move that brought it
+ * to `plies`, and puts the lane back at the start position.
+ */
+inline void finishLane(GameBatch &batch, SimStats &stats, size_t i, uint64_t plies, bool won) {
+    int outcome = !won ? OUTCOME_DRAW : (plies & 1) ? OUTCOME_FIRST_WINS : OUTCOME_SECOND_WINS;
+    stats.games++;
+    stats.byFirstMove[batch.first[i]][outcome]++;
+    stats.lengths[plies]++;
+    batch.toMove[i] = batch.startToMove;
+    batch.waiting[i] = batch.startWaiting;
+    batch.plies[i] = batch.startPlies;
+    batch.first[i] = COLS;
+}
+
+// Plays one random move in every lane.
+inline void stepScalar(GameBatch &batch, SimStats &stats) {
+    for (size_t i = 0; i < batch.lanes; i++) {
+        uint64_t mask = batch.toMove[i] | batch.waiting[i];
+        uint64_t col = ((nextLaneRandom(batch.rng[i]) >> 32) * COLS) >> 32;
+        while (mask & (uint64_t(1) << (col * COL_BITS + ROWS - 1)))
+            col = col == COLS - 1 ? 0 : col + 1;
+        uint64_t bit = (mask + (uint64_t(1) << (col * COL_BITS))) & columnMask(col);
+        uint64_t mover = batch.toMove[i] | bit;
+        if (batch.plies[i] == batch.startPlies)
+            batch.first[i] = col;
+        uint64_t plies = ++batch.plies[i];
+        bool won = hasFour(mover);
+        if (won || plies == MAX_PLIES) {
+            finishLane(batch, stats, i, plies, won);
+            continue;
+        }
+        batch.toMove[i] = batch.waiting[i];
+        batch.waiting[i] = mover;
+    }
+    stats.moves += batch.lanes;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+inline __m256i runOfFour(__m256i b, int d) {
+    __m256i m = _mm256_and_si256(b, _mm256_srli_epi64(b, d));
+    return _mm256_and_si256(m, _mm256_srli_epi64(m, 2 * d));
+}
+
+/*
+ * Function: stepAvx2
+ *
+ * stepScalar() four lanes at a time. Columns become per-lane shift
+ * counts (col * COL_BITS) for the variable shifts; the full-column
+ * retry loop only runs while some lane still landed on a full column.
+ * Finished lanes are handed to finishLane() after the vectors are
+ * stored back.
+ */
+__attribute__((target("avx2")))
+inline void stepAvx2(GameBatch &batch, SimStats &stats) {
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i seven = _mm256_set1_epi64x(COLS);
+    const __m256i column = _mm256_set1_epi64x((1 << ROWS) - 1);
+    const __m256i topRow = _mm256_set1_epi64x(ROWS - 1);
+    const __m256i maxPlies = _mm256_set1_epi64x(MAX_PLIES);
+    const __m256i startPlies = _mm256_set1_epi64x(batch.startPlies);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (size_t i = 0; i < batch.lanes; i += LANE_GROUP) {
+        __m256i toMove = _mm256_loadu_si256((const __m256i*)&batch.toMove[i]);
+        __m256i waiting = _mm256_loadu_si256((const __m256i*)&batch.waiting[i]);
+        __m256i plies = _mm256_loadu_si256((const __m256i*)&batch.plies[i]);
+        __m256i first = _mm256_loadu_si256((const __m256i*)&batch.first[i]);
+        __m256i x = _mm256_loadu_si256((const __m256i*)&batch.rng[i]);
+        __m256i mask = _mm256_or_si256(toMove, waiting);
+
+        x = _mm256_xor_si256(x, _mm256_slli_epi64(x, 13));
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 7));
+        x = _mm256_xor_si256(x, _mm256_slli_epi64(x, 17));
+        __m256i col = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), seven), 32);
+
+        __m256i shift = _mm256_sub_epi64(_mm256_slli_epi64(col, 3), col); // col * COL_BITS
+        __m256i top = _mm256_sllv_epi64(one, _mm256_add_epi64(shift, topRow));
+        __m256i full = _mm256_cmpeq_epi64(_mm256_and_si256(mask, top), top);
+        while (!_mm256_testz_si256(full, full)) {
+            col = _mm256_add_epi64(col, _mm256_and_si256(full, one));
+            col = _mm256_and_si256(col, _mm256_cmpgt_epi64(seven, col)); // 7 wraps to 0
+            shift = _mm256_sub_epi64(_mm256_slli_epi64(col, 3), col);
+            top = _mm256_sllv_epi64(one, _mm256_add_epi64(shift, topRow));
+            full = _mm256_cmpeq_epi64(_mm256_and_si256(mask, top), top);
+        }
+
+        __m256i bottom = _mm256_sllv_epi64(one, shift);
+        __m256i bit = _mm256_and_si256(_mm256_add_epi64(mask, bottom), _mm256_sllv_epi64(column, shift));
+        __m256i mover = _mm256_or_si256(toMove, bit);
+        first = _mm256_blendv_epi8(first, col, _mm256_cmpeq_epi64(plies, startPlies));
+        plies = _mm256_add_epi64(plies, one);
+
+        __m256i runs = _mm256_or_si256(
+            _mm256_or_si256(runOfFour(mover, 1), runOfFour(mover, COL_BITS)),
+            _mm256_or_si256(runOfFour(mover, COL_BITS - 1), runOfFour(mover, COL_BITS + 1)));
+        __m256i won = _mm256_xor_si256(_mm256_cmpeq_epi64(runs, zero), _mm256_cmpeq_epi64(zero, zero));
+        __m256i done = _mm256_or_si256(won, _mm256_cmpeq_epi64(plies, maxPlies));
+
+        _mm256_storeu_si256((__m256i*)&batch.toMove[i], waiting);
+        _mm256_storeu_si256((__m256i*)&batch.waiting[i], mover);
+        _mm256_storeu_si256((__m256i*)&batch.plies[i], plies);
+        _mm256_storeu_si256((__m256i*)&batch.first[i], first);
+        _mm256_storeu_si256((__m256i*)&batch.rng[i], x);
+
+        int doneLanes = _mm256_movemask_pd(_mm256_castsi256_pd(done));
+        if (doneLanes) {
+            int wonLanes = _mm256_movemask_pd(_mm256_castsi256_pd(won));
+            for (size_t lane = 0; lane < LANE_GROUP; lane++)
+                if (doneLanes & (1 << lane))
+                    finishLane(batch, stats, i + lane, batch.plies[i + lane], wonLanes & (1 << lane));
+        }
+    }
+    stats.moves += batch.lanes;
+}
+
+inline bool haveAvx2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+inline void stepAvx2(GameBatch &batch, SimStats &stats) {
+    stepScalar(batch, stats);
+}
+
+inline bool haveAvx2() {
+    return false;
+}
+
+#endif
+
+#endif // BATCH_H
@@ -0,0 +1,345 @@
+/*
+ *  bench.cpp
+ *
+ *  -------------------------------------------------------------------
+ *  Microbenchmarks for the game-rule hot path:
+ *
+ *      run_bench.x [--positions <n>] [--rounds <n>]
+ *
+ *  Times dropPiece, checkWin, checkTie, boardToString and MOVE parsing
+ *  over randomized legal positions and prints ns/op and heap
+ *  allocations/op (operator new is counted below). "sessionTurn" runs
+ *  whole server turns - client MOVE line in, server reply, frame
+ *  written to a socketpair and read back - and must stay at 0
+ *  allocs/op once warmed up: run_bench.x exits with 2 if it doesn't,
+ *  so a regression fails the run. "metrics" times count() and record(),
+ *  which stay on in production. Every rule op is
+ *  also run against the original char[ROWS][COLS] implementation from
+ *  before the bitboard rewrite, kept here verbatim in `legacy`, so any
+ *  future engine change can be measured against both.
+ *  -------------------------------------------------------------------
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "metrics.h"
+#include "session.h" // parseMove(), handleClientLine(), applyServerMove()
+
+static uint64_t g_allocations = 0;
+
+void *operator new(size_t size) {
+    g_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// The original array-based rules, unchanged apart from the namespace.
+namespace legacy {
+
+void initBoard(char board[ROWS][COLS]) {
+    for (int i = 0; i < ROWS; i++)
+        for (int j = 0; j < COLS; j++)
+            board[i][j] = '.';
+}
+
+std::string boardToString(const char board[ROWS][COLS]) {
+    std::ostringstream oss;
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            oss << board[i][j];
+            if (j < COLS - 1)
+                oss << " ";
+        }
+        oss << "\n";
+    }
+    return oss.str();
+}
+
+int dropPiece(char board[ROWS][COLS], int col, char piece) {
+    if (col < 0 || col >= COLS)
+        return -1;
+    for (int row = ROWS - 1; row >= 0; row--) {
+        if (board[row][col] == '.') {
+            board[row][col] = piece;
+            return row;
+        }
+    }
+    return -1;
+}
+
+bool checkWin(const char board[ROWS][COLS], int row, int col, char piece) {
+    int directions[4][2] = { {0, 1}, {1, 0}, {1, 1}, {1, -1} };
+    for (int i = 0; i < 4; i++) {
+        int dr = directions[i][0], dc = directions[i][1];
+        int count = 1;
+        int r = row + dr, c = col + dc;
+        while (r >= 0 && r < ROWS && c >= 0 && c < COLS && board[r][c] == piece) {
+            count++;
+            r += dr;
+            c += dc;
+        }
+        r = row - dr;
+        c = col - dc;
+        while (r >= 0 && r < ROWS && c >= 0 && c < COLS && board[r][c] == piece) {
+            count++;
+            r -= dr;
+            c -= dc;
+        }
+        if (count >= 4)
+            return true;
+    }
+    return false;
+}
+
+bool checkTie(const char board[ROWS][COLS]) {
+    for (int i = 0; i < ROWS; i++)
+        for (int j = 0; j < COLS; j++)
+            if (board[i][j] == '.')
+                return false;
+    return true;
+}
+
+} // namespace legacy
+
+// One randomized legal, unfinished position in both representations.
+struct BenchPosition {
+    Board board;
+    char array[ROWS][COLS];
+    int lastRow, lastCol;  // The move that produced it, for checkWin.
+    char lastPiece;
+    int nextCol;           // A legal column to drop into next.
+    char nextPiece;
+};
+
+static uint64_t g_rng = 0x2545F4914F6CDD1DULL;
+
+static uint64_t nextRandom() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static int randomLegalColumn(const Board &b) {
+    int legal[COLS], count = 0;
+    for (int c = 0; c < COLS; c++)
+        if (b.heights[c] < ROWS)
+            legal[count++] = c;
+    return legal[nextRandom() % count];
+}
+
+static std::vector<BenchPosition> makePositions(int count) {
+    std::vector<BenchPosition> positions;
+    while ((int)positions.size() < count) {
+        BenchPosition p;
+        initBoard(p.board);
+        legacy::initBoard(p.array);
+        int plies = 1 + nextRandom() % (ROWS * COLS - 2);
+        bool ok = true;
+        for (int i = 0; i < plies && ok; i++) {
+            char piece = (i & 1) ? 'S' : 'C';
+            int col = randomLegalColumn(p.board);
+            int row = dropPiece(p.board, col, piece);
+            legacy::dropPiece(p.array, col, piece);
+            p.lastRow = row;
+            p.lastCol = col;
+            p.lastPiece = piece;
+            ok = !checkWin(p.board, row, col, piece);
+        }
+        if (!ok || checkTie(p.board))
+            continue; // Keep only positions where the game is still going.
+        p.nextCol = randomLegalColumn(p.board);
+        p.nextPiece = p.lastPiece == 'C' ? 'S' : 'C';
+        positions.push_back(p);
+    }
+    return positions;
+}
+
+static volatile uint64_t g_sink; // Keeps results alive so nothing gets optimised out.
+
+struct BenchResult {
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+template <typename Op>
+static BenchResult runBench(int rounds, size_t perRound, Op op) {
+    uint64_t sink = 0;
+    uint64_t allocsBefore = g_allocations;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        sink += op();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocs = g_allocations - allocsBefore;
+    g_sink = sink;
+    double ops = (double)rounds * perRound;
+    BenchResult result = { ns / ops, allocs / ops };
+    return result;
+}
+
+static void report(const char *name, const char *impl, BenchResult r) {
+    printf("%-16s %-10s %10.2f ns/op %8.2f allocs/op\n", name, impl, r.nsPerOp, r.allocsPerOp);
+}
+
+int main(int argc, char *argv[]) {
+    int count = 4096;
+    int rounds = 200;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--positions") == 0 && i + 1 < argc)
+            count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--positions <n>] [--rounds <n>]\n";
+            return 1;
+        }
+    }
+    if (count <= 0 || rounds <= 0) {
+        std::cerr << "--positions and --rounds must be positive.\n";
+        return 1;
+    }
+
+    std::vector<BenchPosition> positions = makePositions(count);
+    std::vector<std::string> moveLines;
+    for (int i = 0; i < count; i++)
+        moveLines.push_back("MOVE " + std::to_string(1 + nextRandom() % 9)); // Some out of range on purpose.
+    size_t n = positions.size();
+
+    printf("%d positions x %d rounds\n", count, rounds);
+
+    report("dropPiece", "bitboard", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++) {
+            Board b = positions[i].board;
+            s += dropPiece(b, positions[i].nextCol, positions[i].nextPiece);
+        }
+        return s;
+    }));
+    report("dropPiece", "legacy", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++) {
+            char a[ROWS][COLS];
+            memcpy(a, positions[i].array, sizeof(a));
+            s += legacy::dropPiece(a, positions[i].nextCol, positions[i].nextPiece);
+        }
+        return s;
+    }));
+
+    report("checkWin", "bitboard", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++) {
+            const BenchPosition &p = positions[i];
+            s += checkWin(p.board, p.lastRow, p.lastCol, p.lastPiece);
+        }
+        return s;
+    }));
+    report("checkWin", "legacy", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++) {
+            const BenchPosition &p = positions[i];
+            s += legacy::checkWin(p.array, p.lastRow, p.lastCol, p.lastPiece);
+        }
+        return s;
+    }));
+
+    report("checkTie", "bitboard", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++)
+            s += checkTie(positions[i].board);
+        return s;
+    }));
+    report("checkTie", "legacy", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++)
+            s += legacy::checkTie(positions[i].array);
+        return s;
+    }));
+
+    report("boardToString", "bitboard", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++)
+            s += boardToString(positions[i].board).size();
+        return s;
+    }));
+    report("boardToString", "legacy", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++)
+            s += legacy::boardToString(positions[i].array).size();
+        return s;
+    }));
+
+    report("parseMove", "session", runBench(rounds, n, [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++) {
+            int col;
+            s += parseMove(moveLines[i], col) ? col : 0;
+        }
+        return s;
+    }));
+
+    Metrics *metrics = newThreadMetrics();
+    report("metrics", "count", runBench(rounds, n, [&]() {
+        for (size_t i = 0; i < n; i++)
+            ::count(*metrics, COUNT_BYTES_OUT, i); // main()'s `count` hides it.
+        return metrics->counters[COUNT_BYTES_OUT].load(std::memory_order_relaxed);
+    }));
+    report("metrics", "record", runBench(rounds, n, [&]() {
+        for (size_t i = 0; i < n; i++)
+            record(*metrics, HIST_MOVE_REPLY, positions[i].board.pieces[0]);
+        return metrics->histograms[HIST_MOVE_REPLY][0].load(std::memory_order_relaxed);
+    }));
+
+    // Whole turns through a session, start of game to game over and
+    // again. One op is one client move plus the server's reply.
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    static const char *MOVES[COLS] = { "MOVE 1", "MOVE 2", "MOVE 3", "MOVE 4", "MOVE 5", "MOVE 6", "MOVE 7" };
+    Session *session = new Session();
+    initConnection(session->conn, sv[0]);
+    session->state = GAME_OVER;
+    char drain[4096];
+    auto turns = [&]() {
+        uint64_t s = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (session->state == GAME_OVER)
+                startSession(*session);
+            handleClientLine(*session, MOVES[randomLegalColumn(session->board)]);
+            if (session->state == AWAIT_SERVER_MOVE)
+                applyServerMove(*session, 1 + randomLegalColumn(session->board));
+            flushOutput(session->conn);
+            s += read(sv[1], drain, sizeof(drain));
+        }
+        return s;
+    };
+    setLogLevel(LOG_ERROR); // No logger thread here; keep the per-move lines off the ring.
+    turns(); // Warm up: grows the chunk ring to its working size.
+    BenchResult sessionTurn = runBench(rounds, n, turns);
+    report("sessionTurn", "session", sessionTurn);
+    delete session;
+    close(sv[0]);
+    close(sv[1]);
+    if (sessionTurn.allocsPerOp > 0) {
+        std::cerr << "sessionTurn allocates on the heap; it must not once warmed up.\n";
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,351 @@
+/*
+ *  bitboard.h
+ *
+ *  -------------------------------------------------------------------
+ *  Bitboard game engine for Connect 4. Replaces the old
+ *  char board[ROWS][COLS] with two 64-bit masks (one per player) plus
+ *  per-column heights and a move counter.
+ *
+ *  Bit layout (column-major, one spare "sentinel" bit on top of every
+ *  column so shifts never bleed from one column into the next):
+ *
+ *       6 13 20 27 34 41 48   <- sentinel row, always 0
+ *       5 12 19 26 33 40 47   <- top row    (row 0 in the old array)
+ *       4 11 18 25 32 39 46
+ *       3 10 17 24 31 38 45
+ *       2  9 16 23 30 37 44
+ *       1  8 15 22 29 36 43
+ *       0  7 14 21 28 35 42   <- bottom row (row 5 in the old array)
+ *
+ *  The engine is a template, Geometry<Rows, Cols, Connect>, so other
+ *  board sizes and run lengths (see variants.h) get their own fully
+ *  specialised copy: masks, shifts and the column header are all
+ *  compile-time constants, and boards with more than 64 cells plus
+ *  sentinels use 128-bit masks. The game itself is Classic, 6 rows by
+ *  7 columns, four to win.
+ *
+ *  The public functions below are Classic's and keep the exact names
+ *  and return values of the old array-based ones (rows are still
+ *  counted from the top), so the game loop in server_skeleton.cpp
+ *  didn't have to change.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+
+__extension__ typedef unsigned __int128 uint128; // Masks of boards past 64 bits.
+
+// Maps the protocol's piece characters onto an index into Board::pieces.
+inline int pieceIndex(char piece) {
+    return piece == 'S' ? 1 : 0;
+}
+
+// " 1 2 3 ... n", the line printed above a board.
+template <int Cols>
+struct HeaderText {
+    char text[2 * Cols + 1];
+};
+
+template <int Cols>
+constexpr HeaderText<Cols> makeHeader() {
+    HeaderText<Cols> header = {};
+    for (int c = 0; c < Cols; c++) {
+        header.text[2 * c] = ' ';
+        header.text[2 * c + 1] = (char)('1' + c);
+    }
+    header.text[2 * Cols] = '\0';
+    return header;
+}
+
+template <int Rows, int Cols, int Connect>
+struct Geometry {
+    static_assert(Cols >= 1 && Cols <= 9, "columns are single digits on the wire");
+    static_assert(Connect >= 2 && (Connect <= Rows || Connect <= Cols), "a run that can't fit");
+    static_assert((Rows + 1) * Cols <= 128, "the board and its sentinels must fit in 128 bits");
+
+    static constexpr int ROWS = Rows;
+    static constexpr int COLS = Cols;
+    static constexpr int CONNECT = Connect;
+    static constexpr int COL_BITS = Rows + 1; // +1 for the sentinel bit.
+    static constexpr int CELLS = Rows * Cols;
+
+    typedef typename std::conditional<(Rows + 1) * Cols <= 64, uint64_t, uint128>::type Mask;
+
+    struct Board {
+        Mask pieces[2];         // [0] = client ('C'), [1] = server ('S')
+        uint8_t heights[Cols];  // Number of pieces already in each column.
+        int moves;              // Total pieces on the board, used for isFull().
+    };
+
+    // One bit at the bottom of every column, and every playable (non-sentinel) cell.
+    static constexpr Mask bottomMask() {
+        Mask mask = 0;
+        for (int c = 0; c < Cols; c++)
+            mask |= Mask(1) << (c * COL_BITS);
+        return mask;
+    }
+    static constexpr Mask BOTTOM = bottomMask();
+    static constexpr Mask FULL = BOTTOM * ((Mask(1) << Rows) - 1);
+
+    static constexpr Mask column(int col) {
+        return ((Mask(1) << Rows) - 1) << (col * COL_BITS);
+    }
+
+    static constexpr HeaderText<Cols> HEADER = makeHeader<Cols>();
+
+    // Text rendering: Rows lines of "c c c ... c\n", top row first.
+    static constexpr int ROW_TEXT = Cols * 2;          // Bytes per rendered row, '\n' included.
+    static constexpr int BOARD_TEXT = Rows * ROW_TEXT; // Bytes in a rendered board.
+
+    static void init(Board &board) {
+        board.pieces[0] = board.pieces[1] = 0;
+        for (int j = 0; j < Cols; j++)
+            board.heights[j] = 0;
+        board.moves = 0;
+    }
+
+    static Mask cellBit(int row, int col) {
+        return Mask(1) << (col * COL_BITS + (Rows - 1 - row));
+    }
+
+    static char cellAt(const Board &board, int row, int col) {
+        Mask bit = cellBit(row, col);
+        if (board.pieces[0] & bit) return 'C';
+        if (board.pieces[1] & bit) return 'S';
+        return '.';
+    }
+
+    // Row counted from the top the piece landed in, or -1 if the column
+    // is out of range or full.
+    static int drop(Board &board, int col, int player) {
+        if (col < 0 || col >= Cols)
+            return -1;
+        int height = board.heights[col];
+        if (height >= Rows)
+            return -1;
+        board.pieces[player] |= Mask(1) << (col * COL_BITS + height);
+        board.heights[col] = height + 1;
+        board.moves++;
+        return Rows - 1 - height;
+    }
+
+    /*
+     * Function: hasRun
+     *
+     * Connect stones in a row along the direction whose neighbour is
+     * Shift bits away. Each step doubles the run length m covers
+     * (m & m >> len*Shift), and a last, overlapping step tops it up to
+     * exactly Connect, so four takes two ANDs and five takes three.
+     */
+    template <int Shift>
+    static bool hasRun(Mask b) {
+        Mask m = b;
+        int length = 1;
+        for (; length * 2 <= Connect; length *= 2)
+            m &= m >> (length * Shift);
+        if (length < Connect)
+            m &= m >> ((Connect - length) * Shift);
+        return m != 0;
+    }
+
+    // Shift-and-AND test over the whole mask. The sentinel row keeps
+    // the horizontal and diagonal shifts from wrapping into the next column.
+    static bool hasWin(Mask b) {
+        return hasRun<1>(b)                // vertical
+            || hasRun<COL_BITS>(b)         // horizontal
+            || hasRun<COL_BITS - 1>(b)     // diagonal "\"
+            || hasRun<COL_BITS + 1>(b);    // diagonal "/"
+    }
+
+    static bool isFull(const Board &board) {
+        return board.moves >= CELLS;
+    }
+
+    // Unique key: the side to move's stones plus the occupied mask
+    // offset by the bottom row (see positionKey()).
+    static Mask key(const Board &board) {
+        return board.pieces[board.moves & 1] + (board.pieces[0] | board.pieces[1]) + BOTTOM;
+    }
+
+    static void render(const Board &board, char *out) {
+        for (int i = 0; i < Rows; i++) {
+            for (int j = 0; j < Cols; j++) {
+                out[i * ROW_TEXT + j * 2] = cellAt(board, i, j);
+                out[i * ROW_TEXT + j * 2 + 1] = j < Cols - 1 ? ' ' : '\n';
+            }
+        }
+    }
+
+    // Plays 1-based column digits from the current position, see playSequence().
+    static bool play(Board &board, const char *moves) {
+        for (const char *p = moves; *p; p++) {
+            if (hasWin(board.pieces[0]) || hasWin(board.pieces[1]))
+                return false;
+            if (*p < '1' || *p > '0' + Cols || drop(board, *p - '1', board.moves & 1) == -1)
+                return false;
+        }
+        return true;
+    }
+};
+
+typedef Geometry<6, 7, 4> Classic;
+typedef Classic::Board Board;
+
+const int ROWS = Classic::ROWS;
+const int COLS = Classic::COLS;
+const int COL_BITS = Classic::COL_BITS;
+const uint64_t BOTTOM_MASK = Classic::BOTTOM;
+const uint64_t FULL_MASK = Classic::FULL;
+const char *const BOARD_HEADER = Classic::HEADER.text; // " 1 2 3 4 5 6 7"
+
+inline uint64_t columnMask(int col) {
+    return Classic::column(col);
+}
+
+inline uint64_t cellBit(int row, int col) {
+    return Classic::cellBit(row, col);
+}
+
+inline void initBoard(Board &board) {
+    Classic::init(board);
+}
+
+inline char cellAt(const Board &board, int row, int col) {
+    return Classic::cellAt(board, row, col);
+}
+
+inline void printBoard(const Board &board) {
+    std::cout << BOARD_HEADER << std::endl;
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            std::cout << cellAt(board, i, j) << " ";
+        }
+        std::cout << std::endl;
+    }
+}
+
+const int ROW_TEXT = Classic::ROW_TEXT;
+const int BOARD_TEXT = Classic::BOARD_TEXT;
+
+// Offset of a cell's character in a rendered board (row counted from the top).
+inline int cellOffset(int row, int col) {
+    return row * ROW_TEXT + col * 2;
+}
+
+/*
+ * Function: renderBoard
+ *
+ * Writes the BOARD_TEXT bytes of the board's text form into `out`.
+ * After that, a move only changes the one byte at cellOffset(), so
+ * callers that keep the text around patch it rather than re-render.
+ */
+inline void renderBoard(const Board &board, char *out) {
+    Classic::render(board, out);
+}
+
+inline std::string boardToString(const Board &board) {
+    char text[BOARD_TEXT];
+    renderBoard(board, text);
+    return std::string(text, BOARD_TEXT);
+}
+
+/*
+ * Function: dropPiece
+ *
+ * O(1): the landing square is just heights[col], no scanning.
+ * Returns the row (counted from the top, like the old array) the piece
+ * landed in, or -1 if the column is out of range or already full.
+ */
+inline int dropPiece(Board &board, int col, char piece) {
+    return Classic::drop(board, col, pieceIndex(piece));
+}
+
+/*
+ * Function: hasFour
+ *
+ * Shift-and-AND test for four in a row anywhere in a player's mask.
+ * For each direction d, m = b & (b >> d) marks every bit that has a
+ * neighbour at distance d; m & (m >> 2d) then leaves only bits that
+ * start a run of four.
+ */
+inline bool hasFour(uint64_t b) {
+    return Classic::hasWin(b);
+}
+
+// row/col are kept for compatibility with the old signature; a bitboard
+// win test looks at the whole mask at once so it doesn't need them.
+inline bool checkWin(const Board &board, int row, int col, char piece) {
+    (void)row;
+    (void)col;
+    return hasFour(board.pieces[pieceIndex(piece)]);
+}
+
+inline bool checkTie(const Board &board) {
+    return Classic::isFull(board);
+}
+
+/*
+ * Function: playSequence
+ *
+ * Plays a string of 1-based column digits (e.g. "4453") from the
+ * current position, alternating 'C' and 'S' starting with whoever is
+ * to move. Returns false on a bad digit, a full column, or a move
+ * after the game is already won.
+ */
+inline bool playSequence(Board &board, const char *moves) {
+    return Classic::play(board, moves);
+}
+
+/*
+ * Function: positionKey
+ *
+ * Unique 49-bit key for a position: the side to move's stones plus
+ * the occupied mask offset by the bottom row. Adding BOTTOM_MASK sets
+ * one marker bit just above the top stone of each column, so two
+ * different positions can never produce the same key.
+ */
+inline uint64_t positionKey(const Board &board) {
+    return Classic::key(board);
+}
+
+// Left-right mirror of one player's stones.
+inline uint64_t mirrorBits(uint64_t pieces) {
+    uint64_t out = 0;
+    for (int c = 0; c < COLS; c++)
+        out |= ((pieces >> (c * COL_BITS)) & ((uint64_t(1) << COL_BITS) - 1)) << ((COLS - 1 - c) * COL_BITS);
+    return out;
+}
+
+inline Board mirrorBoard(const Board &board) {
+    Board out;
+    out.pieces[0] = mirrorBits(board.pieces[0]);
+    out.pieces[1] = mirrorBits(board.pieces[1]);
+    for (int c = 0; c < COLS; c++)
+        out.heights[c] = board.heights[COLS - 1 - c];
+    out.moves = board.moves;
+    return out;
+}
+
+/*
+ * Function: canonicalKey
+ *
+ * positionKey() of the board or of its mirror, whichever is smaller.
+ * Sets `mirrored` when the mirror's key was taken, so the caller knows
+ * to flip columns (col -> COLS - 1 - col) going in or out. Each column
+ * of a key fits in its own COL_BITS (no carries between columns), so
+ * mirroring the key is the same as keying the mirrored board.
+ */
+inline uint64_t canonicalKey(const Board &board, bool &mirrored) {
+    uint64_t key = positionKey(board);
+    uint64_t mirrorKey = mirrorBits(key);
+    mirrored = mirrorKey < key;
+    return mirrored ? mirrorKey : key;
+}
+
+#endif // BITBOARD_H
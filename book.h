@@ -0,0 +1,150 @@
+/*
+ *  book.h
+ *
+ *  -------------------------------------------------------------------
+ *  Opening book: precomputed best moves for the early plies, where the
+ *  search is slowest and the positions repeat the most. book_gen.cpp
+ *  writes the file; the server mmap()s it read-only at startup
+ *  (--book <file>) and looks moves up before falling back to search.
+ *
+ *  File layout (little-endian, no parsing needed, just map it):
+ *
+ *      BookHeader   32 bytes: magic "C4BOOK01", max ply, entry count
+ *      uint64_t[]   entries, sorted ascending, each (key << 8) | column
+ *
+ *  The key is the canonical position key: the smaller of the position's
+ *  key and its left-right mirror's, so mirrored positions share one
+ *  entry. The stored column is for the canonical orientation and gets
+ *  flipped back on lookup when the mirror was the smaller key (see
+ *  canonicalKey() in bitboard.h).
+ *  Lookup is a binary search over the mapped array - no allocation -
+ *  and the pages are shared by every server process using the file.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+
+const char BOOK_MAGIC[8] = { 'C', '4', 'B', 'O', 'O', 'K', '0', '1' };
+
+struct BookHeader {
+    char     magic[8];
+    uint32_t maxPly;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t reserved2;
+};
+
+struct OpeningBook {
+    const BookHeader *header; // nullptr when no book is loaded.
+    const uint64_t *entries;
+    uint64_t count;
+    size_t mappedBytes;
+};
+
+inline void closeBook(OpeningBook &book) {
+    if (book.header)
+        munmap((void*)book.header, book.mappedBytes);
+    book.header = nullptr;
+    book.entries = nullptr;
+    book.count = 0;
+    book.mappedBytes = 0;
+}
+
+/*
+ * Function: openBook
+ *
+ * Maps a book file read-only and checks its header, and that the
+ * entries are sorted with a column on the board each, since lookups
+ * trust both. Returns false (and leaves `book` empty) if the file
+ * can't be opened or isn't a book.
+ */
+inline bool openBook(OpeningBook &book, const char *path) {
+    book.header = nullptr;
+    book.entries = nullptr;
+    book.count = 0;
+    book.mappedBytes = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "[ERROR] open(" << path << "): " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BookHeader)) {
+        std::cerr << "[ERROR] " << path << " is not an opening book." << std::endl;
+        close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file alive.
+    if (mapped == MAP_FAILED) {
+        std::cerr << "[ERROR] mmap(" << path << "): " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    const BookHeader *header = (const BookHeader*)mapped;
+    if (memcmp(header->magic, BOOK_MAGIC, sizeof(BOOK_MAGIC)) != 0
+        || sizeof(BookHeader) + header->count * sizeof(uint64_t) != (size_t)st.st_size) {
+        std::cerr << "[ERROR] " << path << " is not an opening book." << std::endl;
+        munmap(mapped, st.st_size);
+        return false;
+    }
+    const uint64_t *entries = (const uint64_t*)(header + 1);
+    for (uint64_t i = 0; i < header->count; i++) {
+        if ((entries[i] & 0xFF) >= (uint64_t)COLS || (i > 0 && entries[i] >> 8 <= entries[i - 1] >> 8)) {
+            std::cerr << "[ERROR] " << path << ": bad or out-of-order entry " << i << "." << std::endl;
+            munmap(mapped, st.st_size);
+            return false;
+        }
+    }
+    book.header = header;
+    book.entries = entries;
+    book.count = header->count;
+    book.mappedBytes = st.st_size;
+    return true;
+}
+
+/*
+ * Function: bookMove
+ *
+ * Returns the book's 0-based column for this position, or -1 if the
+ * position isn't in the book or the column it gives can't be played
+ * here (a book built for other rules, or a key collision).
+ */
+inline int bookMove(const OpeningBook &book, const Board &board) {
+    if (book.count == 0 || board.moves > (int)book.header->maxPly)
+        return -1;
+    bool mirrored;
+    uint64_t key = canonicalKey(board, mirrored);
+
+    uint64_t lo = 0, hi = book.count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        uint64_t entryKey = book.entries[mid] >> 8;
+        if (entryKey < key)
+            lo = mid + 1;
+        else if (entryKey > key)
+            hi = mid;
+        else {
+            int col = (int)(book.entries[mid] & 0xFF);
+            if (mirrored)
+                col = COLS - 1 - col;
+            return col >= 0 && col < COLS && board.heights[col] < ROWS ? col : -1;
+        }
+    }
+    return -1;
+}
+
+#endif // BOOK_H
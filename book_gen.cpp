@@ -0,0 +1,133 @@
+/*
+ *  book_gen.cpp
+ *
+ *  -------------------------------------------------------------------
+ *  Generates the opening book the server loads with --book (format in
+ *  book.h). Example:
+ *
+ *      g++ -O2 -pthread book_gen.cpp -o run_book_gen.x
+ *      run_book_gen.x book.bin --ply 10 --ms 200 --threads 4
+ *
+ *  Walks the game tree ply by ply up to --ply, folding mirrored
+ *  positions together, and runs the normal engine search on each
+ *  position to find its best move.
+ *
+ *  By default only positions the server can actually face are booked:
+ *  every client reply is expanded, but on the server's turns only the
+ *  book move is followed. That keeps the book about 7x smaller per two
+ *  plies than the full tree. --all books every position for both sides.
+ *  -------------------------------------------------------------------
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#include "bitboard.h"
+#include "book.h"
+#include "search.h"
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <output file> [--ply <n>] [--ms <ms>] [--threads <n>] [--all]\n";
+        return 1;
+    }
+    const char *path = argv[1];
+    int maxPly = 8;
+    int budgetMs = 100;
+    int threads = 1;
+    bool all = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--ply") == 0 && i + 1 < argc)
+            maxPly = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ms") == 0 && i + 1 < argc)
+            budgetMs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--all") == 0)
+            all = true;
+        else {
+            std::cerr << "Bad or unknown option: " << argv[i] << "\n";
+            return 1;
+        }
+    }
+    if (maxPly < 0 || maxPly >= ROWS * COLS || budgetMs <= 0 || threads <= 0) {
+        std::cerr << "--ply must be 0-" << ROWS * COLS - 1 << ", --ms and --threads positive.\n";
+        return 1;
+    }
+
+    TranspositionTable tt;
+    if (!initTable(tt, TT_MEGABYTES)) {
+        std::cerr << "Out of memory for the search table.\n";
+        return 1;
+    }
+
+    std::vector<uint64_t> entries;
+    std::vector<Board> frontier(1);
+    initBoard(frontier[0]);
+
+    for (int ply = 0; ply <= maxPly && !frontier.empty(); ply++) {
+        bool serverTurn = ply & 1; // The client always moves first.
+        bool book = all || serverTurn;
+        std::vector<Board> next;
+        std::unordered_set<uint64_t> seen;
+
+        for (size_t i = 0; i < frontier.size(); i++) {
+            const Board &board = frontier[i];
+            int best = -1;
+            if (book) {
+                SearchResult result = searchMove(tt, board, budgetMs, threads);
+                best = result.column;
+                bool mirrored;
+                uint64_t key = canonicalKey(board, mirrored);
+                int stored = mirrored ? COLS - 1 - best : best;
+                entries.push_back(key << 8 | (uint64_t)stored);
+            }
+            if (ply == maxPly)
+                continue;
+
+            for (int col = 0; col < COLS; col++) {
+                if (book && !all && col != best)
+                    continue;
+                Board child = board;
+                int side = child.moves & 1;
+                if (dropPiece(child, col, side ? 'S' : 'C') == -1)
+                    continue;
+                if (hasFour(child.pieces[side]) || checkTie(child))
+                    continue; // Game over, nothing left to book.
+                bool mirrored;
+                if (seen.insert(canonicalKey(child, mirrored)).second)
+                    next.push_back(child);
+            }
+        }
+        std::cout << "ply " << ply << ": " << frontier.size() << " positions"
+                  << (book ? " searched" : "") << std::endl;
+        frontier.swap(next);
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    BookHeader header = {};
+    memcpy(header.magic, BOOK_MAGIC, sizeof(BOOK_MAGIC));
+    header.maxPly = maxPly;
+    header.count = entries.size();
+
+    FILE *out = fopen(path, "wb");
+    if (out == nullptr) {
+        std::cerr << "[ERROR] fopen(" << path << "): " << strerror(errno) << std::endl;
+        return 1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+           && fwrite(entries.data(), sizeof(uint64_t), entries.size(), out) == entries.size();
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        std::cerr << "[ERROR] writing " << path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << entries.size() << " positions to " << path << std::endl;
+    return 0;
+}
@@ -1,228 +1,443 @@
-/*
- *  client_skeleton.cpp
- *
- *  -------------------------------------------------------------------
- *  This skeleton code provides the basic structure for the Connect 4
- *  client. You will implement the networking parts to:
- *   1. Create a TCP socket.
- *   2. Resolve the server's hostname.
- *   3. Connect to the server.
- *   4. Receive board updates.
- *   5. Send your moves back to the server.
- *   6. Close the connection when the game ends.
- *  -------------------------------------------------------------------
- */
-
-#include <iostream>
-#include <cstdlib>
-#include <cstring>
-#include <sstream>
-#include <string>
-
-
-
-// TODO: Include necessary headers for network calls (e.g., unistd.h, sys/types.h, sys/socket.h, netdb.h)
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <unistd.h>
-
- /*
-  * Function: readLine (TO BE IMPLEMENTED)
-  *
-  * Pseudo code:
-  *   • Initialize an empty string.
-  *   • Repeatedly call recv() to read one byte at a time.
-  *   • Stop if a newline character is read or on error.
-  *   • Return the accumulated string.
-  */
-std::string readLine(int sockfd) {
-    // TODO: Implement using recv() in a loop.
-    std::string byteString = "";
-    
-    char buffer[1]; // Need to read from `recv()` one byte at a time, so no point in having a buffer > 1 byte in size.
-    while(true)
-    {
-                                             // 0 is passed as we have no use for flags.
-        if(recv(sockfd, buffer, sizeof(buffer), 0) == 0 ) // if no bytes received
-        {
-            std::cerr << "[ERROR] recv(): "<< errno << " - " <<  strerror(errno) << std::endl;
-            break;
-        }
-        if(buffer[0] == '\n') // if '\n` received, break from loop.
-            break;
-        //if(byteString == "\n") removed this line as it's not necessary in my implementation.
-        byteString += buffer[0]; // Add recieved data to byteString.
-    }
-    
-    return byteString;
-}
-
-/*
- * Function: writeLine (TO BE IMPLEMENTED)
- *
- * Pseudo code:
- *   • Append a newline character to your string.
- *   • Use a loop with send() to ensure all data is transmitted.
- *   • If send() fails, return false.
- *   • Return true if successful.
- */
-bool writeLine(int sockfd, const std::string& line) {
-    // TODO: Implement using send() in a loop.
-
-    std::string newLine = line; //technically I don't need to do this since I can just do another send() after the loop with '\n', but that feels kinda dumb.
-    newLine += '\n';
-    for(char c : newLine)
-    {
-        if(send(sockfd, &c, 1, 0) <= 0) // If some error occurs
-        {
-            std::cerr << "[ERROR] send(): "<< errno << " - " <<  strerror(errno) << std::endl;
-            return false; //break not necessary since error detected.
-        }    
-    }
-    return true;
-}
-
-void displayBoard(const std::string &boardData) {
-    std::istringstream iss(boardData);
-    std::string line;
-    std::cout << " 1 2 3 4 5 6 7" << std::endl;
-    while (std::getline(iss, line)) {
-        if (line.empty()) continue;
-        std::cout << line << std::endl;
-    }
-}
-
-int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <hostname> <port>\n";
-        return 1;
-    }
-    const char* hostname = argv[1];
-    const char* service = argv[2]; //swapped this to be a char* because getaddrinfo() requires a const char*
-
-    struct addrinfo hints = {}; // init so there's no junk data.
-
-    struct addrinfo* result;
-    struct addrinfo* rp; //result pointer to preserve head of linked list later on in connect().
-    
-    struct sockaddr_in server = {}; // Init so there's no garbage data.
-
-    int sockfd, connect_success;
-
-    //init hints to only allow ipv4 addr.
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    
-
-
-    int getaddrinfo_status = getaddrinfo(hostname, service, &hints, &result); // Success on `getaddrinfo()`. This will be used later on in conjunction with connect()
-    //getaddrinfo() returns a list of IPs in this case to the resolved host and port that will allow us to iterate through and pick one if >1 are returned.
-
-    if(getaddrinfo_status != 0) // 0 is success. Only handling failures to print & exit as required.
-    {
-        std::cerr << "[ERROR] getaddrinfo(): " << gai_strerror(getaddrinfo_status) << std::endl;
-        return getaddrinfo_status; // Exits the program with the error code given by getaddrinfo_status.
-    }
-//    std::cout << "[DEBUG] getaddrinfo() successful." << std::endl;
-
-    //navigating linked list to attempt to find a valid connection to maybe fix my `connect() no route` or whatever bug.
-//    std::cout << "[DEBUG] Iterating through Linked List..." << std::endl;
-    int debug_counter = 1;
-    for(rp = result; rp != NULL; rp = rp->ai_next)
-    {   
-//        std::cout << "[DEBUG] Iteration #" << debug_counter++ << ":" << std::endl;
-        sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if(sockfd == -1)
-        {
-//            std::cout << "[DEBUG] socket() failed. Going to next." << std::endl;
-            continue; //If errors, try next in linked list.
-        }
-        
-//        std::cout << "[DEBUG] socket() succeeded!" << std::endl;
-        
-        if (connect(sockfd, rp->ai_addr, rp->ai_addrlen) == 0) 
-        {
-//            std::cout << "[DEBUG] connect() succeeded!" << std::endl;
-            break;
-        }
-//        std::cout << "[DEBUG] connect() failed: " << strerror(errno) << ". Trying next." << std::endl;
-            close(sockfd); //closes sockfd if it fails to connect.
-    }
-
-    if(rp == nullptr)
-    {
-        std::cerr << "[ERROR] Failed to connect to " << hostname << ":" << service << "; " << strerror(errno) << " (errno " << errno << ")." << std::endl; //holy moly this is ugly af. gimme c# syntax aaa
-        return errno;
-    }
-
-    std::cout << "Connected to " << hostname << ":" << service << std::endl;
-    bool gameOver = false;
-    while (!gameOver) {
-        // ============================================
-        // The server should first send the header "BOARD".
-        // ============================================
-        std::string header = readLine(sockfd);
-        if (header != "BOARD") {
-            std::cerr << "Protocol error: expected BOARD, got '" << header << "'\n";
-            break;
-        }
-
-        // ============================================
-        // Read the board data: Expect 6 lines from the server.
-        // ============================================
-        std::string boardData;
-        for (int i = 0; i < 6; i++) {
-            std::string line = readLine(sockfd);
-            boardData += line + "\n";
-        }
-
-        // ============================================
-        // Read the turn message from the server (e.g., "TURN CLIENT" or "GAMEOVER ...").
-        // ============================================
-        std::string turnMsg = readLine(sockfd);
-
-        displayBoard(boardData);
-
-        if (turnMsg.rfind("TURN", 0) == 0) {
-            if (turnMsg == "TURN CLIENT") {
-                std::cout << "Enter your move (1-7): ";
-                int col;
-                std::cin >> col;
-                if (std::cin.fail()) {
-                    std::cin.clear();
-                    std::cin.ignore(1000, '\n');
-                    std::cout << "Invalid input, try again.\n";
-                    continue;
-                }
-                std::ostringstream oss;
-                oss << "MOVE " << col;
-                if (!writeLine(sockfd, oss.str())) {
-                    std::cerr << "Failed to send move.\n";
-                    break;
-                }
-            } else {
-                std::cout << "Waiting for server's move...\n";
-            }
-        }
-        else if (turnMsg.rfind("GAMEOVER", 0) == 0) {
-            std::cout << turnMsg << std::endl;
-            gameOver = true;
-        }
-        else {
-            std::cerr << "Protocol error: unknown command '" << turnMsg << "'\n";
-            break;
-        }
-    } // end while
-
-    // ============================================
-    // TODO: Close the socket:
-    // Pseudo code:
-    //   • Call close() on the client socket when the game is finished.
-    // ============================================
-
-
-    close(sockfd); // no check is necessary here because if the code reaches this section, the game is over and is notifying the server to terminate the session.
-    return 0;
-}
+/*
+ *  client_skeleton.cpp
+ *
+ *  -------------------------------------------------------------------
+ *  This skeleton code provides the basic structure for the Connect 4
+ *  client. You will implement the networking parts to:
+ *   1. Create a TCP socket.
+ *   2. Resolve the server's hostname.
+ *   3. Connect to the server.
+ *   4. Receive board updates.
+ *   5. Send your moves back to the server.
+ *   6. Close the connection when the game ends.
+ *  -------------------------------------------------------------------
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+
+
+// TODO: Include necessary headers for network calls (e.g., unistd.h, sys/types.h, sys/socket.h, netdb.h)
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "connection.h" // Connection, readLine(), writeLine()
+#include "loadgen.h"    // runLoad(), for --load
+#include "protocol.h"   // Binary frames, for --binary
+
+void displayBoard(const std::string &boardData) {
+    std::istringstream iss(boardData);
+    std::string line;
+    std::cout << BOARD_HEADER << std::endl;
+    while (std::getline(iss, line)) {
+        if (line.empty()) continue;
+        std::cout << line << std::endl;
+    }
+}
+
+const int HINT_REQUEST = -2; // promptMove()'s answer to "?".
+const int HINT_MS = 500;      // Search budget we ask the server for per hint.
+
+// Asks until we get a number, or "?" for a hint; the server rejects
+// out-of-range columns itself. Returns -1 at end of input.
+int promptMove() {
+    while (true) {
+        std::cout << "Enter your move (1-7, ? for a hint): ";
+        std::string input;
+        std::cin >> input;
+        if (std::cin.eof())
+            return -1;
+        if (input == "?")
+            return HINT_REQUEST;
+        char *end;
+        long col = strtol(input.c_str(), &end, 10);
+        if (*end == '\0')
+            return (int)col;
+        std::cout << "Invalid input, try again.\n";
+    }
+}
+
+bool sendMove(Connection &conn, int col) {
+    std::ostringstream oss;
+    oss << "MOVE " << col;
+    if (!writeLine(conn, oss.str())) {
+        std::cerr << "Failed to send move.\n";
+        return false;
+    }
+    return true;
+}
+
+bool requestHint(Connection &conn) {
+    if (!writeLine(conn, "ANALYZE " + std::to_string(HINT_MS))) {
+        std::cerr << "Failed to ask for a hint.\n";
+        return false;
+    }
+    return true;
+}
+
+// Prompts for our move and sends it, or asks for a hint on "?". Sets
+// `col` to what was entered. Returns false if input or the socket ended.
+bool takeTurn(Connection &conn, int &col) {
+    col = promptMove();
+    if (col == HINT_REQUEST)
+        return requestHint(conn);
+    return col >= 0 && sendMove(conn, col);
+}
+
+// Prints the server's per-column scores (see protocol.h for the notation).
+void displayHint(int depth, const std::string &scores) {
+    if (depth == 0) {
+        std::cout << "The server is too busy for hints right now.\n";
+        return;
+    }
+    std::cout << "Hint (searched " << depth << " plies; W<n>/L<n> = win/lose in n, higher is better):\n"
+              << BOARD_HEADER << "\n " << scores << std::endl;
+}
+
+/*
+ * Function: playBinary
+ *
+ * Rest of the game after the server accepted "PROTOCOL BINARY" (see
+ * protocol.h). We keep our own Board and apply each move frame to it
+ * instead of re-reading the whole board every turn. Our own move is
+ * only applied once the server's answer shows it was accepted.
+ */
+void playBinary(Connection &conn) {
+    Board board;
+    initBoard(board);
+    uint32_t expectedSeq = 0;
+    int pending = -1; // Our last move, 0-based, until the server confirms it.
+
+    while (true) {
+        uint8_t frame[SNAPSHOT_FRAME_SIZE]; // The largest frame type (with ANALYSIS_FRAME_SIZE).
+        std::string_view type = readBytes(conn, 1);
+        if (type.empty())
+            return;
+        frame[0] = (uint8_t)type[0];
+        size_t size = frame[0] == FRAME_SNAPSHOT ? SNAPSHOT_FRAME_SIZE
+                    : frame[0] == FRAME_ANALYSIS ? ANALYSIS_FRAME_SIZE : MOVE_FRAME_SIZE;
+        if (frame[0] == FRAME_SNAPSHOT || frame[0] == FRAME_MOVE || frame[0] == FRAME_ANALYSIS) {
+            std::string_view rest = readBytes(conn, size - 1);
+            if (rest.empty())
+                return;
+            memcpy(frame + 1, rest.data(), size - 1);
+        }
+
+        int status;
+        uint32_t seq;
+        if (frame[0] == FRAME_ANALYSIS) {
+            std::string scores;
+            for (int c = 0; c < COLS; c++) {
+                char text[8];
+                formatColumnScore(analysisScore(frame, c), text, sizeof(text));
+                scores += text;
+                scores += ' ';
+            }
+            displayHint(frame[1], scores);
+            expectedSeq = (uint32_t)getLE(frame + 4, 4) + 1;
+            int col;
+            if (!takeTurn(conn, col))
+                return;
+            pending = col == HINT_REQUEST ? -1 : col - 1;
+            continue;
+        }
+        if (frame[0] == FRAME_SNAPSHOT) {
+            decodeSnapshot(frame, board);
+            status = frame[3];
+            seq = (uint32_t)getLE(frame + 4, 4);
+            pending = -1;
+        } else if (frame[0] == FRAME_MOVE) {
+            status = frame[3];
+            seq = (uint32_t)getLE(frame + 4, 4);
+            if (seq != expectedSeq) {
+                std::cerr << "Missed a frame, asking the server to resync.\n";
+                if (!writeLine(conn, "RESYNC"))
+                    return;
+                continue;
+            }
+            if (status == STATUS_INVALID_MOVE) {
+                std::cout << "INVALID_MOVE" << std::endl;
+                pending = -1;
+            } else {
+                if (frame[2] == 1 && pending >= 0)
+                    dropPiece(board, pending, 'C'); // Server moved, so ours stood.
+                pending = -1;
+                if (frame[1] != NO_COLUMN)
+                    dropPiece(board, frame[1], frame[2] == 1 ? 'S' : 'C');
+            }
+        } else {
+            std::cerr << "Protocol error: unknown binary frame type " << (int)frame[0] << "\n";
+            return;
+        }
+        expectedSeq = seq + 1;
+
+        displayBoard(boardToString(board));
+        if (isGameOver(status)) {
+            std::cout << STATUS_TEXT[status] << std::endl;
+            return;
+        }
+        if (status == STATUS_TURN_OPPONENT) {
+            std::cout << "Waiting for your opponent's move...\n";
+            continue;
+        }
+        int col;
+        if (!takeTurn(conn, col))
+            return;
+        pending = col == HINT_REQUEST ? -1 : col - 1;
+    }
+}
+
+/*
+ * Function: watchGame
+ *
+ * Spectator mode (--watch <game-id>): asks to watch the game and shows
+ * every board the server sends until the game ends. Anything before
+ * the server's "WATCHING" line is the game we were offered on
+ * connecting, and is skipped. Returns the exit status.
+ */
+int watchGame(Connection &conn, const char *gameId) {
+    if (!writeLine(conn, std::string("WATCH ") + gameId))
+        return 1;
+    while (true) {
+        std::string_view line = readLine(conn);
+        if (line.empty())
+            return 1;
+        if (line == "NO_SUCH_GAME") {
+            std::cerr << "No game " << gameId << " on this server.\n";
+            return 1;
+        }
+        if (line.rfind("WATCHING", 0) == 0)
+            break;
+    }
+    std::cout << "Watching game " << gameId << "." << std::endl;
+    while (true) {
+        std::string_view header = readLine(conn);
+        if (header != "BOARD") {
+            if (!header.empty())
+                std::cerr << "Protocol error: expected BOARD, got '" << header << "'\n";
+            return 1;
+        }
+        std::string boardData;
+        for (int i = 0; i < 6; i++) {
+            boardData += readLine(conn);
+            boardData += '\n';
+        }
+        std::string_view turnMsg = readLine(conn);
+        displayBoard(boardData);
+        std::cout << turnMsg << std::endl;
+        if (turnMsg.rfind("GAMEOVER", 0) == 0 || turnMsg.empty())
+            return 0;
+    }
+}
+
+/*
+ * Function: parseLoadArgs
+ *
+ * Parses "--load <n> [--seconds <s>] [--games <n>] [--script <cols>]
+ * [--mux <games>]"
+ * starting at argv[3]. Returns false on anything it doesn't recognise.
+ */
+bool parseLoadArgs(int argc, char *argv[], LoadOptions &opts) {
+    opts.connections = 0;
+    opts.seconds = -1;
+    opts.games = 0;
+    opts.mux = 0;
+    for (int i = 3; i < argc; i++) {
+        if (i + 1 >= argc)
+            return false;
+        if (strcmp(argv[i], "--load") == 0)
+            opts.connections = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0)
+            opts.seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--games") == 0)
+            opts.games = atol(argv[++i]);
+        else if (strcmp(argv[i], "--script") == 0)
+            opts.script = argv[++i];
+        else if (strcmp(argv[i], "--mux") == 0)
+            opts.mux = atoi(argv[++i]);
+        else
+            return false;
+    }
+    if (opts.seconds < 0)
+        opts.seconds = opts.games > 0 ? 0 : 10;
+    return opts.connections > 0 && opts.mux >= 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <hostname> <port> [--binary | --watch <game-id> | --load <connections> [--seconds <s>] [--games <n>] [--script <cols>] [--mux <games>]]\n";
+        return 1;
+    }
+    const char* hostname = argv[1];
+    const char* service = argv[2]; //swapped this to be a char* because getaddrinfo() requires a const char*
+    bool wantBinary = argc == 4 && strcmp(argv[3], "--binary") == 0;
+    const char *watchId = argc == 5 && strcmp(argv[3], "--watch") == 0 ? argv[4] : nullptr;
+
+    if (argc > 3 && !wantBinary && !watchId) {
+        LoadOptions load;
+        if (!parseLoadArgs(argc, argv, load)) {
+            std::cerr << "Usage: " << argv[0] << " <hostname> <port> [--binary | --watch <game-id> | --load <connections> [--seconds <s>] [--games <n>] [--script <cols>] [--mux <games>]]\n";
+            return 1;
+        }
+        return runLoad(hostname, service, load);
+    }
+
+    struct addrinfo hints = {}; // init so there's no junk data.
+
+    struct addrinfo* result;
+    struct addrinfo* rp; //result pointer to preserve head of linked list later on in connect().
+    
+    struct sockaddr_in server = {}; // Init so there's no garbage data.
+
+    int sockfd, connect_success;
+
+    //init hints to only allow ipv4 addr.
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    
+
+
+    int getaddrinfo_status = getaddrinfo(hostname, service, &hints, &result); // Success on `getaddrinfo()`. This will be used later on in conjunction with connect()
+    //getaddrinfo() returns a list of IPs in this case to the resolved host and port that will allow us to iterate through and pick one if >1 are returned.
+
+    if(getaddrinfo_status != 0) // 0 is success. Only handling failures to print & exit as required.
+    {
+        std::cerr << "[ERROR] getaddrinfo(): " << gai_strerror(getaddrinfo_status) << std::endl;
+        return getaddrinfo_status; // Exits the program with the error code given by getaddrinfo_status.
+    }
+//    std::cout << "[DEBUG] getaddrinfo() successful." << std::endl;
+
+    //navigating linked list to attempt to find a valid connection to maybe fix my `connect() no route` or whatever bug.
+//    std::cout << "[DEBUG] Iterating through Linked List..." << std::endl;
+    int debug_counter = 1;
+    for(rp = result; rp != NULL; rp = rp->ai_next)
+    {   
+//        std::cout << "[DEBUG] Iteration #" << debug_counter++ << ":" << std::endl;
+        sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        if(sockfd == -1)
+        {
+//            std::cout << "[DEBUG] socket() failed. Going to next." << std::endl;
+            continue; //If errors, try next in linked list.
+        }
+        
+//        std::cout << "[DEBUG] socket() succeeded!" << std::endl;
+        
+        if (connect(sockfd, rp->ai_addr, rp->ai_addrlen) == 0) 
+        {
+//            std::cout << "[DEBUG] connect() succeeded!" << std::endl;
+            break;
+        }
+//        std::cout << "[DEBUG] connect() failed: " << strerror(errno) << ". Trying next." << std::endl;
+            close(sockfd); //closes sockfd if it fails to connect.
+    }
+
+    if(rp == nullptr)
+    {
+        std::cerr << "[ERROR] Failed to connect to " << hostname << ":" << service << "; " << strerror(errno) << " (errno " << errno << ")." << std::endl; //holy moly this is ugly af. gimme c# syntax aaa
+        return errno;
+    }
+
+    std::cout << "Connected to " << hostname << ":" << service << std::endl;
+    Connection conn;
+    initConnection(conn, sockfd);
+    if (watchId) {
+        int status = watchGame(conn, watchId);
+        close(sockfd);
+        return status;
+    }
+
+    // Ask for binary frames up front. The first (text) board is already
+    // on its way, so we skip its prompt and wait for the server's answer.
+    bool awaitingHandshake = wantBinary && writeLine(conn, "PROTOCOL BINARY");
+
+    bool gameOver = false;
+    while (!gameOver) {
+        // ============================================
+        // The server should first send the header "BOARD".
+        // ============================================
+        std::string_view header = readLine(conn);
+        if (header == "PROTOCOL BINARY OK") {
+            playBinary(conn);
+            break;
+        }
+        if (header == "INVALID_MOVE") {
+            if (awaitingHandshake)
+                std::cout << "Server doesn't speak the binary protocol, staying on text.\n";
+            else
+                std::cout << "INVALID_MOVE" << std::endl;
+            awaitingHandshake = false;
+            continue;
+        }
+        if (header.rfind("ANALYSIS ", 0) == 0) {
+            std::string_view rest = header.substr(9);
+            size_t space = rest.find(' ');
+            if (rest == "BUSY" || space == std::string_view::npos)
+                displayHint(0, "");
+            else
+                displayHint(atoi(std::string(rest.substr(0, space)).c_str()), std::string(rest.substr(space + 1)));
+            int col;
+            if (!takeTurn(conn, col))
+                break;
+            continue;
+        }
+        if (header != "BOARD") {
+            std::cerr << "Protocol error: expected BOARD, got '" << header << "'\n";
+            break;
+        }
+
+        // ============================================
+        // Read the board data: Expect 6 lines from the server.
+        // ============================================
+        std::string boardData;
+        for (int i = 0; i < 6; i++) {
+            boardData += readLine(conn);
+            boardData += '\n';
+        }
+
+        // ============================================
+        // Read the turn message from the server (e.g., "TURN CLIENT" or "GAMEOVER ...").
+        // ============================================
+        std::string_view turnMsg = readLine(conn);
+
+        displayBoard(boardData);
+
+        if (turnMsg.rfind("TURN", 0) == 0) {
+            if (turnMsg == "TURN CLIENT" && awaitingHandshake) {
+                continue;
+            } else if (turnMsg == "TURN CLIENT") {
+                int col;
+                if (!takeTurn(conn, col))
+                    break;
+            } else if (turnMsg == "TURN OPPONENT") {
+                std::cout << "Waiting for your opponent's move...\n";
+            } else {
+                std::cout << "Waiting for server's move...\n";
+            }
+        }
+        else if (turnMsg.rfind("GAMEOVER", 0) == 0) {
+            std::cout << turnMsg << std::endl;
+            gameOver = true;
+        }
+        else {
+            std::cerr << "Protocol error: unknown command '" << turnMsg << "'\n";
+            break;
+        }
+    } // end while
+
+    // ============================================
+    // TODO: Close the socket:
+    // Pseudo code:
+    //   • Call close() on the client socket when the game is finished.
+    // ============================================
+
+
+    close(sockfd); // no check is necessary here because if the code reaches this section, the game is over and is notifying the server to terminate the session.
+    return 0;
+}
@@ -0,0 +1,452 @@
+/*
+ *  connection.h
+ *
+ *  -------------------------------------------------------------------
+ *  Buffered connection shared by the client and the server. Replaces
+ *  the old readLine()/writeLine() pair that made one recv()/send() per
+ *  byte (~100 syscalls for a single BOARD frame).
+ *
+ *   • Input: one recv() fills a fixed receive buffer; nextLine() hands
+ *     out complete lines as views into that buffer, no copying.
+ *   • Output: queued chunks (string literals and other long-lived
+ *     buffers are referenced, not copied) are gathered into a single
+ *     writev(), so a whole frame - header, six board rows and the turn
+ *     line - goes out in one call. The chunk queue is a ring that only
+ *     grows, and copied chunks reuse their slot's string, so a
+ *     connection in steady state queues and sends without touching
+ *     the heap. outputBacklogged() says when a peer has stopped
+ *     reading: the server takes no more lines from it until the queue
+ *     drains, so a client can't grow it by sending and never reading.
+ *   • Shared frames: one immutable, reference-counted buffer can sit in
+ *     many connections' queues at once (queueShared()), which is how a
+ *     game's board goes out to all its spectators from a single render.
+ *     Each queue holds a reference until its copy is sent or dropped.
+ *
+ *  Both sides cope with partial reads and writes, so the same type
+ *  works on the server's non-blocking sockets and on the client's
+ *  blocking one.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+const size_t CONN_BUFFER = 4096; // Receive buffer; also the longest line we'll accept.
+const int MAX_IOV = 64;          // Chunks gathered per writev().
+const size_t OUT_RING = 16;      // Initial chunk ring size; doubles when full.
+const size_t OUT_LIMIT_CHUNKS = 256;      // Queued chunks past which outputBacklogged()...
+const size_t OUT_LIMIT_BYTES = 64 * 1024; // ...or queued bytes.
+
+// Immutable once built; shared between connections by reference count.
+typedef std::shared_ptr<const std::string> SharedFrame;
+
+struct OutChunk {
+    const char *borrowed; // Sent in place, must outlive the send. nullptr means use `shared` or `owned`.
+    size_t length;
+    std::string owned;
+    SharedFrame shared;   // Only while queued; released as soon as it's sent.
+
+    const char *data() const { return borrowed ? borrowed : shared ? shared->data() : owned.data(); }
+};
+
+struct Connection {
+    int fd;
+    char in[CONN_BUFFER];
+    size_t inHead;           // First unconsumed byte in `in`.
+    size_t inTail;           // One past the last received byte.
+    std::vector<OutChunk> out; // Ring of queued chunks...
+    size_t outHead;            // ...starting here...
+    size_t outCount;           // ...this many long.
+    size_t outOffset;          // Bytes of the head chunk already sent.
+    size_t outBytes;           // Total length of the queued chunks, sent part of the head included.
+    uint64_t bytesSent;        // Running total, for metrics.
+    uint64_t syscalls;         // recv() and writev() calls so far, for metrics.
+};
+
+inline void initConnection(Connection &c, int fd) {
+    c.fd = fd;
+    c.inHead = c.inTail = 0;
+    if (c.out.size() < OUT_RING)
+        c.out.resize(OUT_RING);
+    c.outHead = c.outCount = 0;
+    c.outOffset = 0;
+    c.outBytes = 0;
+    c.bytesSent = 0;
+    c.syscalls = 0;
+}
+
+// Makes room at the end of the buffer: resets it if everything has
+// been consumed, else slides unconsumed bytes to the front once the
+// end is reached.
+inline void compactInput(Connection &c) {
+    if (c.inHead == c.inTail) {
+        c.inHead = c.inTail = 0;
+    } else if (c.inTail == CONN_BUFFER && c.inHead > 0) {
+        memmove(c.in, c.in + c.inHead, c.inTail - c.inHead);
+        c.inTail -= c.inHead;
+        c.inHead = 0;
+    }
+}
+
+/*
+ * Function: fillInput
+ *
+ * One recv() into the free space at the end of the buffer, sliding
+ * unconsumed bytes to the front first if there's no room left.
+ * Returns what recv() returned (0 on EOF, -1 with errno set on error).
+ * The caller must check inputFull() first; a full buffer can't be filled.
+ */
+inline ssize_t fillInput(Connection &c) {
+    compactInput(c);
+    c.syscalls++;
+    ssize_t n = recv(c.fd, c.in + c.inTail, CONN_BUFFER - c.inTail, 0);
+    if (n > 0)
+        c.inTail += n;
+    return n;
+}
+
+// fillInput() from bytes already received some other way (the server's
+// io_uring backend): copies as many of them as fit and returns how many.
+inline size_t fillInputFrom(Connection &c, const char *data, size_t length) {
+    compactInput(c);
+    size_t n = std::min(length, CONN_BUFFER - c.inTail);
+    memcpy(c.in + c.inTail, data, n);
+    c.inTail += n;
+    return n;
+}
+
+/*
+ * Function: feedLine
+ *
+ * Adds `line` and its '\n' to the input as if they had been received
+ * (the server's multiplexed games get their lines this way). Slides
+ * unconsumed bytes to the front if that makes room. Returns false,
+ * changing nothing, if the whole line doesn't fit.
+ */
+inline bool feedLine(Connection &c, std::string_view line) {
+    size_t need = line.size() + 1;
+    if (c.inTail + need > CONN_BUFFER && c.inHead > 0) {
+        memmove(c.in, c.in + c.inHead, c.inTail - c.inHead);
+        c.inTail -= c.inHead;
+        c.inHead = 0;
+    }
+    if (c.inTail + need > CONN_BUFFER)
+        return false;
+    memcpy(c.in + c.inTail, line.data(), line.size());
+    c.in[c.inTail + line.size()] = '\n';
+    c.inTail += need;
+    return true;
+}
+
+inline bool inputFull(const Connection &c) {
+    return c.inHead == 0 && c.inTail == CONN_BUFFER;
+}
+
+inline bool hasLine(const Connection &c) {
+    return memchr(c.in + c.inHead, '\n', c.inTail - c.inHead) != nullptr;
+}
+
+/*
+ * Function: nextLine
+ *
+ * If a complete line is buffered, points `line` at it (without the
+ * '\n') and consumes it. The view is only good until the next
+ * fillInput() call.
+ */
+inline bool nextLine(Connection &c, std::string_view &line) {
+    const char *start = c.in + c.inHead;
+    const char *nl = (const char*)memchr(start, '\n', c.inTail - c.inHead);
+    if (nl == nullptr)
+        return false;
+    line = std::string_view(start, nl - start);
+    c.inHead += (nl - start) + 1;
+    return true;
+}
+
+// Like nextLine(), but leaves the line in the buffer.
+inline bool peekLine(const Connection &c, std::string_view &line) {
+    const char *start = c.in + c.inHead;
+    const char *nl = (const char*)memchr(start, '\n', c.inTail - c.inHead);
+    if (nl == nullptr)
+        return false;
+    line = std::string_view(start, nl - start);
+    return true;
+}
+
+/*
+ * Function: nextBytes
+ *
+ * Fixed-size counterpart of nextLine() for binary frames: if `n` bytes
+ * are buffered, points `data` at them and consumes them.
+ */
+inline bool nextBytes(Connection &c, size_t n, std::string_view &data) {
+    if (c.inTail - c.inHead < n)
+        return false;
+    data = std::string_view(c.in + c.inHead, n);
+    c.inHead += n;
+    return true;
+}
+
+inline OutChunk &outChunk(Connection &c, size_t i) {
+    return c.out[(c.outHead + i) % c.out.size()];
+}
+
+// Claims the next free ring slot, doubling the ring if it's full.
+inline OutChunk &pushChunk(Connection &c) {
+    if (c.outCount == c.out.size()) {
+        std::vector<OutChunk> bigger(c.out.size() * 2);
+        for (size_t i = 0; i < c.outCount; i++)
+            bigger[i] = std::move(outChunk(c, i));
+        c.out.swap(bigger);
+        c.outHead = 0;
+    }
+    return outChunk(c, c.outCount++);
+}
+
+// Queues `length` bytes at `data` without copying them. They must stay
+// unchanged until sent; see detachBorrowed() for buffers that don't.
+inline void queueBorrowed(Connection &c, const char *data, size_t length) {
+    OutChunk &chunk = pushChunk(c);
+    chunk.borrowed = data;
+    chunk.length = length;
+    c.outBytes += length;
+}
+
+// Queues static text (string literals).
+inline void queueLiteral(Connection &c, const char *text, size_t length) {
+    queueBorrowed(c, text, length);
+}
+
+inline void queueLiteral(Connection &c, const char *text) {
+    queueBorrowed(c, text, strlen(text));
+}
+
+// Queues a copy of `length` bytes. Short copies (and any copy into a
+// slot whose string has been this big before) don't allocate.
+inline void queueCopy(Connection &c, const char *data, size_t length) {
+    OutChunk &chunk = pushChunk(c);
+    chunk.borrowed = nullptr;
+    chunk.length = length;
+    chunk.owned.assign(data, length);
+    c.outBytes += length;
+}
+
+inline void queueString(Connection &c, const std::string &text) {
+    queueCopy(c, text.data(), text.size());
+}
+
+// Queues a shared frame by reference: no copy, one reference count bump.
+inline void queueShared(Connection &c, const SharedFrame &frame) {
+    OutChunk &chunk = pushChunk(c);
+    chunk.borrowed = nullptr;
+    chunk.length = frame->size();
+    chunk.shared = frame;
+    c.outBytes += chunk.length;
+}
+
+inline bool hasPendingOutput(const Connection &c) {
+    return c.outCount != 0;
+}
+
+// The peer is this far behind: the server stops taking its lines until it catches up.
+inline bool outputBacklogged(const Connection &c) {
+    return c.outCount >= OUT_LIMIT_CHUNKS || c.outBytes >= OUT_LIMIT_BYTES;
+}
+
+/*
+ * Function: detachBorrowed
+ *
+ * Turns every queued chunk borrowing from [data, data + length) into
+ * a copy, so the caller can change that buffer while the old contents
+ * are still waiting to be sent. Only slow clients ever need this.
+ */
+inline void detachBorrowed(Connection &c, const char *data, size_t length) {
+    for (size_t i = 0; i < c.outCount; i++) {
+        OutChunk &chunk = outChunk(c, i);
+        if (chunk.borrowed && chunk.borrowed >= data && chunk.borrowed < data + length) {
+            chunk.owned.assign(chunk.borrowed, chunk.length);
+            chunk.borrowed = nullptr;
+        }
+    }
+}
+
+// Frees the head chunk's slot once it has been sent in full.
+inline void popChunk(Connection &c) {
+    OutChunk &chunk = outChunk(c, 0);
+    if (chunk.shared)
+        chunk.shared.reset();
+    c.outBytes -= chunk.length;
+    c.outHead = (c.outHead + 1) % c.out.size();
+    c.outCount--;
+    c.outOffset = 0;
+}
+
+/*
+ * Function: dropQueued
+ *
+ * Throws away every queued chunk that hasn't started going out (the
+ * head chunk stays if part of it has been sent, so the stream never
+ * breaks mid-frame). Returns how many were dropped.
+ */
+inline size_t dropQueued(Connection &c) {
+    size_t keep = c.outOffset > 0 ? 1 : 0;
+    size_t dropped = c.outCount - keep;
+    for (size_t i = keep; i < c.outCount; i++) {
+        OutChunk &chunk = outChunk(c, i);
+        chunk.shared.reset();
+        c.outBytes -= chunk.length;
+    }
+    c.outCount = keep;
+    return dropped;
+}
+
+// Empties the queue, even a half-sent head chunk: its socket has gone.
+inline void clearOutput(Connection &c) {
+    dropQueued(c);
+    if (c.outCount > 0)
+        popChunk(c);
+}
+
+// Moves what `from` hasn't sent yet onto the end of `to`'s queue, as
+// copies, so it can follow `from`'s socket to another connection.
+inline void moveOutput(Connection &from, Connection &to) {
+    for (size_t i = 0; i < from.outCount; i++) {
+        OutChunk &chunk = outChunk(from, i);
+        size_t skip = i == 0 ? from.outOffset : 0;
+        queueCopy(to, chunk.data() + skip, chunk.length - skip);
+    }
+    clearOutput(from);
+}
+
+/*
+ * Function: flushOutput
+ *
+ * Gathers queued chunks into writev() calls until everything is sent
+ * or the socket stops taking data. Short writes are picked up where
+ * they left off next time. Returns false on a real error (errno set);
+ * EAGAIN just leaves the rest queued.
+ */
+inline bool flushOutput(Connection &c) {
+    while (c.outCount != 0) {
+        struct iovec iov[MAX_IOV];
+        int count = 0;
+        for (; (size_t)count < c.outCount && count < MAX_IOV; count++) {
+            const OutChunk &chunk = outChunk(c, count);
+            size_t skip = count == 0 ? c.outOffset : 0;
+            iov[count].iov_base = (void*)(chunk.data() + skip);
+            iov[count].iov_len = chunk.length - skip;
+        }
+        c.syscalls++;
+        ssize_t n = writev(c.fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        size_t sent = n;
+        c.bytesSent += sent;
+        while (sent > 0) {
+            size_t left = outChunk(c, 0).length - c.outOffset;
+            if (sent < left) {
+                c.outOffset += sent;
+                break;
+            }
+            sent -= left;
+            popChunk(c);
+        }
+    }
+    return true;
+}
+
+/*
+ * Function: takeOutput
+ *
+ * Appends every queued byte to `out` and empties the queue, for a
+ * sender that needs one buffer that stays put until the kernel is done
+ * with it (the server's io_uring backend). `out` keeps its capacity,
+ * so a steady stream of frames doesn't allocate.
+ */
+inline void takeOutput(Connection &c, std::vector<char> &out) {
+    while (c.outCount != 0) {
+        const OutChunk &chunk = outChunk(c, 0);
+        const char *data = chunk.data();
+        out.insert(out.end(), data + c.outOffset, data + chunk.length);
+        popChunk(c);
+    }
+}
+
+/*
+ * Function: readLine
+ *
+ * Blocking helper for the client: returns the next line, calling
+ * recv() only when the buffer has no complete line left. Returns an
+ * empty view on disconnect or error.
+ */
+inline std::string_view readLine(Connection &c) {
+    std::string_view line;
+    while (!nextLine(c, line)) {
+        if (inputFull(c)) {
+            std::cerr << "[ERROR] Line longer than " << CONN_BUFFER << " bytes." << std::endl;
+            return std::string_view();
+        }
+        ssize_t n = fillInput(c);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            std::cerr << "[ERROR] recv(): "<< errno << " - " <<  strerror(errno) << std::endl;
+            return std::string_view();
+        }
+    }
+    return line;
+}
+
+/*
+ * Function: readBytes
+ *
+ * Blocking helper for the client's binary mode: returns the next `n`
+ * bytes, or an empty view on disconnect or error.
+ */
+inline std::string_view readBytes(Connection &c, size_t n) {
+    std::string_view data;
+    while (!nextBytes(c, n, data)) {
+        ssize_t got = fillInput(c);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0) {
+            std::cerr << "[ERROR] recv(): "<< errno << " - " <<  strerror(errno) << std::endl;
+            return std::string_view();
+        }
+    }
+    return data;
+}
+
+/*
+ * Function: writeLine
+ *
+ * Blocking helper for the client: queues the line and its '\n' and
+ * sends them with a single writev().
+ */
+inline bool writeLine(Connection &c, const std::string &line) {
+    queueString(c, line);
+    queueLiteral(c, "\n", 1);
+    if (!flushOutput(c) || hasPendingOutput(c)) {
+        std::cerr << "[ERROR] send(): "<< errno << " - " <<  strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif // CONNECTION_H
@@ -0,0 +1,456 @@
+/*
+ *  loadgen.h
+ *
+ *  -------------------------------------------------------------------
+ *  Headless load generator for the client:
+ *
+ *      run_client.x <host> <port> --load <connections> [--seconds <s>]
+ *                   [--games <n>] [--script <columns>] [--mux <games>]
+ *
+ *  Opens <connections> games at once and plays them all from one epoll
+ *  loop, reading the same BOARD / TURN / GAMEOVER frames the
+ *  interactive client does. On "TURN CLIENT" it plays the next column
+ *  of --script (e.g. 4453), or a random legal column once the script is
+ *  used up or its column is full. Finished games are replaced with new
+ *  connections until --seconds pass (default 10) or --games games have
+ *  finished, whichever comes first.
+ *
+ *  --mux <games> instead plays that many games at once over each
+ *  connection (the multiplexed protocol, see protocol.h), each game's
+ *  moves pipelined with the others'. A finished game's channel is
+ *  reopened for the next one; connections stay up until the end. The
+ *  server opens at most 1024 games per connection.
+ *
+ *  The server has to pick its own moves (run it with --ai) or pair the
+ *  connections against each other (--pvp, not with --mux), otherwise
+ *  every game stalls on the console.
+ *
+ *  Reports games/sec, moves/sec, p50/p99/p99.9 move round trip (MOVE
+ *  sent -> next complete frame received) and error counts.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection.h"
+#include "protocol.h"
+
+struct LoadOptions {
+    int connections;
+    int seconds;       // Stop after this long, if > 0...
+    long games;        // ...or after this many finished games, if > 0.
+    std::string script;
+    int mux;           // Games per connection over the multiplexed protocol; 0 = one, plain.
+};
+
+enum LoadState {
+    LOAD_HEADER,  // Expecting "BOARD" (or "INVALID_MOVE" first).
+    LOAD_ROWS,    // Reading the six board rows.
+    LOAD_TURN     // Expecting the TURN/GAMEOVER line.
+};
+
+struct LoadGame {
+    LoadState state;
+    int rowsRead;
+    bool open[7];        // Column still has room, from the top board row.
+    size_t scriptPos;
+    bool moveInFlight;
+    bool finished;       // Saw its GAMEOVER.
+    std::chrono::steady_clock::time_point sentAt;
+    std::string partial; // --mux: the start of a line the next frame finishes.
+};
+
+struct LoadConn {
+    Connection conn;
+    bool connecting;
+    LoadGame game;                  // Without --mux.
+    bool muxReady;                  // --mux: the server said PROTOCOL MUX OK...
+    std::vector<LoadGame> channels; // ...and channel c + 1 plays channels[c].
+};
+
+struct LoadStats {
+    uint64_t games;
+    uint64_t moves;
+    uint64_t invalidMoves;
+    uint64_t protocolErrors;
+    uint64_t disconnects;
+    uint64_t connectFailures;
+    std::vector<uint64_t> latencyNs;
+};
+
+struct LoadGen {
+    const LoadOptions *opts;
+    struct addrinfo *addr;
+    int epfd;
+    std::vector<LoadConn*> conns; // Indexed by fd.
+    int active;
+    uint64_t rng;
+    bool stopping;
+    LoadStats stats;
+};
+
+inline uint64_t nextRandom(LoadGen &g) {
+    g.rng ^= g.rng << 13;
+    g.rng ^= g.rng >> 7;
+    g.rng ^= g.rng << 17;
+    return g.rng;
+}
+
+inline bool startLoadConn(LoadGen &g) {
+    int fd = socket(g.addr->ai_family, g.addr->ai_socktype | SOCK_NONBLOCK, g.addr->ai_protocol);
+    if (fd == -1) {
+        g.stats.connectFailures++;
+        return false;
+    }
+    if (connect(fd, g.addr->ai_addr, g.addr->ai_addrlen) != 0 && errno != EINPROGRESS) {
+        g.stats.connectFailures++;
+        close(fd);
+        return false;
+    }
+    LoadConn *c = new LoadConn();
+    initConnection(c->conn, fd);
+    c->connecting = true;
+    c->game = LoadGame();
+    c->muxReady = false;
+    if (g.opts->mux > 0) {
+        c->channels.resize(g.opts->mux);
+        queueLiteral(c->conn, "PROTOCOL MUX\n"); // Goes once connected.
+    }
+    if ((size_t)fd >= g.conns.size())
+        g.conns.resize(fd + 1, nullptr);
+    g.conns[fd] = c;
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    epoll_ctl(g.epfd, EPOLL_CTL_ADD, fd, &ev);
+    g.active++;
+    return true;
+}
+
+// Closes a finished or broken game and, unless we're wrapping up, starts
+// another. Failed connects aren't retried so a dead server can't spin us.
+inline void endLoadConn(LoadGen &g, LoadConn *c, bool replace = true) {
+    epoll_ctl(g.epfd, EPOLL_CTL_DEL, c->conn.fd, nullptr);
+    close(c->conn.fd);
+    g.conns[c->conn.fd] = nullptr;
+    delete c;
+    g.active--;
+    if (g.opts->games > 0 && (long)g.stats.games >= g.opts->games)
+        g.stopping = true;
+    if (!g.stopping && replace)
+        startLoadConn(g);
+}
+
+// Plays `game`'s next move; `channel` is its --mux channel, 0 without.
+inline void sendLoadMove(LoadGen &g, LoadConn *c, LoadGame &game, uint32_t channel) {
+    int col = -1;
+    while (game.scriptPos < g.opts->script.size() && col < 0) {
+        int scripted = g.opts->script[game.scriptPos++] - '1';
+        if (scripted >= 0 && scripted < 7 && game.open[scripted])
+            col = scripted;
+    }
+    if (col < 0) {
+        int legal[7], count = 0;
+        for (int i = 0; i < 7; i++)
+            if (game.open[i])
+                legal[count++] = i;
+        col = count > 0 ? legal[nextRandom(g) % count] : 0;
+    }
+    if (channel != 0) {
+        char line[32];
+        int length = snprintf(line, sizeof(line), "%u MOVE %d\n", channel, col + 1);
+        queueCopy(c->conn, line, length);
+    } else {
+        static const char *MOVES[7] = { "MOVE 1\n", "MOVE 2\n", "MOVE 3\n", "MOVE 4\n", "MOVE 5\n", "MOVE 6\n", "MOVE 7\n" };
+        queueLiteral(c->conn, MOVES[col], 7);
+    }
+    game.moveInFlight = true;
+    game.sentAt = std::chrono::steady_clock::now();
+    g.stats.moves++;
+}
+
+/*
+ * Function: handleLoadLine
+ *
+ * Advances one game's frame parser. Returns false if the game is over
+ * (`finished` is set) or broke the protocol.
+ */
+inline bool handleLoadLine(LoadGen &g, LoadConn *c, LoadGame &game, uint32_t channel, std::string_view line) {
+    switch (game.state) {
+    case LOAD_HEADER:
+        if (line == "INVALID_MOVE") {
+            g.stats.invalidMoves++;
+            return true;
+        }
+        if (line != "BOARD") {
+            g.stats.protocolErrors++;
+            return false;
+        }
+        game.state = LOAD_ROWS;
+        game.rowsRead = 0;
+        return true;
+    case LOAD_ROWS:
+        if (game.rowsRead == 0) {
+            if (line.size() < 13) {
+                g.stats.protocolErrors++;
+                return false;
+            }
+            for (int i = 0; i < 7; i++)
+                game.open[i] = line[i * 2] == '.';
+        }
+        if (++game.rowsRead == 6)
+            game.state = LOAD_TURN;
+        return true;
+    case LOAD_TURN:
+        game.state = LOAD_HEADER;
+        if (game.moveInFlight) {
+            g.stats.latencyNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - game.sentAt).count());
+            game.moveInFlight = false;
+        }
+        if (line == "TURN CLIENT") {
+            sendLoadMove(g, c, game, channel);
+            return true;
+        }
+        if (line.rfind("TURN", 0) == 0)
+            return true;
+        if (line.rfind("GAMEOVER", 0) == 0) {
+            g.stats.games++;
+            game.finished = true;
+            return false;
+        }
+        g.stats.protocolErrors++;
+        return false;
+    }
+    return false;
+}
+
+// Starts a new game on --mux channel `channel`.
+inline void openLoadChannel(LoadConn *c, uint32_t channel) {
+    c->channels[channel - 1] = LoadGame();
+    char line[32];
+    int length = snprintf(line, sizeof(line), "%u OPEN\n", channel);
+    queueCopy(c->conn, line, length);
+}
+
+/*
+ * Function: handleLoadPayload
+ *
+ * Feeds one mux frame's payload to its channel's game, a line at a
+ * time, and reopens the channel when the game ends. Returns false if
+ * the game broke the protocol.
+ */
+inline bool handleLoadPayload(LoadGen &g, LoadConn *c, uint32_t channel, std::string_view payload) {
+    LoadGame &game = c->channels[channel - 1];
+    game.partial.append(payload.data(), payload.size());
+    size_t start = 0, end;
+    while ((end = game.partial.find('\n', start)) != std::string::npos) {
+        std::string_view line(game.partial.data() + start, end - start);
+        start = end + 1;
+        if (handleLoadLine(g, c, game, channel, line))
+            continue;
+        if (!game.finished)
+            return false;
+        if (g.opts->games > 0 && (long)g.stats.games >= g.opts->games)
+            g.stopping = true;
+        if (!g.stopping)
+            openLoadChannel(c, channel); // Resets `game`, partial line and all.
+        return true;
+    }
+    game.partial.erase(0, start);
+    return true;
+}
+
+/*
+ * Function: readLoadMux
+ *
+ * Consumes a --mux connection's input: the plain-text lines up to
+ * "PROTOCOL MUX OK", then whole mux frames. Returns false if the
+ * server broke the protocol.
+ */
+inline bool readLoadMux(LoadGen &g, LoadConn *c) {
+    while (!c->muxReady) {
+        std::string_view line;
+        if (!nextLine(c->conn, line))
+            return true;
+        if (line == "PROTOCOL MUX OK") {
+            c->muxReady = true;
+            for (uint32_t ch = 1; ch <= c->channels.size(); ch++)
+                openLoadChannel(c, ch);
+        } else if (line == "INVALID_MOVE") {
+            return false; // A server without multiplexing.
+        }
+    }
+    while (c->conn.inTail - c->conn.inHead >= MUX_HEADER_SIZE) {
+        const uint8_t *header = (const uint8_t *)c->conn.in + c->conn.inHead;
+        size_t length = getLE(header + 2, 2);
+        uint32_t channel = getLE(header + 4, 4);
+        if (header[0] != FRAME_MUX || channel == 0 || channel > c->channels.size())
+            return false;
+        std::string_view frame;
+        if (!nextBytes(c->conn, MUX_HEADER_SIZE + length, frame))
+            return true;
+        if (!handleLoadPayload(g, c, channel, frame.substr(MUX_HEADER_SIZE)))
+            return false;
+    }
+    return true;
+}
+
+inline void serviceLoadConn(LoadGen &g, LoadConn *c, uint32_t events) {
+    if (c->connecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            g.stats.connectFailures++;
+            endLoadConn(g, c, false);
+            return;
+        }
+        if (!(events & (EPOLLOUT | EPOLLIN)))
+            return;
+        c->connecting = false;
+    }
+
+    while (true) {
+        if (!c->channels.empty()) {
+            if (!readLoadMux(g, c)) {
+                g.stats.protocolErrors++;
+                endLoadConn(g, c);
+                return;
+            }
+        } else {
+            std::string_view line;
+            while (nextLine(c->conn, line)) {
+                if (!handleLoadLine(g, c, c->game, 0, line)) {
+                    endLoadConn(g, c);
+                    return;
+                }
+            }
+        }
+        if (inputFull(c->conn)) {
+            g.stats.protocolErrors++;
+            endLoadConn(g, c);
+            return;
+        }
+        ssize_t n = fillInput(c->conn);
+        if (n > 0)
+            continue;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        g.stats.disconnects++;
+        endLoadConn(g, c);
+        return;
+    }
+    if (!flushOutput(c->conn)) {
+        g.stats.disconnects++;
+        endLoadConn(g, c);
+    }
+}
+
+inline uint64_t percentile(const std::vector<uint64_t> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+/*
+ * Function: runLoad
+ *
+ * Runs the load test against host:service and prints the report.
+ * Returns 0, or 1 if the address can't be resolved.
+ */
+inline int runLoad(const char *hostname, const char *service, const LoadOptions &opts) {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    LoadGen g;
+    int status = getaddrinfo(hostname, service, &hints, &g.addr);
+    if (status != 0) {
+        std::cerr << "[ERROR] getaddrinfo(): " << gai_strerror(status) << std::endl;
+        return 1;
+    }
+
+    // One fd per simulated player (per --mux connection).
+    struct rlimit fd_limit;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0 && fd_limit.rlim_cur < fd_limit.rlim_max) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fd_limit);
+    }
+
+    g.opts = &opts;
+    g.epfd = epoll_create1(0);
+    g.active = 0;
+    g.rng = 0x9E3779B97F4A7C15ULL ^ (uint64_t)getpid();
+    g.stopping = false;
+    g.stats = LoadStats();
+    g.stats.latencyNs.reserve(1 << 20);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point end = start + std::chrono::seconds(opts.seconds);
+    for (int i = 0; i < opts.connections; i++)
+        startLoadConn(g);
+
+    // Games still in progress when we stop are simply abandoned.
+    struct epoll_event events[256];
+    while (!g.stopping && g.active > 0) {
+        if (opts.seconds > 0 && std::chrono::steady_clock::now() >= end)
+            break;
+        int n = epoll_wait(g.epfd, events, 256, 100);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if ((size_t)fd < g.conns.size() && g.conns[fd] != nullptr)
+                serviceLoadConn(g, g.conns[fd], events[i].events);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (size_t fd = 0; fd < g.conns.size(); fd++) {
+        if (g.conns[fd]) {
+            close(g.conns[fd]->conn.fd);
+            delete g.conns[fd];
+        }
+    }
+    close(g.epfd);
+    freeaddrinfo(g.addr);
+
+    std::vector<uint64_t> &lat = g.stats.latencyNs;
+    std::sort(lat.begin(), lat.end());
+    std::cout << "connections:      " << opts.connections << "\n";
+    if (opts.mux > 0)
+        std::cout << "games/connection: " << opts.mux << " (multiplexed)\n";
+    std::cout << "elapsed:          " << seconds << " s\n"
+              << "games:            " << g.stats.games << " (" << g.stats.games / seconds << "/s)\n"
+              << "moves:            " << g.stats.moves << " (" << g.stats.moves / seconds << "/s)\n"
+              << "move RTT p50:     " << percentile(lat, 0.50) / 1000.0 << " us\n"
+              << "move RTT p99:     " << percentile(lat, 0.99) / 1000.0 << " us\n"
+              << "move RTT p99.9:   " << percentile(lat, 0.999) / 1000.0 << " us\n"
+              << "INVALID_MOVE:     " << g.stats.invalidMoves << "\n"
+              << "protocol errors:  " << g.stats.protocolErrors << "\n"
+              << "disconnects:      " << g.stats.disconnects << "\n"
+              << "connect failures: " << g.stats.connectFailures << std::endl;
+    return 0;
+}
+
+#endif // LOADGEN_H
@@ -0,0 +1,169 @@
+/*
+ *  lobby.h
+ *
+ *  -------------------------------------------------------------------
+ *  Matchmaking for player-vs-player games (run_server.x --pvp). Every
+ *  new connection goes into the lobby and is paired with whoever has
+ *  been waiting, in arrival order; the first to arrive moves first.
+ *
+ *  The lobby is a single lock-free exchange slot, shared by every
+ *  reactor:
+ *    • arriving with the slot empty, a player parks a LobbyTicket there
+ *      with one compare-and-swap and waits;
+ *    • arriving with a ticket there, a player takes it with one
+ *      compare-and-swap and is paired with its owner.
+ *  Nobody ever waits behind a lock and each arrival is O(1), however
+ *  many connect at once; at most one player is ever waiting.
+ *
+ *  Both players of a game have to live on the same reactor so moves
+ *  can be relayed with plain function calls. If the waiting player is
+ *  on another reactor, the newcomer is taken out of its own reactor's
+ *  epoll set and pushed onto the waiting player's HandoffInbox, a
+ *  lock-free stack plus an eventfd in that reactor's epoll set; the
+ *  reactor adopts the session and starts the game there. A player who
+ *  hangs up while waiting takes the ticket back out of the slot; if
+ *  someone claimed it first, the handoff finds the ticket's session
+ *  gone and the newcomer goes back into the lobby.
+ *
+ *  Tickets and the sessions they name are only touched by their own
+ *  reactor, except `inbox`, which is set before the ticket is
+ *  published and never changes.
+ *
+ *  Spectators travel the same way: "WATCH <game-id>" hands the
+ *  spectator to the reactor the game lives on, found by reactor id in
+ *  handoffDirectory(). Game ids carry that reactor id (gameReactor()),
+ *  and so do resume tokens, so "RESUME <token>" finds its game's
+ *  reactor the same way.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef LOBBY_H
+#define LOBBY_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <unistd.h>
+
+#include "session.h"
+
+// A reactor's mailbox for sessions other reactors hand over to it.
+struct HandoffInbox {
+    int eventfd;
+    std::atomic<Session*> head; // Newest first, linked through nextHandoff.
+};
+
+struct LobbyTicket {
+    HandoffInbox *inbox; // The waiting player's reactor.
+    Session *session;    // nullptr once the player has left.
+};
+
+inline std::atomic<LobbyTicket*> &lobbySlot() {
+    static std::atomic<LobbyTicket*> slot(nullptr);
+    return slot;
+}
+
+// Every reactor's HandoffInbox by reactor id; nullptr until it starts.
+struct HandoffDirectory {
+    std::unique_ptr<std::atomic<HandoffInbox*>[]> inboxes;
+    int count;
+};
+
+inline HandoffDirectory &handoffDirectory() {
+    static HandoffDirectory directory;
+    return directory;
+}
+
+// Sizes the directory; before any reactor thread starts.
+inline void initHandoffDirectory(int reactors) {
+    HandoffDirectory &directory = handoffDirectory();
+    directory.inboxes.reset(new std::atomic<HandoffInbox*>[reactors]);
+    for (int i = 0; i < reactors; i++)
+        directory.inboxes[i].store(nullptr, std::memory_order_relaxed);
+    directory.count = reactors;
+}
+
+// Game ids are serial * reactors + reactor id, so any reactor can find a game's home.
+inline uint64_t makeGameId(uint64_t serial, int reactor) {
+    return serial * handoffDirectory().count + reactor;
+}
+
+// Resume tokens route the same way, but the rest is random: holding
+// one is all it takes to walk into the game, so it mustn't be guessable.
+inline uint64_t makeResumeToken(int reactor) {
+    uint64_t random = 0;
+    ssize_t n;
+    do {
+        n = getrandom(&random, sizeof(random), 0);
+    } while (n < 0 && errno == EINTR);
+    uint64_t count = handoffDirectory().count;
+    uint64_t token = (random >> 1) / count * count + reactor;
+    return token != 0 ? token : count; // 0 means no token.
+}
+
+inline int gameReactor(uint64_t gameId) {
+    return (int)(gameId % handoffDirectory().count);
+}
+
+inline HandoffInbox *reactorInbox(int reactor) {
+    return handoffDirectory().inboxes[reactor].load(std::memory_order_acquire);
+}
+
+inline bool initHandoffs(HandoffInbox &inbox) {
+    inbox.head.store(nullptr, std::memory_order_relaxed);
+    inbox.eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return inbox.eventfd != -1;
+}
+
+/*
+ * Function: enterLobby
+ *
+ * Parks `ticket` if nobody is waiting and returns nullptr, or takes
+ * the waiting player's ticket and returns it (the caller now owns it).
+ */
+inline LobbyTicket *enterLobby(LobbyTicket *ticket) {
+    std::atomic<LobbyTicket*> &slot = lobbySlot();
+    LobbyTicket *waiting = slot.load(std::memory_order_acquire);
+    while (true) {
+        LobbyTicket *next = waiting ? nullptr : ticket;
+        if (slot.compare_exchange_weak(waiting, next, std::memory_order_acq_rel, std::memory_order_acquire))
+            return waiting;
+    }
+}
+
+// Takes our ticket back out of the slot. False if someone already claimed it.
+inline bool leaveLobby(LobbyTicket *ticket) {
+    LobbyTicket *expected = ticket;
+    return lobbySlot().compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+}
+
+inline void postHandoff(HandoffInbox &inbox, Session *s) {
+    s->nextHandoff = inbox.head.load(std::memory_order_relaxed);
+    while (!inbox.head.compare_exchange_weak(s->nextHandoff, s, std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+    }
+    uint64_t one = 1;
+    ssize_t n = write(inbox.eventfd, &one, sizeof(one));
+    (void)n; // Only fails if the counter is about to overflow, i.e. already readable.
+}
+
+// Everything handed over so far, oldest first, and clears the eventfd.
+inline Session *takeHandoffs(HandoffInbox &inbox) {
+    uint64_t wakeups;
+    while (read(inbox.eventfd, &wakeups, sizeof(wakeups)) > 0) {
+    }
+    Session *newest = inbox.head.exchange(nullptr, std::memory_order_acquire);
+    Session *oldest = nullptr;
+    while (newest) {
+        Session *next = newest->nextHandoff;
+        newest->nextHandoff = oldest;
+        oldest = newest;
+        newest = next;
+    }
+    return oldest;
+}
+
+#endif // LOBBY_H
@@ -0,0 +1,403 @@
+/*
+ *  log.h
+ *
+ *  -------------------------------------------------------------------
+ *  Asynchronous logger for the server's game loop.
+ *
+ *      logMessage(LOG_INFO, "Client dropped a piece in column {}.", col);
+ *
+ *  The calling thread doesn't format anything or touch stdout: it
+ *  copies the format pointer and the raw arguments into a fixed-size
+ *  LogRecord on its own single-producer ring and returns. A background
+ *  thread (startLogger()) drains every ring, puts the records back in
+ *  time order, substitutes the "{}" placeholders and writes each batch
+ *  with one write() per stream. A slow terminal or a full disk now
+ *  only delays the log, never a game.
+ *
+ *  Rules for callers:
+ *    • The format must be a string literal, and so must any const char*
+ *      argument - only the pointers are stored.
+ *    • Arguments are integers, doubles, strings, LogIp (an address and
+ *      port), LogErrno (formatted with strerror() on the logger thread)
+ *      or LogBoard (the console's board diagram, counts as two), or
+ *      LogGrid (the same for a variant's board, counts as five).
+ *    • At most LOG_MAX_ARGS argument slots.
+ *
+ *  Records below the current level (--log-level, or --quiet for
+ *  warnings and errors only) are dropped before they're built. If a
+ *  ring is full the record is dropped and counted, rather than making
+ *  the game thread wait; the logger reports how many it lost.
+ *
+ *  WARN and ERROR go to stderr, the rest to stdout. LOG_CONSOLE is the
+ *  console player's own prompts and is never filtered.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+
+enum LogLevel {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+    LOG_CONSOLE
+};
+
+const char *const LOG_LEVEL_NAMES[] = { "debug", "info", "warn", "error" };
+
+const int LOG_MAX_ARGS = 6;
+const size_t LOG_RING = 4096; // Records per thread; a power of two.
+const int LOG_IDLE_MS = 2;    // Logger thread's nap when every ring is empty.
+
+enum LogArgType : uint8_t {
+    ARG_INT,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_IP,    // Address in .i (network order), port in the next slot.
+    ARG_ERRNO,
+    ARG_BOARD, // Client stones in .i, server stones in the next slot.
+    ARG_GRID,  // rows << 8 | cols in .i, then each side's 128-bit stones, low half first.
+    ARG_SKIP   // Second slot of a two-slot argument.
+};
+
+struct LogIp { struct in_addr addr; uint16_t port; }; // Port in host order.
+struct LogErrno { int code; };
+struct LogBoard { uint64_t pieces[2]; };
+struct LogGrid { int rows, cols; uint128 pieces[2]; }; // Stones in Geometry<rows, cols>'s layout.
+
+union LogValue {
+    int64_t i;
+    double d;
+    const char *s;
+};
+
+const uint8_t LOG_NO_NEWLINE = 1;
+
+struct LogRecord {
+    uint64_t timeNs;
+    const char *format;
+    uint8_t level;
+    uint8_t flags;
+    uint8_t count;
+    LogArgType types[LOG_MAX_ARGS];
+    LogValue args[LOG_MAX_ARGS];
+};
+
+// Single producer (the owning thread), single consumer (the logger).
+struct LogRing {
+    alignas(64) std::atomic<uint64_t> head; // Next record to read.
+    alignas(64) std::atomic<uint64_t> tail; // Next record to write.
+    std::atomic<uint64_t> dropped;
+    LogRecord records[LOG_RING];
+};
+
+struct Logger {
+    std::atomic<int> level;
+    std::mutex lock; // Guards `rings` (thread start-up) and the thread handle.
+    std::vector<LogRing*> rings;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<bool> stopping;
+};
+
+inline Logger &logger() {
+    static Logger instance { {LOG_INFO}, {}, {}, {}, {false}, {false} };
+    return instance;
+}
+
+inline void setLogLevel(LogLevel level) {
+    logger().level.store(level, std::memory_order_relaxed);
+}
+
+inline bool logEnabled(LogLevel level) {
+    return level >= logger().level.load(std::memory_order_relaxed);
+}
+
+// This thread's ring, created and registered on first use.
+inline LogRing &threadLogRing() {
+    thread_local LogRing *ring = nullptr;
+    if (ring == nullptr) {
+        ring = new LogRing();
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->tail.store(0, std::memory_order_relaxed);
+        ring->dropped.store(0, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> guard(logger().lock);
+        logger().rings.push_back(ring);
+    }
+    return *ring;
+}
+
+inline void packArg(LogRecord &r, long long v) { r.types[r.count] = ARG_INT; r.args[r.count++].i = v; }
+inline void packArg(LogRecord &r, int v) { packArg(r, (long long)v); }
+inline void packArg(LogRecord &r, unsigned v) { packArg(r, (long long)v); }
+inline void packArg(LogRecord &r, long v) { packArg(r, (long long)v); }
+inline void packArg(LogRecord &r, unsigned long v) { packArg(r, (long long)v); }
+inline void packArg(LogRecord &r, unsigned long long v) { packArg(r, (long long)v); }
+inline void packArg(LogRecord &r, double v) { r.types[r.count] = ARG_DOUBLE; r.args[r.count++].d = v; }
+inline void packArg(LogRecord &r, const char *v) { r.types[r.count] = ARG_STRING; r.args[r.count++].s = v; }
+inline void packArg(LogRecord &r, LogErrno v) { r.types[r.count] = ARG_ERRNO; r.args[r.count++].i = v.code; }
+
+inline void packArg(LogRecord &r, LogIp v) {
+    r.types[r.count] = ARG_IP;
+    r.args[r.count++].i = v.addr.s_addr;
+    r.types[r.count] = ARG_SKIP;
+    r.args[r.count++].i = v.port;
+}
+
+inline void packArg(LogRecord &r, LogBoard v) {
+    r.types[r.count] = ARG_BOARD;
+    r.args[r.count++].i = (int64_t)v.pieces[0];
+    r.types[r.count] = ARG_SKIP;
+    r.args[r.count++].i = (int64_t)v.pieces[1];
+}
+
+inline void packArg(LogRecord &r, LogGrid v) {
+    r.types[r.count] = ARG_GRID;
+    r.args[r.count++].i = v.rows << 8 | v.cols;
+    for (int p = 0; p < 2; p++) {
+        r.types[r.count] = ARG_SKIP;
+        r.args[r.count++].i = (int64_t)(uint64_t)v.pieces[p];
+        r.types[r.count] = ARG_SKIP;
+        r.args[r.count++].i = (int64_t)(uint64_t)(v.pieces[p] >> 64);
+    }
+}
+
+// Argument slots each type takes in a LogRecord; checked at compile time.
+template <typename T> struct LogSlots { static constexpr int count = 1; };
+template <> struct LogSlots<LogIp> { static constexpr int count = 2; };
+template <> struct LogSlots<LogBoard> { static constexpr int count = 2; };
+template <> struct LogSlots<LogGrid> { static constexpr int count = 5; };
+
+/*
+ * Function: logRecord
+ *
+ * Queues one record on the calling thread's ring (see the rules at the
+ * top of this file). Never blocks; drops the record if the ring is full.
+ */
+template <typename... Args>
+inline void logRecord(LogLevel level, uint8_t flags, const char *format, Args... args) {
+    static_assert((0 + ... + LogSlots<Args>::count) <= LOG_MAX_ARGS, "too many log argument slots");
+    if (!logEnabled(level))
+        return;
+    LogRing &ring = threadLogRing();
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (tail - ring.head.load(std::memory_order_acquire) >= LOG_RING) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    LogRecord &r = ring.records[tail & (LOG_RING - 1)];
+    r.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    r.format = format;
+    r.level = level;
+    r.flags = flags;
+    r.count = 0;
+    int unused[] = { 0, (packArg(r, args), 0)... };
+    (void)unused;
+    ring.tail.store(tail + 1, std::memory_order_release);
+}
+
+template <typename... Args>
+inline void logMessage(LogLevel level, const char *format, Args... args) {
+    logRecord(level, 0, format, args...);
+}
+
+// A console prompt: no newline, so the cursor stays on the line.
+inline void logPrompt(const char *text) {
+    logRecord(LOG_CONSOLE, LOG_NO_NEWLINE, text);
+}
+
+// Appends one argument's text; returns how many slots it used.
+inline int formatArg(std::string &out, const LogRecord &r, int k) {
+    char buffer[64];
+    switch (r.types[k]) {
+    case ARG_INT:
+        snprintf(buffer, sizeof(buffer), "%lld", (long long)r.args[k].i);
+        out += buffer;
+        return 1;
+    case ARG_DOUBLE:
+        snprintf(buffer, sizeof(buffer), "%g", r.args[k].d);
+        out += buffer;
+        return 1;
+    case ARG_STRING:
+        out += r.args[k].s;
+        return 1;
+    case ARG_IP: {
+        struct in_addr addr;
+        addr.s_addr = (uint32_t)r.args[k].i;
+        inet_ntop(AF_INET, &addr, buffer, sizeof(buffer));
+        out += buffer;
+        out += ':';
+        out += std::to_string(r.args[k + 1].i);
+        return 2;
+    }
+    case ARG_ERRNO:
+        out += std::to_string(r.args[k].i);
+        out += " - ";
+        out += strerror((int)r.args[k].i);
+        return 1;
+    case ARG_BOARD: {
+        Board board;
+        initBoard(board);
+        board.pieces[0] = (uint64_t)r.args[k].i;
+        board.pieces[1] = (uint64_t)r.args[k + 1].i;
+        out += BOARD_HEADER;
+        out += '\n';
+        for (int i = 0; i < ROWS; i++) {
+            for (int j = 0; j < COLS; j++) {
+                out += cellAt(board, i, j);
+                out += ' ';
+            }
+            if (i < ROWS - 1)
+                out += '\n';
+        }
+        return 2;
+    }
+    case ARG_GRID: {
+        int rows = (int)(r.args[k].i >> 8), cols = (int)(r.args[k].i & 0xff);
+        uint128 pieces[2];
+        for (int p = 0; p < 2; p++)
+            pieces[p] = uint128((uint64_t)r.args[k + 1 + 2 * p].i) | uint128((uint64_t)r.args[k + 2 + 2 * p].i) << 64;
+        for (int j = 0; j < cols; j++) {
+            out += ' ';
+            out += (char)('1' + j);
+        }
+        for (int i = 0; i < rows; i++) {
+            out += '\n';
+            for (int j = 0; j < cols; j++) {
+                uint128 bit = uint128(1) << (j * (rows + 1) + (rows - 1 - i));
+                out += pieces[0] & bit ? 'C' : pieces[1] & bit ? 'S' : '.';
+                out += ' ';
+            }
+        }
+        return 5;
+    }
+    case ARG_SKIP:
+        return 1;
+    }
+    return 1;
+}
+
+inline void formatRecord(std::string &out, const LogRecord &r) {
+    int k = 0;
+    for (const char *p = r.format; *p; p++) {
+        if (p[0] == '{' && p[1] == '}' && k < r.count) {
+            k += formatArg(out, r, k);
+            p++;
+        } else {
+            out += *p;
+        }
+    }
+    if (!(r.flags & LOG_NO_NEWLINE))
+        out += '\n';
+}
+
+inline void writeAll(int fd, const std::string &text) {
+    size_t done = 0;
+    while (done < text.size()) {
+        ssize_t n = write(fd, text.data() + done, text.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return; // Nowhere to log to; nothing sensible left to do.
+        done += n;
+    }
+}
+
+/*
+ * Function: drainLogs
+ *
+ * Takes everything queued on every ring, sorts it by time and writes
+ * it out. Returns how many records it wrote.
+ */
+inline size_t drainLogs(std::vector<LogRecord> &batch, std::string &out, std::string &err) {
+    batch.clear();
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> guard(logger().lock);
+        for (size_t i = 0; i < logger().rings.size(); i++) {
+            LogRing &ring = *logger().rings[i];
+            uint64_t head = ring.head.load(std::memory_order_relaxed);
+            uint64_t tail = ring.tail.load(std::memory_order_acquire);
+            for (; head != tail; head++)
+                batch.push_back(ring.records[head & (LOG_RING - 1)]);
+            ring.head.store(head, std::memory_order_release);
+            dropped += ring.dropped.exchange(0, std::memory_order_relaxed);
+        }
+    }
+    std::stable_sort(batch.begin(), batch.end(),
+                     [](const LogRecord &a, const LogRecord &b) { return a.timeNs < b.timeNs; });
+    out.clear();
+    err.clear();
+    for (size_t i = 0; i < batch.size(); i++) {
+        bool toStderr = batch[i].level == LOG_WARN || batch[i].level == LOG_ERROR;
+        formatRecord(toStderr ? err : out, batch[i]);
+    }
+    if (dropped)
+        err += "[WARN] Logger fell behind, dropped " + std::to_string(dropped) + " records.\n";
+    writeAll(STDOUT_FILENO, out);
+    writeAll(STDERR_FILENO, err);
+    return batch.size();
+}
+
+inline void runLogger() {
+    std::vector<LogRecord> batch;
+    batch.reserve(LOG_RING);
+    std::string out, err;
+    while (!logger().stopping.load(std::memory_order_relaxed)) {
+        if (drainLogs(batch, out, err) == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_MS));
+    }
+    drainLogs(batch, out, err);
+}
+
+// Starts the logger thread. std::cout output written before this (the
+// start-up banner) is flushed first so nothing comes out of order.
+inline void startLogger() {
+    Logger &l = logger();
+    if (l.running.exchange(true))
+        return;
+    std::cout.flush();
+    l.stopping.store(false);
+    l.thread = std::thread(runLogger);
+}
+
+// Writes out whatever is still queued and stops the logger thread.
+inline void stopLogger() {
+    Logger &l = logger();
+    if (!l.running.exchange(false))
+        return;
+    l.stopping.store(true);
+    l.thread.join();
+}
+
+// Parses a --log-level name; false if it isn't one.
+inline bool parseLogLevel(const char *name, int &level) {
+    for (int i = LOG_DEBUG; i <= LOG_ERROR; i++) {
+        if (strcmp(name, LOG_LEVEL_NAMES[i]) == 0) {
+            level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // LOG_H
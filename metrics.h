@@ -0,0 +1,186 @@
+/*
+ *  metrics.h
+ *
+ *  -------------------------------------------------------------------
+ *  Always-on counters and latency histograms for the server.
+ *
+ *  Every reactor thread gets its own Metrics block from
+ *  newThreadMetrics() and is the only writer to it, so recording is a
+ *  relaxed load and store to a cache line no other core writes - no
+ *  lock, no atomic read-modify-write, a few ns. Readers (stats.h) sum
+ *  the blocks whenever they want a snapshot; relaxed atomics keep
+ *  those reads well defined while the owner keeps writing.
+ *
+ *  Histograms are HDR-style log-linear: values below 16 get their own
+ *  bucket, above that each power of two is split into 16 sub-buckets,
+ *  so any recorded value is known to within 1/16 (6.25%) from 1 ns up
+ *  to 2^64 ns in under 1000 buckets.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum Counter {
+    COUNT_ACCEPTED,      // Connections accepted.
+    COUNT_CLOSED,        // Connections closed, for any reason.
+    COUNT_GAMES,         // Games that reached GAMEOVER.
+    COUNT_MOVES,         // Moves played, client and server.
+    COUNT_INVALID_MOVES, // INVALID_MOVE replies.
+    COUNT_TIMEOUTS,      // Games forfeited on a handshake/move timeout.
+    COUNT_REAPED,        // Finished games dropped for not reading.
+    COUNT_BYTES_IN,
+    COUNT_BYTES_OUT,
+    COUNT_ANALYSES,      // ANALYZE requests answered with scores.
+    COUNT_ANALYSIS_HITS, // ... of which straight from the cache.
+    COUNT_ANALYSIS_BUSY, // ANALYZE requests turned away, queue full.
+    COUNT_TT_PROBES,     // Position cache lookups by AI and ANALYZE searches.
+    COUNT_TT_HITS,       // ... that found their position.
+    COUNT_MATCHES,       // PvP games started (--pvp).
+    COUNT_HANDOFFS,      // Sessions moved to another reactor: PvP players, spectators.
+    COUNT_SPECTATORS,    // WATCH requests attached to a game.
+    COUNT_WATCH_RENDERS, // Spectator frames rendered (one per change, however many watch).
+    COUNT_FRAMES_SKIPPED, // Queued spectator chunks dropped for a newer frame.
+    COUNT_IO_SYSCALLS,   // Reactor socket and event-loop syscalls: waits, accepts, reads, writes, closes.
+    COUNT_MUX_GAMES,     // Games opened on multiplexed connections (also in games once finished).
+    COUNT_PARKED,        // Games kept for RESUME after their connection dropped.
+    COUNT_RESUMED,       // Games picked up again with RESUME.
+    COUNT_MIGRATED,      // Sessions handed to a restarted server on SIGUSR2.
+    COUNTER_COUNT
+};
+
+const char *const COUNTER_NAMES[COUNTER_COUNT] = {
+    "accepted", "closed", "games", "moves", "invalid_moves",
+    "timeouts", "reaped", "bytes_in", "bytes_out",
+    "analyses", "analysis_hits", "analysis_busy", "tt_probes", "tt_hits",
+    "matches", "handoffs", "spectators", "watch_renders", "frames_skipped", "io_syscalls", "mux_games",
+    "parked", "resumed", "migrated"
+};
+
+enum HistogramId {
+    HIST_MOVE_REPLY, // Client line received -> whole reply handed to the kernel.
+    HIST_AI_SEARCH,  // searchMove() wall time.
+    HIST_ANALYSIS,   // analyzePosition() wall time, on the analysis pool.
+    HISTOGRAM_COUNT
+};
+
+const char *const HISTOGRAM_NAMES[HISTOGRAM_COUNT] = { "move_reply", "ai_search", "analysis" };
+
+const int HIST_SUB_BITS = 4;
+const uint64_t HIST_SUB = uint64_t(1) << HIST_SUB_BITS;
+const int HIST_BUCKETS = (64 - HIST_SUB_BITS + 1) * HIST_SUB;
+
+struct alignas(64) Metrics {
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+    std::atomic<uint64_t> histograms[HISTOGRAM_COUNT][HIST_BUCKETS];
+};
+
+// Plain totals summed over every thread's Metrics.
+struct MetricsSnapshot {
+    uint64_t counters[COUNTER_COUNT];
+    uint64_t histograms[HISTOGRAM_COUNT][HIST_BUCKETS];
+};
+
+inline int histBucket(uint64_t value) {
+    if (value < HIST_SUB)
+        return (int)value;
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (int)((value >> shift) & (HIST_SUB - 1));
+}
+
+// Largest value that lands in `bucket`, which is what percentiles report.
+inline uint64_t histBucketTop(int bucket) {
+    if (bucket < (int)HIST_SUB)
+        return bucket;
+    int shift = bucket / HIST_SUB - 1;
+    uint64_t sub = bucket % HIST_SUB;
+    return ((HIST_SUB + sub + 1) << shift) - 1;
+}
+
+// Single-writer increment: plain load + store, no locked instruction.
+inline void count(Metrics &m, Counter c, uint64_t n = 1) {
+    m.counters[c].store(m.counters[c].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void record(Metrics &m, HistogramId h, uint64_t value) {
+    std::atomic<uint64_t> &bucket = m.histograms[h][histBucket(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+inline uint64_t monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Every thread's block. Only touched when a thread starts and when
+// a snapshot is taken, never while recording.
+struct MetricsRegistry {
+    std::mutex lock;
+    std::vector<Metrics*> threads;
+};
+
+inline MetricsRegistry &metricsRegistry() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+/*
+ * Function: newThreadMetrics
+ *
+ * A zeroed Metrics block for the calling thread to record into. It
+ * lives for the rest of the process, so its counts still show in
+ * snapshots after the thread exits.
+ */
+inline Metrics *newThreadMetrics() {
+    Metrics *m = new Metrics();
+    for (int c = 0; c < COUNTER_COUNT; c++)
+        m->counters[c].store(0, std::memory_order_relaxed);
+    for (int h = 0; h < HISTOGRAM_COUNT; h++)
+        for (int b = 0; b < HIST_BUCKETS; b++)
+            m->histograms[h][b].store(0, std::memory_order_relaxed);
+    MetricsRegistry &registry = metricsRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.threads.push_back(m);
+    return m;
+}
+
+inline void takeSnapshot(MetricsSnapshot &out) {
+    out = MetricsSnapshot();
+    MetricsRegistry &registry = metricsRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for (size_t t = 0; t < registry.threads.size(); t++) {
+        const Metrics &m = *registry.threads[t];
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            out.counters[c] += m.counters[c].load(std::memory_order_relaxed);
+        for (int h = 0; h < HISTOGRAM_COUNT; h++)
+            for (int b = 0; b < HIST_BUCKETS; b++)
+                out.histograms[h][b] += m.histograms[h][b].load(std::memory_order_relaxed);
+    }
+}
+
+/*
+ * Function: histPercentile
+ *
+ * Value at quantile q (0-1) of the histogram's samples, as its bucket's
+ * top. Returns 0 if there are no samples.
+ */
+inline uint64_t histPercentile(const uint64_t *buckets, uint64_t total, double q) {
+    if (total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= rank)
+            return histBucketTop(b);
+    }
+    return histBucketTop(HIST_BUCKETS - 1);
+}
+
+#endif // METRICS_H
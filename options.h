@@ -0,0 +1,309 @@
+/*
+ *  options.h
+ *
+ *  -------------------------------------------------------------------
+ *  Command line for run_server.x:
+ *
+ *      run_server.x <port> [--ai <ms>] [--threads <n>] [--book <file>]
+ *                   [--reactors <n|auto>] [--io <epoll|uring>]
+ *                   [--move-timeout <s>] [--handshake-timeout <s>]
+ *                   [--idle-timeout <s>] [--resume-timeout <s>]
+ *                   [--stats-port <port>] [--stats-interval <s>]
+ *                   [--log-level <level>] [--quiet] [--archive <file>]
+ *                   [--analyze-threads <n>] [--tt-mb <n>] [--huge-pages]
+ *                   [--checkpoint <file>] [--pvp] [--search-bench]
+ *
+ *    --ai <ms>        The server picks its own moves with the built-in
+ *                     engine (search.h), spending at most <ms> per move
+ *                     on a pool thread (one per reactor, see analysis.h).
+ *                     Without it, moves are typed at the console as before.
+ *    --threads <n>    Search threads per AI move (lazy SMP), at most the
+ *                     machine's CPU count. Default 1.
+ *    --book <file>    Opening book from book_gen.cpp, mmap()ed at startup
+ *                     and consulted before searching.
+ *    --reactors <n>   Event loop threads, each with its own SO_REUSEPORT
+ *                     listener on <port> and its own games; the kernel
+ *                     spreads new connections across them. "auto" = one
+ *                     per online CPU. Default 1. More than one needs
+ *                     --ai or --pvp, since there's only one console.
+ *    --io <backend>   How the reactors do socket I/O: "epoll" (default),
+ *                     readiness events and a recv()/writev() per socket,
+ *                     or "uring", io_uring completions with one
+ *                     io_uring_enter() per loop for every socket (see
+ *                     reactor.h). Falls back to epoll, with a warning, if
+ *                     the kernel can't do what the uring backend needs.
+ *    --move-timeout <s>       Seconds the client gets for each move before
+ *                             it forfeits with GAMEOVER TIMEOUT. Default 60.
+ *    --handshake-timeout <s>  Seconds a new connection gets to send its
+ *                             first line. Default 10.
+ *    --idle-timeout <s>       Seconds a finished game may take to drain its
+ *                             final frame before it's dropped. Default 10.
+ *                             0 turns any of these three off.
+ *    --resume-timeout <s>     Seconds a game whose client asked for a
+ *                             resume token (see protocol.h) is kept after
+ *                             its connection drops, for "RESUME <token>".
+ *                             Default 60; 0 = not kept.
+ *    --stats-port <port>      Serve live counters and latency histograms
+ *                             as text on 127.0.0.1:<port> (see stats.h).
+ *    --stats-interval <s>     Also print them every <s> seconds.
+ *    --log-level <level>      debug, info (default), warn or error.
+ *    --quiet                  Same as --log-level warn: no per-move lines.
+ *    --archive <file>         Append every finished game to <file> (see
+ *                             archive.h); read it with run_replay.x.
+ *    --analyze-threads <n>    Threads answering clients' ANALYZE requests
+ *                             (see analysis.h). Default 1.
+ *    --tt-mb <n>      Size of the position cache every AI move and ANALYZE
+ *                     search shares (search.h), allocated at startup.
+ *                     Default 64, at most 65536.
+ *    --huge-pages     Back that cache with 2 MB pages: explicit ones if
+ *                     vm.nr_hugepages has any free, else a THP hint.
+ *    --checkpoint <file>  Allow zero-downtime restarts: on SIGUSR2 the
+ *                     server snapshots its games into <file> and hands
+ *                     them and its listening sockets to a fresh copy of
+ *                     itself (see upgrade.h). Without it SIGUSR2 is
+ *                     ignored. The copy gets --inherit <fds> on top of
+ *                     these arguments; that one isn't for typing.
+ *    --pvp            Player vs player: clients are paired with each other
+ *                     in arrival order (see lobby.h) instead of playing
+ *                     the server. Can't be combined with --ai.
+ *    --search-bench   Don't serve; time the search on a fixed set of
+ *                     positions with 1 and <n> threads, print nodes/sec
+ *                     and the speedup, then exit.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.h"    // LogLevel, parseLogLevel()
+#include "search.h" // TT_MEGABYTES, TT_MAX_MEGABYTES
+
+enum IoBackend {
+    IO_EPOLL,
+    IO_URING
+};
+
+struct ServerOptions {
+    int port;
+    int aiMs; // 0 = console plays the server's side.
+    int threads;
+    const char *bookPath; // nullptr = no opening book.
+    int reactors;         // 0 = one per online CPU.
+    IoBackend io;
+    int moveTimeout;      // Seconds; 0 = no limit. Same for the next two.
+    int handshakeTimeout;
+    int idleTimeout;
+    int resumeTimeout;
+    int statsPort;        // 0 = no stats endpoint.
+    int statsInterval;    // Seconds between stats dumps; 0 = none.
+    int logLevel;         // A LogLevel (log.h).
+    const char *archivePath; // nullptr = don't archive games.
+    const char *checkpointPath; // nullptr = SIGUSR2 does nothing.
+    std::vector<int> inherited; // --inherit: a predecessor's listening sockets, reactor 0's first.
+    int analyzeThreads;
+    int ttMb;
+    bool hugePages;
+    bool pvp;
+    bool searchBench;
+};
+
+inline void printUsage(const char *prog) {
+    std::cerr << "Usage: " << prog << " <port> [--ai <ms>] [--threads <n>] [--book <file>]"
+              << " [--reactors <n|auto>] [--io <epoll|uring>] [--move-timeout <s>] [--handshake-timeout <s>]"
+              << " [--idle-timeout <s>] [--resume-timeout <s>] [--stats-port <port>] [--stats-interval <s>]"
+              << " [--log-level <debug|info|warn|error>] [--quiet] [--archive <file>]"
+              << " [--analyze-threads <n>] [--tt-mb <n>] [--huge-pages] [--checkpoint <file>] [--pvp]"
+              << " [--search-bench]\n";
+}
+
+// Reads a positive integer argument; false if it's missing or bad.
+inline bool parseCount(int argc, char *argv[], int &i, int &out) {
+    if (i + 1 >= argc)
+        return false;
+    char *end;
+    long value = strtol(argv[++i], &end, 10);
+    if (*end != '\0' || value <= 0)
+        return false;
+    out = (int)value;
+    return true;
+}
+
+inline bool parseString(int argc, char *argv[], int &i, const char *&out) {
+    if (i + 1 >= argc)
+        return false;
+    out = argv[++i];
+    return true;
+}
+
+// Like parseCount(), but 0 is allowed too.
+inline bool parseSeconds(int argc, char *argv[], int &i, int &out) {
+    if (i + 1 >= argc)
+        return false;
+    char *end;
+    long value = strtol(argv[++i], &end, 10);
+    if (*end != '\0' || value < 0 || value > 86400 * 365)
+        return false;
+    out = (int)value;
+    return true;
+}
+
+// A positive count, or "auto" (stored as 0).
+inline bool parseReactors(int argc, char *argv[], int &i, int &out) {
+    if (i + 1 < argc && strcmp(argv[i + 1], "auto") == 0) {
+        i++;
+        out = 0;
+        return true;
+    }
+    return parseCount(argc, argv, i, out);
+}
+
+inline bool parseIo(int argc, char *argv[], int &i, IoBackend &out) {
+    if (i + 1 >= argc)
+        return false;
+    const char *name = argv[++i];
+    if (strcmp(name, "epoll") == 0)
+        out = IO_EPOLL;
+    else if (strcmp(name, "uring") == 0)
+        out = IO_URING;
+    else
+        return false;
+    return true;
+}
+
+// "<fd>[,<fd>...]", as spawnSuccessor() (upgrade.h) writes it.
+inline bool parseFds(int argc, char *argv[], int &i, std::vector<int> &out) {
+    if (i + 1 >= argc)
+        return false;
+    const char *p = argv[++i];
+    out.clear();
+    while (true) {
+        char *end;
+        long fd = strtol(p, &end, 10);
+        if (end == p || fd < 0 || fd > 1 << 30)
+            return false;
+        out.push_back((int)fd);
+        if (*end == '\0')
+            return true;
+        if (*end != ',')
+            return false;
+        p = end + 1;
+    }
+}
+
+inline bool parseServerArgs(int argc, char *argv[], ServerOptions &opts) {
+    opts.port = 0;
+    opts.aiMs = 0;
+    opts.threads = 1;
+    opts.bookPath = nullptr;
+    opts.reactors = 1;
+    opts.io = IO_EPOLL;
+    opts.moveTimeout = 60;
+    opts.handshakeTimeout = 10;
+    opts.idleTimeout = 10;
+    opts.resumeTimeout = 60;
+    opts.statsPort = 0;
+    opts.statsInterval = 0;
+    opts.logLevel = LOG_INFO;
+    opts.archivePath = nullptr;
+    opts.checkpointPath = nullptr;
+    opts.inherited.clear();
+    opts.analyzeThreads = 1;
+    opts.ttMb = TT_MEGABYTES;
+    opts.hugePages = false;
+    opts.pvp = false;
+    opts.searchBench = false;
+    if (argc < 2)
+        return false;
+    char *end;
+    long port = strtol(argv[1], &end, 10);
+    if (*end != '\0' || port < 0 || port > 65535)
+        return false;
+    opts.port = (int)port;
+
+    for (int i = 2; i < argc; i++) {
+        const char *opt = argv[i];
+        bool ok;
+        if (strcmp(opt, "--ai") == 0)
+            ok = parseCount(argc, argv, i, opts.aiMs);
+        else if (strcmp(opt, "--threads") == 0)
+            ok = parseCount(argc, argv, i, opts.threads);
+        else if (strcmp(opt, "--book") == 0)
+            ok = parseString(argc, argv, i, opts.bookPath);
+        else if (strcmp(opt, "--reactors") == 0)
+            ok = parseReactors(argc, argv, i, opts.reactors);
+        else if (strcmp(opt, "--io") == 0)
+            ok = parseIo(argc, argv, i, opts.io);
+        else if (strcmp(opt, "--move-timeout") == 0)
+            ok = parseSeconds(argc, argv, i, opts.moveTimeout);
+        else if (strcmp(opt, "--handshake-timeout") == 0)
+            ok = parseSeconds(argc, argv, i, opts.handshakeTimeout);
+        else if (strcmp(opt, "--idle-timeout") == 0)
+            ok = parseSeconds(argc, argv, i, opts.idleTimeout);
+        else if (strcmp(opt, "--resume-timeout") == 0)
+            ok = parseSeconds(argc, argv, i, opts.resumeTimeout);
+        else if (strcmp(opt, "--stats-port") == 0)
+            ok = parseCount(argc, argv, i, opts.statsPort) && opts.statsPort <= 65535;
+        else if (strcmp(opt, "--stats-interval") == 0)
+            ok = parseCount(argc, argv, i, opts.statsInterval);
+        else if (strcmp(opt, "--log-level") == 0)
+            ok = i + 1 < argc && parseLogLevel(argv[++i], opts.logLevel);
+        else if (strcmp(opt, "--quiet") == 0) {
+            opts.logLevel = LOG_WARN;
+            ok = true;
+        }
+        else if (strcmp(opt, "--archive") == 0)
+            ok = parseString(argc, argv, i, opts.archivePath);
+        else if (strcmp(opt, "--checkpoint") == 0)
+            ok = parseString(argc, argv, i, opts.checkpointPath);
+        else if (strcmp(opt, "--inherit") == 0)
+            ok = parseFds(argc, argv, i, opts.inherited);
+        else if (strcmp(opt, "--analyze-threads") == 0)
+            ok = parseCount(argc, argv, i, opts.analyzeThreads);
+        else if (strcmp(opt, "--tt-mb") == 0)
+            ok = parseCount(argc, argv, i, opts.ttMb);
+        else if (strcmp(opt, "--huge-pages") == 0)
+            ok = opts.hugePages = true;
+        else if (strcmp(opt, "--pvp") == 0)
+            ok = opts.pvp = true;
+        else if (strcmp(opt, "--search-bench") == 0)
+            ok = opts.searchBench = true;
+        else
+            ok = false;
+        if (!ok) {
+            std::cerr << "Bad or unknown option: " << opt << "\n";
+            return false;
+        }
+    }
+    int cpus = std::max(1u, std::thread::hardware_concurrency());
+    if (opts.threads > cpus) {
+        std::cerr << "--threads " << opts.threads << " is more than this machine's CPU count (" << cpus << ").\n";
+        return false;
+    }
+    if (opts.ttMb > TT_MAX_MEGABYTES) {
+        std::cerr << "--tt-mb goes up to " << TT_MAX_MEGABYTES << ".\n";
+        return false;
+    }
+    if (opts.pvp && opts.aiMs > 0) {
+        std::cerr << "--pvp and --ai don't mix: with --pvp the server doesn't play.\n";
+        return false;
+    }
+    if (!opts.inherited.empty() && !opts.checkpointPath) {
+        std::cerr << "--inherit comes with the --checkpoint it restores from.\n";
+        return false;
+    }
+    if (opts.reactors != 1 && opts.aiMs == 0 && !opts.pvp) {
+        std::cerr << "--reactors needs --ai or --pvp: only one console can play the server's side.\n";
+        return false;
+    }
+    return true;
+}
+
+#endif // OPTIONS_H
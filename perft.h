@@ -0,0 +1,290 @@
+/*
+ *  perft.h
+ *
+ *  -------------------------------------------------------------------
+ *  Exhaustive move-tree counter ("perft", as chess engines call it)
+ *  for checking the rule engine against known numbers and for timing
+ *  it. perft.cpp is the command-line front end.
+ *
+ *  From a start position, every legal move sequence is played to
+ *  `depth` plies with the engine's own drop(), hasWin() and isFull()
+ *  (bitboard.h), not a copy of them, so a mistake in any of the three
+ *  changes the counts. Everything is a template over the board
+ *  Geometry, so each variant (variants.h) is counted by its own
+ *  specialised engine. A game that ends (a winning run or a full
+ *  board) is a leaf. For every ply we count the positions reached and
+ *  how many of them are client wins, server wins and ties.
+ *
+ *  Two kinds of count:
+ *    • tree (default): every move sequence, so transpositions are
+ *      counted once per path.
+ *    • dedup: each distinct position once. Every node's positionKey()
+ *      goes into a shared lock-free hash set before it is expanded; a
+ *      node already there has had its subtree counted and is skipped.
+ *      The table is fixed-size (runPerft()'s hashMb); running out of
+ *      room makes the result invalid, and runPerft() says so. Only
+ *      boards with 64-bit keys can be deduplicated.
+ *
+ *  Parallelism is a work-stealing pool. A task is a position plus the
+ *  plies left to search. Tasks with more than PERFT_SPLIT_DEPTH plies
+ *  left push one task per child onto the worker's own deque; smaller
+ *  ones are searched recursively in place. Workers pop their own
+ *  newest task (depth-first, cache-warm) and, when out of work, steal
+ *  the oldest task (the biggest subtree) from another worker.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bitboard.h"
+
+const int PERFT_MAX_PLY = 127;   // The most cells any Geometry can have.
+const int PERFT_SPLIT_DEPTH = 6; // Subtrees this shallow aren't split any further.
+
+struct PerftCounts {
+    uint64_t positions[PERFT_MAX_PLY + 1]; // Indexed by absolute ply (board.moves).
+    uint64_t wins[2][PERFT_MAX_PLY + 1];   // [0] client, [1] server.
+    uint64_t ties[PERFT_MAX_PLY + 1];
+};
+
+struct PerftResult {
+    PerftCounts counts;
+    uint64_t nodes; // Sum of positions over every ply.
+    double seconds;
+    bool tableFull; // Dedup table ran out of room; the counts are wrong.
+};
+
+template <class G>
+struct PerftTask {
+    typename G::Board board;
+    int depth; // Plies left.
+};
+
+template <class G>
+struct alignas(64) PerftWorker {
+    std::mutex lock; // Guards `tasks`; held only to push, pop or steal.
+    std::deque<PerftTask<G>> tasks;
+    PerftCounts counts;
+};
+
+// Set of positionKey()s for --dedup. Open addressing, 0 = empty slot
+// (no real key is 0: BOTTOM_MASK is always added in).
+struct PerftTable {
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    uint64_t mask;
+    std::atomic<bool> full;
+};
+
+template <class G>
+struct PerftShared {
+    std::vector<PerftWorker<G>> workers;
+    std::atomic<uint64_t> pending; // Tasks queued or running.
+    PerftTable *table;             // nullptr = tree count.
+};
+
+inline void initPerftTable(PerftTable &table, size_t megabytes) {
+    uint64_t slots = 1;
+    while (slots * 2 * sizeof(uint64_t) <= megabytes * 1024 * 1024)
+        slots *= 2;
+    table.slots.reset(new std::atomic<uint64_t>[slots]);
+    for (uint64_t i = 0; i < slots; i++)
+        table.slots[i].store(0, std::memory_order_relaxed);
+    table.mask = slots - 1;
+    table.full.store(false, std::memory_order_relaxed);
+}
+
+/*
+ * Function: insertPosition
+ *
+ * Adds a key to the set. Returns true if it wasn't there before (so
+ * the caller owns the position), false if some thread already added
+ * it or the table is full.
+ */
+inline bool insertPosition(PerftTable &table, uint64_t key) {
+    uint64_t i = (key * 0x9E3779B97F4A7C15ULL) >> 20 & table.mask;
+    for (uint64_t probes = 0; probes <= table.mask; probes++, i = (i + 1) & table.mask) {
+        uint64_t seen = table.slots[i].load(std::memory_order_relaxed);
+        if (seen == key)
+            return false;
+        if (seen == 0) {
+            if (table.slots[i].compare_exchange_strong(seen, key, std::memory_order_relaxed))
+                return true;
+            if (seen == key)
+                return false;
+        }
+    }
+    table.full.store(true, std::memory_order_relaxed);
+    return false;
+}
+
+/*
+ * Function: perftVisit
+ *
+ * Counts `board` (already known to be a position the game can reach)
+ * and returns whether it should be expanded: it's not a finished game,
+ * and in dedup mode this thread is the first to reach it. `last` is
+ * the player who just moved (0 client, 1 server), -1 on an empty board.
+ */
+template <class G>
+inline bool perftVisit(PerftShared<G> &shared, PerftCounts &counts, const typename G::Board &board, int last) {
+    if (shared.table && !insertPosition(*shared.table, (uint64_t)G::key(board)))
+        return false;
+    counts.positions[board.moves]++;
+    if (last >= 0 && G::hasWin(board.pieces[last])) {
+        counts.wins[last][board.moves]++;
+        return false;
+    }
+    if (G::isFull(board)) {
+        counts.ties[board.moves]++;
+        return false;
+    }
+    return true;
+}
+
+// Depth-first count below an already visited position.
+template <class G>
+inline void perftRecurse(PerftShared<G> &shared, PerftCounts &counts, const typename G::Board &board, int depth) {
+    if (depth == 0)
+        return;
+    int player = board.moves & 1;
+    for (int col = 0; col < G::COLS; col++) {
+        typename G::Board child = board;
+        if (G::drop(child, col, player) == -1)
+            continue;
+        if (perftVisit(shared, counts, child, player))
+            perftRecurse(shared, counts, child, depth - 1);
+    }
+}
+
+template <class G>
+inline void pushTask(PerftShared<G> &shared, PerftWorker<G> &worker, const PerftTask<G> &task) {
+    shared.pending.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(worker.lock);
+    worker.tasks.push_back(task);
+}
+
+// Runs one task: splits it into child tasks or searches it in place.
+template <class G>
+inline void runTask(PerftShared<G> &shared, PerftWorker<G> &self, const PerftTask<G> &task) {
+    if (task.depth <= PERFT_SPLIT_DEPTH) {
+        perftRecurse(shared, self.counts, task.board, task.depth);
+        return;
+    }
+    int player = task.board.moves & 1;
+    for (int col = G::COLS - 1; col >= 0; col--) { // Pushed in reverse so column 0 pops first.
+        PerftTask<G> child = { task.board, task.depth - 1 };
+        if (G::drop(child.board, col, player) == -1)
+            continue;
+        if (perftVisit(shared, self.counts, child.board, player))
+            pushTask(shared, self, child);
+    }
+}
+
+// Own newest task, else the oldest one from the next worker that has any.
+template <class G>
+inline bool takeTask(PerftShared<G> &shared, size_t id, PerftTask<G> &task) {
+    {
+        PerftWorker<G> &self = shared.workers[id];
+        std::lock_guard<std::mutex> guard(self.lock);
+        if (!self.tasks.empty()) {
+            task = self.tasks.back();
+            self.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < shared.workers.size(); k++) {
+        PerftWorker<G> &victim = shared.workers[(id + k) % shared.workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class G>
+inline void perftWorker(PerftShared<G> &shared, size_t id) {
+    PerftTask<G> task;
+    while (shared.pending.load(std::memory_order_acquire) != 0) {
+        if (!takeTask(shared, id, task)) {
+            std::this_thread::yield();
+            continue;
+        }
+        runTask(shared, shared.workers[id], task);
+        shared.pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// Dedup keys are stored in a uint64_t table.
+template <class G>
+constexpr bool perftCanDedup() {
+    return sizeof(typename G::Mask) == sizeof(uint64_t);
+}
+
+/*
+ * Function: runPerft
+ *
+ * Counts the tree below `start` to `depth` plies (capped at the end of
+ * the board) on `threads` workers. hashMb > 0 turns on dedup with a
+ * table of about that many megabytes; ignored unless G's keys fit in
+ * 64 bits (perftCanDedup()).
+ */
+template <class G>
+inline PerftResult runPerft(const typename G::Board &start, int depth, int threads, size_t hashMb) {
+    if (depth > G::CELLS - start.moves)
+        depth = G::CELLS - start.moves;
+    std::unique_ptr<PerftTable> table; // Cleared before the clock starts.
+    if (hashMb > 0 && perftCanDedup<G>()) {
+        table.reset(new PerftTable());
+        initPerftTable(*table, hashMb);
+    }
+    PerftShared<G> shared;
+    shared.workers = std::vector<PerftWorker<G>>(threads);
+    shared.pending.store(0, std::memory_order_relaxed);
+    shared.table = table.get();
+    for (int t = 0; t < threads; t++)
+        shared.workers[t].counts = PerftCounts();
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    int last = start.moves == 0 ? -1 : (start.moves - 1) & 1;
+    if (perftVisit(shared, shared.workers[0].counts, start, last))
+        pushTask(shared, shared.workers[0], PerftTask<G>{ start, depth });
+
+    std::vector<std::thread> helpers;
+    for (int t = 1; t < threads; t++)
+        helpers.emplace_back(perftWorker<G>, std::ref(shared), (size_t)t);
+    perftWorker<G>(shared, 0);
+    for (size_t t = 0; t < helpers.size(); t++)
+        helpers[t].join();
+
+    PerftResult result;
+    result.counts = PerftCounts();
+    result.nodes = 0;
+    for (int t = 0; t < threads; t++) {
+        const PerftCounts &c = shared.workers[t].counts;
+        for (int p = 0; p <= PERFT_MAX_PLY; p++) {
+            result.counts.positions[p] += c.positions[p];
+            result.counts.wins[0][p] += c.wins[0][p];
+            result.counts.wins[1][p] += c.wins[1][p];
+            result.counts.ties[p] += c.ties[p];
+            result.nodes += c.positions[p];
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    result.tableFull = table && table->full.load();
+    return result;
+}
+
+#endif // PERFT_H
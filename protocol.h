@@ -0,0 +1,262 @@
+/*
+ *  protocol.h
+ *
+ *  -------------------------------------------------------------------
+ *  Optional compact binary protocol, shared by client and server.
+ *
+ *  The text protocol is still the default. A client that wants binary
+ *  frames sends "PROTOCOL BINARY" as a normal line while it's its turn
+ *  (typically straight after connecting). The server answers with the
+ *  text line "PROTOCOL BINARY OK" and from then on sends only binary
+ *  frames. An old server treats the line as a bad move and answers
+ *  INVALID_MOVE plus a text board, so the client knows to stay on text.
+ *
+ *  Server -> client frames (all integers little-endian):
+ *
+ *    Move frame, 8 bytes, one per turn instead of a ~100 byte BOARD:
+ *      [0]    FRAME_MOVE
+ *      [1]    column 0-6 of the move just played (NO_COLUMN if none)
+ *      [2]    player who played it: 0 = client, 1 = server
+ *      [3]    FrameStatus after the move
+ *      [4-7]  sequence number
+ *
+ *    Snapshot frame, 22 bytes, sent on switching to binary and on
+ *    "RESYNC":
+ *      [0]     FRAME_SNAPSHOT
+ *      [1-2]   reserved (0)
+ *      [3]     FrameStatus
+ *      [4-7]   sequence number
+ *      [8-14]  client's stones, low 7 bytes of Board::pieces[0]
+ *      [15-21] server's stones, low 7 bytes of Board::pieces[1]
+ *
+ *    Analysis frame, 22 bytes, the answer to "ANALYZE <ms>":
+ *      [0]     FRAME_ANALYSIS
+ *      [1]     search depth reached, 0 = server too busy, no scores
+ *      [2-3]   reserved (0)
+ *      [4-7]   sequence number
+ *      [8-21]  seven int16 column scores (see below), column 1 first
+ *
+ *  Column scores are from the point of view of the player asking:
+ *  ANALYSIS_WIN - n means playing there wins n plies from now (counting
+ *  that move), -(ANALYSIS_WIN - n) loses in n plies, ANALYSIS_FULL is a
+ *  full column, anything else is the engine's heuristic (higher is
+ *  better). On the text protocol the same reply is one line:
+ *      ANALYSIS <depth> <s1> ... <s7>     e.g. ANALYSIS 9 -2 4 W3 L2 0 - 1
+ *  with W<n>/L<n> for wins and losses and "-" for a full column, or
+ *  "ANALYSIS BUSY".
+ *
+ *  Player-vs-player games (run_server.x --pvp) use the same frames from
+ *  each player's own point of view: "client" is you and "server" is
+ *  your opponent, so your stones are always C / pieces[0], and
+ *  GAMEOVER SERVER_WIN means the opponent won. While the opponent is
+ *  thinking the status is TURN OPPONENT (STATUS_TURN_OPPONENT); a text
+ *  client that only acts on "TURN CLIENT" needs no changes. If the
+ *  opponent times out or hangs up, you get GAMEOVER CLIENT_WIN with no
+ *  move.
+ *
+ *  Spectators: the server logs an id for every game it starts. A new
+ *  connection whose first line is "WATCH <game-id>" (in place of its
+ *  first move, or while in the PvP lobby) gets "WATCHING <game-id>" and
+ *  then a text BOARD frame for the game as it stands and after every
+ *  change, from the first player's point of view, with "TURN CLIENT" /
+ *  "TURN SERVER" for the side to move and finally GAMEOVER CLIENT_WIN,
+ *  SERVER_WIN, TIE, TIMEOUT or ABANDONED. An unknown id gets
+ *  "NO_SUCH_GAME". A spectator that reads too slowly skips straight to
+ *  the latest board. Spectators' lines are ignored.
+ *
+ *  Sequence numbers count every binary frame on the connection, so a
+ *  client that sees a gap knows its board is stale and sends "RESYNC".
+ *  Client -> server messages stay as text lines ("MOVE 4"): they're
+ *  already 7 bytes and the server's line parser handles them for free.
+ *
+ *  Multiplexed connections: a client that plays many games at once (a
+ *  bot fleet, a front-end) can carry them all on one connection. It
+ *  sends "PROTOCOL MUX" before the first move of the game it was
+ *  offered, which is dropped; the server answers "PROTOCOL MUX OK"
+ *  and from then on sends only mux frames. An old server answers
+ *  INVALID_MOVE, as for PROTOCOL BINARY. Not on a --pvp server, whose
+ *  new connections wait in the lobby.
+ *
+ *  Every client line then starts with a channel, a number from 1 to
+ *  2^32 - 1 the client picks, naming one of its games:
+ *      <channel> OPEN       starts a game against the server
+ *      <channel> CLOSE      abandons it; the server answers CLOSED
+ *      <channel> <line>     any line of a normal connection, such as
+ *                           MOVE 4, ANALYZE 500 or PROTOCOL BINARY
+ *  Lines for different channels can be sent back to back without
+ *  waiting for answers. Each channel's replies are exactly what a
+ *  connection of its own would get (text BOARD frames, or binary
+ *  frames after PROTOCOL BINARY), cut into mux frames:
+ *      [0]    FRAME_MUX
+ *      [1]    reserved (0)
+ *      [2-3]  payload length, at most MUX_MAX_PAYLOAD
+ *      [4-7]  channel
+ *      [8-]   payload
+ *  A channel's bytes can be split across frames anywhere, even inside
+ *  a line, and frames for different channels interleave. A channel is
+ *  free again once its game is over (the GAMEOVER is its last frame)
+ *  or once CLOSED arrives. Problems with a line itself get a text line
+ *  on that channel: NO_SUCH_CHANNEL, CHANNEL_IN_USE (OPEN on a live
+ *  one) or TOO_MANY_CHANNELS (OPEN past 1024 open on the connection,
+ *  or while the server is full); a line without a channel gets
+ *  INVALID_MESSAGE on channel 0.
+ *
+ *  Resuming: in a game against the server on a connection of its own,
+ *  "TOKEN" (any time it's the client's turn) gets "TOKEN <16 hex
+ *  digits>", the same token every time it's asked. If that connection
+ *  drops mid-game, the game is kept for --resume-timeout seconds. A
+ *  new connection whose first line is "RESUME <token>" (in place of
+ *  the first move of the game it was offered, which is dropped) gets
+ *  "RESUMED <game-id>" and the board as it stands, with "TURN CLIENT",
+ *  or "TURN SERVER" if the server's move is still to come; binary
+ *  clients send PROTOCOL BINARY first and get a snapshot frame with
+ *  STATUS_TURN_CLIENT or STATUS_TURN_OPPONENT. The game then carries
+ *  on, same id, same token. A game whose old connection is still open
+ *  is taken from it, and that connection is closed. An unknown or
+ *  finished game gets "NO_SUCH_SESSION". A server restarted with
+ *  SIGUSR2 (upgrade.h) keeps tokens and connections alike.
+ *
+ *  Variants: on a server whose moves come from the console (no --ai,
+ *  --book or --pvp), a text client can play on another board from
+ *  variants.h by sending "VARIANT <name>" before the first move, e.g.
+ *  "VARIANT 9x7". It gets "VARIANT 9x7 OK" and the empty board; BOARD
+ *  frames then have that many rows of that many columns, and MOVE
+ *  takes 1 to the number of columns. On other servers the line is an
+ *  INVALID_MOVE, except "VARIANT 7x6", the usual game; after PROTOCOL
+ *  BINARY it always is. Such games have no binary frames or ANALYZE,
+ *  aren't archived, and play out on the old server through a restart
+ *  (a parked one can't be resumed after it).
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "bitboard.h"
+
+const uint8_t FRAME_MOVE = 1;
+const uint8_t FRAME_SNAPSHOT = 2;
+const uint8_t FRAME_ANALYSIS = 3;
+const uint8_t FRAME_MUX = 4;
+const uint8_t NO_COLUMN = 0xFF;
+
+const size_t MOVE_FRAME_SIZE = 8;
+const size_t SNAPSHOT_FRAME_SIZE = 22;
+const size_t ANALYSIS_FRAME_SIZE = 22;
+const size_t MUX_HEADER_SIZE = 8;
+const size_t MUX_MAX_PAYLOAD = 2048; // Leaves a receive buffer (CONN_BUFFER) room for a whole frame.
+
+const int ANALYSIS_WIN = 30000;
+const int16_t ANALYSIS_FULL = INT16_MIN;
+
+enum FrameStatus {
+    STATUS_TURN_CLIENT = 0,
+    STATUS_CLIENT_WIN,
+    STATUS_SERVER_WIN,
+    STATUS_TIE,
+    STATUS_INVALID_MOVE,
+    STATUS_TIMEOUT, // The client ran out of time and forfeits.
+    STATUS_TURN_OPPONENT, // Player-vs-player: the other player's turn.
+    STATUS_COUNT
+};
+
+// The text protocol's turn line for each status (INVALID_MOVE is sent
+// on its own line ahead of a TURN CLIENT board).
+const char *const STATUS_TEXT[STATUS_COUNT] = {
+    "TURN CLIENT",
+    "GAMEOVER CLIENT_WIN",
+    "GAMEOVER SERVER_WIN",
+    "GAMEOVER TIE",
+    "INVALID_MOVE",
+    "GAMEOVER TIMEOUT",
+    "TURN OPPONENT"
+};
+
+inline bool isGameOver(int status) {
+    return status == STATUS_CLIENT_WIN || status == STATUS_SERVER_WIN || status == STATUS_TIE
+        || status == STATUS_TIMEOUT;
+}
+
+inline void putLE(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out[i] = (uint8_t)(value >> (8 * i));
+}
+
+inline uint64_t getLE(const uint8_t *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+inline void encodeMoveFrame(uint8_t out[MOVE_FRAME_SIZE], int column, int player, int status, uint32_t seq) {
+    out[0] = FRAME_MOVE;
+    out[1] = column < 0 ? NO_COLUMN : (uint8_t)column;
+    out[2] = (uint8_t)player;
+    out[3] = (uint8_t)status;
+    putLE(out + 4, seq, 4);
+}
+
+inline void encodeSnapshotFrame(uint8_t out[SNAPSHOT_FRAME_SIZE], const Board &board, int status, uint32_t seq) {
+    out[0] = FRAME_SNAPSHOT;
+    out[1] = out[2] = 0;
+    out[3] = (uint8_t)status;
+    putLE(out + 4, seq, 4);
+    putLE(out + 8, board.pieces[0], 7);
+    putLE(out + 15, board.pieces[1], 7);
+}
+
+inline void encodeAnalysisFrame(uint8_t out[ANALYSIS_FRAME_SIZE], int depth, const int16_t scores[COLS], uint32_t seq) {
+    out[0] = FRAME_ANALYSIS;
+    out[1] = (uint8_t)depth;
+    out[2] = out[3] = 0;
+    putLE(out + 4, seq, 4);
+    for (int c = 0; c < COLS; c++)
+        putLE(out + 8 + 2 * c, (uint16_t)scores[c], 2);
+}
+
+inline void encodeMuxHeader(uint8_t out[MUX_HEADER_SIZE], uint32_t channel, size_t length) {
+    out[0] = FRAME_MUX;
+    out[1] = 0;
+    putLE(out + 2, length, 2);
+    putLE(out + 4, channel, 4);
+}
+
+inline int16_t analysisScore(const uint8_t in[ANALYSIS_FRAME_SIZE], int col) {
+    return (int16_t)getLE(in + 8 + 2 * col, 2);
+}
+
+// One column score in the text protocol's form: W<n>, L<n>, "-" or a number.
+inline void formatColumnScore(int16_t score, char *out, size_t size) {
+    if (score == ANALYSIS_FULL)
+        snprintf(out, size, "-");
+    else if (score > ANALYSIS_WIN - ROWS * COLS - 1)
+        snprintf(out, size, "W%d", ANALYSIS_WIN - score);
+    else if (score < -(ANALYSIS_WIN - ROWS * COLS - 1))
+        snprintf(out, size, "L%d", ANALYSIS_WIN + score);
+    else
+        snprintf(out, size, "%d", score);
+}
+
+/*
+ * Function: decodeSnapshot
+ *
+ * Rebuilds a full Board (heights and move count included) from a
+ * snapshot frame's two masks.
+ */
+inline void decodeSnapshot(const uint8_t in[SNAPSHOT_FRAME_SIZE], Board &board) {
+    initBoard(board);
+    board.pieces[0] = getLE(in + 8, 7);
+    board.pieces[1] = getLE(in + 15, 7);
+    uint64_t mask = board.pieces[0] | board.pieces[1];
+    for (int c = 0; c < COLS; c++) {
+        board.heights[c] = __builtin_popcountll(mask & columnMask(c));
+        board.moves += board.heights[c];
+    }
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,2213 @@
+/*
+ *  reactor.h
+ *
+ *  -------------------------------------------------------------------
+ *  Non-blocking, edge-triggered epoll event loop. Replaces the old
+ *  accept -> play one game -> close loop in main(), so one server
+ *  process can host thousands of games at once without a thread per
+ *  connection.
+ *
+ *  Every accepted socket becomes a Session (see session.h). The
+ *  reactor only moves bytes: it reads whatever the socket has into the
+ *  session's Connection (see connection.h), hands complete lines to the
+ *  session, and flushes queued output whenever the socket can take more.
+ *
+ *  The server's own moves come from the built-in engine when --ai is
+ *  given, searched on the analysis pool's move threads (analysis.h)
+ *  so the loop never waits on one. Otherwise they still come from the
+ *  console: stdin is watched by the same epoll set, and games that are
+ *  waiting on the server queue up in arrival order; each line typed at
+ *  the console is the move for the game at the front of that queue.
+ *
+ *  With --pvp there is no server side at all: new connections wait in
+ *  the lobby (lobby.h) until another player arrives, and the two are
+ *  moved onto one reactor and play each other. A checked move is
+ *  replayed on the opponent's session, whose held input is then read
+ *  from the `ready` list once the current event is done, never from
+ *  inside another session's handler. Hanging up or timing out mid-game
+ *  hands the opponent the win.
+ *
+ *  Every session also has one deadline on the reactor's timer wheel
+ *  (timer.h), re-armed as it changes state: --handshake-timeout until
+ *  the client's first line, --move-timeout for each of its turns
+ *  (INVALID_MOVE doesn't reset it), none during the server's or the
+ *  opponent's turn or in the lobby, and
+ *  --idle-timeout for a finished game whose final frame won't drain.
+ *  epoll_wait() sleeps at most until the wheel's next tick.
+ *
+ *  Each reactor records into its own Metrics block (metrics.h): accepts,
+ *  closes, moves, INVALID_MOVEs, timeouts, bytes in and out, the time
+ *  from a client line arriving to the reply being written, and AI
+ *  search time.
+ *
+ *  "ANALYZE <ms>" requests are answered from the analysis cache or
+ *  handed to the analysis pool (analysis.h); the pool posts results to
+ *  the reactor's inbox, whose eventfd is in the epoll set. A session
+ *  with an analysis outstanding holds its later lines until the answer
+ *  has been sent, so replies stay in request order.
+ *
+ *  With --archive, closeSession() passes every game's record on to the
+ *  archiver thread (archive.h) before freeing the session.
+ *
+ *  Every game gets an id when it starts (logged, see makeGameId() in
+ *  lobby.h), and "WATCH <id>" as a connection's first line makes it a
+ *  spectator: it's handed to the reactor the game lives on and added
+ *  to the game's `watchers`. Whenever a game with spectators is
+ *  flushed after a change, fanOut() renders one frame and queues that
+ *  one shared buffer on every spectator, so a move costs one render
+ *  however many are watching. A spectator that has fallen
+ *  SPECTATOR_BACKLOG chunks behind has its backlog dropped in favour
+ *  of the newest frame: a frame is a whole board, so nothing is lost
+ *  but the positions in between.
+ *
+ *  With --reactors, runReactors() starts one of these loops per thread
+ *  (pinned one per CPU), each on its own SO_REUSEPORT listener for the
+ *  same port. The kernel hashes every new connection to one listener,
+ *  so a game lives its whole life on one thread, with its own sessions
+ *  and epoll set. The one thing the threads do share is the lock-free
+ *  position cache (sharedTable() in search.h), so every game's searches
+ *  reuse what the others already worked out.
+ *
+ *  "PROTOCOL MUX" turns a connection into a link carrying many games
+ *  (see protocol.h). Each channel's game is a Session of its own with
+ *  no socket (`link` set): processMux() feeds it the link's lines with
+ *  feedLine(), and flushSession() forwards its output as mux frames
+ *  onto the link's `muxOut`, which goes out as one chunk when the
+ *  link's read is done, so a burst of moves across channels costs one
+ *  write. A game only holds up the others if its own input is full;
+ *  past MUX_OUTPUT_LIMIT of unsent output the link stops reading
+ *  (`stalled`) until a flush drains it. Any other connection stalls
+ *  the same way once its own queue is outputBacklogged(). A link holds
+ *  at most MUX_MAX_CHANNELS games, and all links together
+ *  MUX_MAX_GAMES.
+ *
+ *  --io uring swaps the epoll set for an io_uring (uring.h) per
+ *  reactor; everything above the socket calls is the same. The
+ *  listener gets one multishot accept, every socket one multishot recv
+ *  into a shared provided-buffer ring, the inbox and console one
+ *  multishot poll, and output goes out as one send per session at a
+ *  time. runUring() submits and waits in a single io_uring_enter() per
+ *  pass, so a busy loop costs one syscall however many sockets it
+ *  served. Received bytes are copied out of the kernel's buffer into
+ *  the Connection (takeReceived()), so the protocol code never sees
+ *  the difference. A closed or handed-off session cancels its requests,
+ *  and its completions are matched against a per-session tag, since
+ *  the fd may be reused before they arrive.
+ *
+ *  A client that took a resume token ("TOKEN", see protocol.h) and
+ *  loses its connection mid-game doesn't lose the game: dropConnection()
+ *  parks it, socketless, on its own timer (--resume-timeout), and
+ *  "RESUME <token>" from a new connection - handed to the token's
+ *  reactor first, like a spectator - moves that socket into the game
+ *  (resumeGame()). On SIGUSR2 with --checkpoint, each loop pass also
+ *  runs checkUpgrade(), which hands what it can to a restarted server
+ *  and drains the rest (upgrade.h); the new server's reactors pick the
+ *  games up with restoreSessions() before their first pass.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "analysis.h"
+#include "archive.h"
+#include "book.h"
+#include "lobby.h"
+#include "metrics.h"
+#include "options.h"
+#include "search.h"
+#include "session.h"
+#include "timer.h"
+#include "upgrade.h"
+#include "uring.h"
+
+const int MAX_EVENTS = 256; // epoll_wait() batch size.
+const size_t SPECTATOR_BACKLOG = 4; // Unsent chunks before a spectator skips ahead.
+const size_t MUX_MAX_CHANNELS = 1024;      // Games open at once on one multiplexed connection...
+const size_t MUX_MAX_GAMES = 16384;        // ...and on all of them, server-wide: each is a ~5 KB Session.
+const size_t MUX_OUTPUT_LIMIT = 64 * 1024; // Framed output a multiplexed connection holds before it stops reading.
+const size_t SPILL_LIMIT = 4 * CONN_BUFFER; // --io uring: received bytes held before a recv is paused.
+const uint32_t URING_TAG_MASK = 0xFFFFFF;   // UringIo::tag bits that fit in user_data.
+
+// What an io_uring completion is for; the top byte of its user_data.
+enum UringOp {
+    URING_ACCEPT,
+    URING_RECV,
+    URING_SEND,
+    URING_POLL,  // An eventfd or the console became readable.
+    URING_CANCEL
+};
+
+// user_data = op << 56 | tag << 32 | fd.
+inline uint64_t uringData(UringOp op, int fd, uint32_t tag) {
+    return (uint64_t)op << 56 | (uint64_t)(tag & URING_TAG_MASK) << 32 | (uint32_t)fd;
+}
+
+// A session handed off under --io uring, waiting for its requests on our ring to finish.
+struct Departure {
+    Session *session;
+    HandoffInbox *inbox; // nullptr: leaving for a restarted server, see beginUpgrade().
+};
+
+struct Reactor {
+    int id;                           // 0-based, one per --reactors thread.
+    int epfd;
+    int listenfd;
+    const ServerOptions *opts;
+    OpeningBook book;                 // Empty unless --book was given.
+    std::vector<Session*> sessions;   // Indexed by fd, nullptr when unused.
+    std::deque<Session*> serverQueue; // Games waiting on a console move, oldest first.
+    std::string console;              // Partial line typed at the console.
+    TimerWheel timers;                // Every session's current deadline.
+    Metrics *metrics;                 // This thread's counters, see metrics.h.
+    AnalysisInbox inbox;              // Finished ANALYZE searches, see analysis.h.
+    uint64_t nextAnalysisId;
+    std::vector<AnalysisDone> analyses; // Scratch for draining `inbox`.
+    HandoffInbox handoffs;            // Sessions other reactors hand us: PvP players, spectators.
+    std::vector<int> ready;           // Fds whose held input can go now, see runReady().
+    std::vector<int> readyNow;        // Scratch for draining `ready`.
+    std::vector<char> muxPayload;     // Scratch for forwardOutput().
+    uint64_t nextGameSerial;          // For makeGameId().
+    std::unordered_map<uint64_t, Session*> games; // Our games by id, for WATCH.
+    std::unordered_map<uint64_t, Session*> resumable; // Our games by resume token, parked or not.
+    UpgradeStep upgrade;              // Where we are in a SIGUSR2 restart (upgrade.h)...
+    uint64_t upgradeRound;            // ...the one we posted to...
+    std::vector<Session*> leaving;    // ...and the sessions going to the new server.
+    bool accepting;                   // false once a restart leaves new connections to the new server.
+    IoBackend io;                     // IO_URING: the fields below stand in for epfd.
+    Uring ring;
+    BufferRing buffers;
+    uint32_t nextTag;                 // For UringIo::tag.
+    bool acceptArmed;                 // The multishot accept is outstanding...
+    uint64_t acceptRetryNs;           // ...or will be re-armed at this time, after an error.
+    bool consoleClosed;
+    std::unordered_map<int, Departure> departing; // By fd.
+    std::unordered_map<uint64_t, std::vector<char>> orphanSends; // By user_data: closed sessions' sends still in flight.
+};
+
+inline bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1)
+        return false;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Output queued or, under --io uring, still in flight.
+inline bool outputPending(const Session &s) {
+    return hasPendingOutput(s.conn) || s.io.sending;
+}
+
+inline bool armRecv(Reactor &r, Session *s) {
+    if (!prepMultishotRecv(r.ring, s->conn.fd, URING_BUFFER_GROUP, uringData(URING_RECV, s->conn.fd, s->io.tag)))
+        return false;
+    s->io.recvArmed = true;
+    return true;
+}
+
+/*
+ * Function: submitSend
+ *
+ * --io uring's flushOutput(): copies everything queued into the
+ * session's send buffer and queues one send for it, to go out with
+ * the loop's next io_uring_enter(). Only one send is in flight per
+ * session; whatever is queued meanwhile goes when it completes.
+ * Returns false if the ring had no room.
+ */
+inline bool submitSend(Reactor &r, Session *s) {
+    UringIo &io = s->io;
+    if (io.sending || !hasPendingOutput(s->conn))
+        return true;
+    io.sendBuf.clear();
+    takeOutput(s->conn, io.sendBuf);
+    io.sendOffset = 0;
+    if (!prepSend(r.ring, s->conn.fd, io.sendBuf.data(), io.sendBuf.size(),
+                  uringData(URING_SEND, s->conn.fd, io.tag)))
+        return false;
+    io.sending = true;
+    return true;
+}
+
+/*
+ * Function: takeReceived
+ *
+ * --io uring's fillInput(): moves bytes the ring has already received
+ * into the Connection, re-arming a paused recv once they run out.
+ * Same results as recv(): bytes taken, 0 at end of stream, -1 with
+ * errno (EAGAIN when there's nothing more yet).
+ */
+inline ssize_t takeReceived(Reactor &r, Session *s) {
+    UringIo &io = s->io;
+    if (!io.spill.empty()) {
+        size_t n = fillInputFrom(s->conn, io.spill.data(), io.spill.size());
+        io.spill.erase(0, n);
+        return n;
+    }
+    if (io.peerClosed) {
+        if (io.recvError == 0)
+            return 0;
+        errno = io.recvError;
+        return -1;
+    }
+    if (io.recvPaused && !io.recvArmed) {
+        io.recvPaused = false;
+        armRecv(r, s);
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+// One read's worth of input: a recv() under epoll, what the ring received under --io uring.
+inline ssize_t pullInput(Reactor &r, Session *s) {
+    if (r.io == IO_URING)
+        return takeReceived(r, s);
+    ssize_t n = fillInput(s->conn);
+    count(*r.metrics, COUNT_IO_SYSCALLS);
+    if (n > 0)
+        count(*r.metrics, COUNT_BYTES_IN, n);
+    return n;
+}
+
+/*
+ * Function: releaseUring
+ *
+ * Cancels a closing session's requests on the ring. They hold their
+ * own reference to the socket, so it only really closes once they
+ * have completed; a send's buffer is kept in `orphanSends` until then.
+ */
+inline void releaseUring(Reactor &r, Session *s) {
+    UringIo &io = s->io;
+    int fd = s->conn.fd;
+    if (io.recvArmed)
+        prepCancel(r.ring, uringData(URING_RECV, fd, io.tag), uringData(URING_CANCEL, fd, io.tag));
+    if (io.sending) {
+        prepCancel(r.ring, uringData(URING_SEND, fd, io.tag), uringData(URING_CANCEL, fd, io.tag));
+        r.orphanSends[uringData(URING_SEND, fd, io.tag)].swap(io.sendBuf);
+    }
+}
+
+// Closes a session's socket and takes it out of the epoll set (or off the ring) and the table.
+inline void releaseSocket(Reactor &r, Session *s) {
+    if (r.io == IO_URING) {
+        releaseUring(r, s);
+    } else {
+        epoll_ctl(r.epfd, EPOLL_CTL_DEL, s->conn.fd, nullptr);
+        count(*r.metrics, COUNT_IO_SYSCALLS);
+    }
+    close(s->conn.fd); // Close the socket for the CLIENT, NOT the actual listening socket.
+    count(*r.metrics, COUNT_IO_SYSCALLS);
+    r.sessions[s->conn.fd] = nullptr;
+}
+
+// Shows the board for the game at the front of the queue and asks for a move.
+inline void promptConsole(Reactor &r) {
+    if (r.serverQueue.empty())
+        return;
+    Session *s = r.serverQueue.front();
+    if (s->variant) {
+        uint128 stones[2];
+        s->variant->stones(s->variantBoard, stones);
+        logMessage(LOG_CONSOLE, "Game with [{}] on {}", LogIp{s->addr.sin_addr, ntohs(s->addr.sin_port)},
+                   s->variant->name);
+        logMessage(LOG_CONSOLE, "{}", LogGrid{s->variant->rows, s->variant->cols, {stones[0], stones[1]}});
+        logRecord(LOG_CONSOLE, LOG_NO_NEWLINE, "Your move (1-{}): ", s->variant->cols);
+        return;
+    }
+    logMessage(LOG_CONSOLE, "Game with [{}]", LogIp{s->addr.sin_addr, ntohs(s->addr.sin_port)});
+    logMessage(LOG_CONSOLE, "{}", LogBoard{{s->board.pieces[0], s->board.pieces[1]}});
+    logPrompt("Your move (1-7): ");
+}
+
+// Queues a readSession() for after the current event, see runReady().
+inline void deferRead(Reactor &r, Session *s) {
+    r.ready.push_back(s->conn.fd);
+}
+
+// Has multiplexed connection `l` flush what its games framed onto it,
+// unless it's in the middle of its own lines and will anyway.
+inline void wakeLink(Reactor &r, Session *l) {
+    if (l->muxReading || l->muxWoken)
+        return;
+    l->muxWoken = true;
+    deferRead(r, l);
+}
+
+// A multiplexed connection reads no more lines while its socket lags this far behind.
+inline bool muxBacklogged(const Session &l) {
+    return l.muxOut.size() >= MUX_OUTPUT_LIMIT || hasPendingOutput(l.conn);
+}
+
+// A session takes no more lines while its socket lags this far behind.
+inline bool backlogged(const Session &s) {
+    return s.state == MULTIPLEXED ? muxBacklogged(s) : outputBacklogged(s.conn);
+}
+
+// Multiplexed games open on every reactor, held under MUX_MAX_GAMES.
+inline std::atomic<size_t> &muxGames() {
+    static std::atomic<size_t> games(0);
+    return games;
+}
+
+// Counts one more multiplexed game in, unless the server already has MUX_MAX_GAMES.
+inline bool reserveMuxGame() {
+    if (muxGames().fetch_add(1, std::memory_order_relaxed) < MUX_MAX_GAMES)
+        return true;
+    muxGames().fetch_sub(1, std::memory_order_relaxed);
+    return false;
+}
+
+// Frames `length` bytes of a channel's output onto link `l`'s muxOut.
+inline void appendMuxFrames(Session *l, uint32_t channel, const char *data, size_t length) {
+    do {
+        size_t n = std::min(length, MUX_MAX_PAYLOAD);
+        uint8_t header[MUX_HEADER_SIZE];
+        encodeMuxHeader(header, channel, n);
+        l->muxOut.insert(l->muxOut.end(), header, header + MUX_HEADER_SIZE);
+        l->muxOut.insert(l->muxOut.end(), data, data + n);
+        data += n;
+        length -= n;
+    } while (length > 0);
+}
+
+// One of the link's own text lines on `channel`: CLOSED, NO_SUCH_CHANNEL and so on.
+inline void muxNotice(Session *l, uint32_t channel, const char *text) {
+    char line[32];
+    int length = snprintf(line, sizeof(line), "%s\n", text);
+    appendMuxFrames(l, channel, line, length);
+}
+
+/*
+ * Function: forwardOutput
+ *
+ * A multiplexed game's flushOutput(): takes everything it has queued
+ * and frames it onto its link, to go out with the rest of the link's
+ * frames the next time the link is flushed.
+ */
+inline void forwardOutput(Reactor &r, Session *g) {
+    if (!hasPendingOutput(g->conn))
+        return;
+    r.muxPayload.clear();
+    takeOutput(g->conn, r.muxPayload);
+    appendMuxFrames(g->link, g->channel, r.muxPayload.data(), r.muxPayload.size());
+    wakeLink(r, g->link);
+}
+
+// Takes a waiting player's ticket back out of the lobby.
+inline void quitLobby(Session *s) {
+    if (!s->ticket)
+        return;
+    if (leaveLobby(s->ticket))
+        delete s->ticket;
+    else
+        s->ticket->session = nullptr; // Claimed: the handoff on its way frees it.
+    s->ticket = nullptr;
+}
+
+inline void fanOut(Reactor &r, Session *g, bool over);
+inline void dropConnection(Reactor &r, Session *s);
+
+inline void closeSession(Reactor &r, Session *s) {
+    if (s->state == LOBBY)
+        quitLobby(s);
+    if (s->state == MULTIPLEXED) {
+        std::vector<Session*> games;
+        games.reserve(s->channels.size());
+        for (std::unordered_map<uint32_t, Session*>::iterator it = s->channels.begin(); it != s->channels.end(); ++it)
+            games.push_back(it->second);
+        for (size_t i = 0; i < games.size(); i++)
+            closeSession(r, games[i]);
+    }
+    if (s->watching) {
+        std::vector<Session*> &watchers = s->watching->watchers;
+        watchers[s->watchIndex] = watchers.back();
+        watchers[s->watchIndex]->watchIndex = s->watchIndex;
+        watchers.pop_back();
+    }
+    if (!s->watchers.empty()) {
+        s->watchStale = true; // Ends here, however it stood: GAMEOVER ABANDONED unless over.
+        fanOut(r, s, true);
+    }
+    if (s->opponent) {
+        Session *o = s->opponent;
+        o->opponent = nullptr;
+        if (o->state != GAME_OVER) {
+            winByForfeit(*o, RESULT_ABANDONED);
+            deferRead(r, o);
+        }
+    }
+    std::deque<Session*>::iterator it = std::find(r.serverQueue.begin(), r.serverQueue.end(), s);
+    bool wasFront = it == r.serverQueue.begin();
+    if (it != r.serverQueue.end())
+        r.serverQueue.erase(it);
+
+    cancelTimer(r.timers, s->timer);
+    if (!s->link && !isParked(*s))
+        count(*r.metrics, COUNT_CLOSED); // A parked game's connection was counted when it went.
+    if (s->token != 0)
+        r.resumable.erase(s->token);
+    if (s->gameId != 0) { // Only a game's seat 0 session: a PvP game is counted once.
+        if (s->state == GAME_OVER)
+            count(*r.metrics, COUNT_GAMES);
+        s->record.durationMs = (uint32_t)((monotonicNs() - s->acceptedNs) / 1000000);
+        if (!s->variant)
+            archiveGame(s->record);
+        r.games.erase(s->gameId);
+    }
+    if (s->link) {
+        s->link->channels.erase(s->channel); // No socket of its own.
+        muxGames().fetch_sub(1, std::memory_order_relaxed);
+    } else if (!isParked(*s))
+        releaseSocket(r, s);
+    delete s;
+    logMessage(LOG_INFO, "Game ended. Waiting for next client...\n----------------------------------------------------------------");
+
+    if (wasFront)
+        promptConsole(r);
+}
+
+/*
+ * Function: flushSession
+ *
+ * Sends as much queued output as the socket will take. A short write
+ * leaves the rest queued; edge-triggered EPOLLOUT tells us when to
+ * try again. Under --io uring the output is queued as a send instead,
+ * and this is called again when it completes. A multiplexed game's
+ * output goes onto its link, and a link queues what its games have
+ * framed since the last flush as one chunk, and a parked game's output
+ * has nowhere to go. Returns false if the session was closed or
+ * parked.
+ */
+inline bool flushSession(Reactor &r, Session *s) {
+    if (s->state == MULTIPLEXED && !s->muxOut.empty()) {
+        queueCopy(s->conn, s->muxOut.data(), s->muxOut.size());
+        s->muxOut.clear();
+    }
+    if (isParked(*s)) {
+        clearOutput(s->conn); // The board is resent whole on RESUME.
+    } else if (s->link) {
+        forwardOutput(r, s);
+    } else if (r.io == IO_URING) {
+        if (!submitSend(r, s)) {
+            logMessage(LOG_ERROR, "[ERROR] io_uring send: {}", LogErrno{errno});
+            closeSession(r, s);
+            return false;
+        }
+    } else {
+        uint64_t sentBefore = s->conn.bytesSent;
+        uint64_t callsBefore = s->conn.syscalls;
+        bool ok = flushOutput(s->conn);
+        count(*r.metrics, COUNT_BYTES_OUT, s->conn.bytesSent - sentBefore);
+        count(*r.metrics, COUNT_IO_SYSCALLS, s->conn.syscalls - callsBefore);
+        if (!ok) {
+            logMessage(LOG_ERROR, "[ERROR] writev(): {}", LogErrno{errno});
+            dropConnection(r, s);
+            return false;
+        }
+    }
+    if (s->replyStart != 0 && s->state != AWAIT_SERVER_MOVE && !outputPending(*s)) {
+        record(*r.metrics, HIST_MOVE_REPLY, monotonicNs() - s->replyStart);
+        s->replyStart = 0;
+    }
+    if (s->watchStale && !s->watchers.empty())
+        fanOut(r, s, s->state == GAME_OVER);
+    if (s->state == GAME_OVER && !outputPending(*s)) {
+        closeSession(r, s);
+        return false;
+    }
+    if (s->stalled && !backlogged(*s)) {
+        s->stalled = false;
+        if (s->state == MULTIPLEXED)
+            wakeLink(r, s); // Back to the lines it left.
+        else
+            deferRead(r, s);
+    }
+    return true;
+}
+
+/*
+ * Function: scheduleTimeout
+ *
+ * Arms the deadline that fits the session's current state (a parked
+ * game's is --resume-timeout), unless the right one is already running. A move deadline belongs to one turn,
+ * so it's only re-armed once the board has changed.
+ */
+inline void scheduleTimeout(Reactor &r, Session *s) {
+    TimerKind kind = TIMER_NONE;
+    int seconds = 0;
+    if (isParked(*s)) {
+        kind = TIMER_RESUME;
+        seconds = r.opts->resumeTimeout;
+    } else if (s->state == AWAIT_MOVE && !s->heard) {
+        kind = TIMER_HANDSHAKE;
+        seconds = r.opts->handshakeTimeout;
+    } else if (s->state == AWAIT_MOVE) {
+        kind = TIMER_MOVE;
+        seconds = r.opts->moveTimeout;
+    } else if (s->state == GAME_OVER) {
+        kind = TIMER_IDLE;
+        seconds = r.opts->idleTimeout;
+    }
+    if (seconds == 0)
+        kind = TIMER_NONE;
+    if (kind == s->timerKind && (kind != TIMER_MOVE || s->timerMoves == movesPlayed(*s)))
+        return;
+    s->timerKind = kind;
+    s->timerMoves = movesPlayed(*s);
+    if (kind == TIMER_NONE)
+        cancelTimer(r.timers, s->timer);
+    else
+        armTimer(r.timers, s->timer, seconds * 1000ULL);
+}
+
+/*
+ * Function: parkSession
+ *
+ * Keeps a game whose connection has gone, for "RESUME <token>": the
+ * socket is closed and whatever was queued for it dropped, and the
+ * game waits, as it stands, for --resume-timeout seconds.
+ */
+inline void parkSession(Reactor &r, Session *s) {
+    releaseSocket(r, s);
+    count(*r.metrics, COUNT_CLOSED);
+    count(*r.metrics, COUNT_PARKED);
+    clearOutput(s->conn);
+    initConnection(s->conn, -1);
+    s->io = UringIo();
+    s->analyzing = false; // Its answer would have nowhere to go.
+    s->replyStart = 0;
+    scheduleTimeout(r, s);
+    logMessage(LOG_INFO, "Game {} parked for {} s, waiting for RESUME.", s->gameId, r.opts->resumeTimeout);
+}
+
+// The client's connection is gone: a game it holds a token for is
+// parked, anything else closed. (A draining server's games can't be
+// resumed: new connections go to its successor.)
+inline void dropConnection(Reactor &r, Session *s) {
+    if (s->token != 0 && r.opts->resumeTimeout > 0 && r.upgrade != UPGRADE_DRAINING
+        && (s->state == AWAIT_MOVE || s->state == AWAIT_SERVER_MOVE))
+        parkSession(r, s);
+    else
+        closeSession(r, s);
+}
+
+// Game `g`'s spectator frame, rendered afresh if the game has changed.
+inline const SharedFrame &currentWatchFrame(Reactor &r, Session *g, bool over) {
+    if (g->watchStale || !g->watchFrame) {
+        g->watchFrame = renderWatchFrame(*g, over);
+        g->watchStale = false;
+        count(*r.metrics, COUNT_WATCH_RENDERS);
+    }
+    return g->watchFrame;
+}
+
+/*
+ * Function: fanOut
+ *
+ * Queues game `g`'s latest frame, rendered once, on every spectator
+ * and flushes them. A spectator with SPECTATOR_BACKLOG chunks still
+ * unsent skips them for this one. If the game is `over`, this is the
+ * last frame and the spectators are done too.
+ */
+inline void fanOut(Reactor &r, Session *g, bool over) {
+    SharedFrame frame = currentWatchFrame(r, g, over);
+    std::vector<Session*> ended;
+    if (over)
+        ended.swap(g->watchers);
+    std::vector<Session*> &watchers = over ? ended : g->watchers;
+    // Backwards: a spectator that fails to flush is closed, and its
+    // slot gets the last one, which has already had the frame.
+    for (size_t i = watchers.size(); i-- > 0;) {
+        Session *w = watchers[i];
+        if (w->conn.outCount >= SPECTATOR_BACKLOG)
+            count(*r.metrics, COUNT_FRAMES_SKIPPED, dropQueued(w->conn));
+        queueShared(w->conn, frame);
+        if (over) {
+            w->watching = nullptr;
+            w->state = GAME_OVER;
+            scheduleTimeout(r, w);
+        }
+        flushSession(r, w);
+    }
+}
+
+// Gives a game, on its seat 0 session, the id spectators WATCH it by.
+inline void registerGame(Reactor &r, Session *s) {
+    s->gameId = makeGameId(++r.nextGameSerial, r.id);
+    r.games[s->gameId] = s;
+    logMessage(LOG_INFO, "Game {} started.", s->gameId);
+}
+
+/*
+ * Function: attachSpectator
+ *
+ * Adds spectator `s` to game s->watchId, which lives on this reactor
+ * if it exists at all: "WATCHING <id>" and the current frame, then
+ * every frame after. An unknown or finished-and-gone game gets
+ * NO_SUCH_GAME; a finished one still draining just its final frame.
+ */
+inline void attachSpectator(Reactor &r, Session *s) {
+    std::unordered_map<uint64_t, Session*>::iterator it = r.games.find(s->watchId);
+    if (it == r.games.end()) {
+        queueLine(*s, "NO_SUCH_GAME");
+        s->state = GAME_OVER;
+        return;
+    }
+    Session *g = it->second;
+    if (g->watchStale && !g->watchers.empty())
+        fanOut(r, g, g->state == GAME_OVER); // The others first, before the frame is replaced.
+    char line[32];
+    int length = snprintf(line, sizeof(line), "WATCHING %llu\n", (unsigned long long)s->watchId);
+    queueCopy(s->conn, line, length);
+    queueShared(s->conn, currentWatchFrame(r, g, g->state == GAME_OVER));
+    count(*r.metrics, COUNT_SPECTATORS);
+    if (g->state == GAME_OVER) {
+        s->state = GAME_OVER;
+        return;
+    }
+    s->watching = g;
+    s->watchIndex = g->watchers.size();
+    g->watchers.push_back(s);
+}
+
+// Takes `s` out of this reactor so another one can adopt it.
+inline void detachSession(Reactor &r, Session *s) {
+    cancelTimer(r.timers, s->timer);
+    s->timerKind = TIMER_NONE;
+    if (r.io == IO_EPOLL) {
+        epoll_ctl(r.epfd, EPOLL_CTL_DEL, s->conn.fd, nullptr);
+        count(*r.metrics, COUNT_IO_SYSCALLS);
+    }
+    r.sessions[s->conn.fd] = nullptr;
+    count(*r.metrics, COUNT_HANDOFFS);
+}
+
+/*
+ * Function: handOff
+ *
+ * Detaches `s` and posts it to another reactor's inbox. Under --io
+ * uring its recv is cancelled first, and it waits in `departing` until
+ * that and any send in flight have completed here, so nothing for it
+ * completes on this ring once the new reactor has it; bytes that
+ * arrive meanwhile go with it in its spill.
+ */
+inline void handOff(Reactor &r, Session *s, HandoffInbox &inbox) {
+    detachSession(r, s);
+    UringIo &io = s->io;
+    if (r.io == IO_URING && (io.recvArmed || io.sending)) {
+        int fd = s->conn.fd;
+        if (io.recvArmed)
+            prepCancel(r.ring, uringData(URING_RECV, fd, io.tag), uringData(URING_CANCEL, fd, io.tag));
+        r.departing[fd] = Departure{ s, &inbox };
+        return;
+    }
+    postHandoff(inbox, s);
+}
+
+/*
+ * Function: startWatching
+ *
+ * Turns `s` into a spectator of game s->watchId (the game it was
+ * offered, if any, never started). Attaches it here if the id is one
+ * of ours, else hands it to the game's reactor. Returns false if `s`
+ * has left this reactor and mustn't be touched.
+ */
+inline bool startWatching(Reactor &r, Session *s) {
+    if (s->state == LOBBY)
+        quitLobby(s);
+    if (s->gameId != 0) {
+        r.games.erase(s->gameId);
+        s->gameId = 0;
+    }
+    s->state = SPECTATING;
+    s->replyStart = 0;
+    int home = gameReactor(s->watchId);
+    HandoffInbox *inbox = reactorInbox(home);
+    if (home == r.id || inbox == nullptr) {
+        attachSpectator(r, s);
+        return true;
+    }
+    handOff(r, s, *inbox);
+    return false;
+}
+
+// "TOKEN": the game's resume token, made the first time it's asked for.
+inline void issueToken(Reactor &r, Session *s) {
+    if (s->token == 0) {
+        s->token = makeResumeToken(r.id);
+        r.resumable[s->token] = s;
+    }
+    char line[32];
+    int length = snprintf(line, sizeof(line), "TOKEN %016llx\n", (unsigned long long)s->token);
+    queueCopy(s->conn, line, length);
+}
+
+// "VARIANT <name>": only where the console plays the server's side
+// and the client is on text. The binary frames, the engine, the book
+// and the lobby all assume Classic's board.
+inline void chooseVariant(Reactor &r, Session *s) {
+    bool classic = s->askedVariant == &VARIANTS[0];
+    if (s->binary || (!classic && (r.opts->aiMs > 0 || r.opts->bookPath != nullptr || r.opts->pvp))) {
+        sendUpdate(*s, -1, 0, STATUS_INVALID_MOVE);
+        count(*r.metrics, COUNT_INVALID_MOVES);
+        return;
+    }
+    startVariant(*s, *s->askedVariant);
+}
+
+/*
+ * Function: resumeGame
+ *
+ * Moves connection `s` into the game s->resumeToken names, which lives
+ * on this reactor if it exists at all: the socket, and anything sent
+ * or received on it that hasn't been dealt with yet, go over to the
+ * game's session, and `s` is freed. A game still on another connection
+ * is taken from it, and that connection closed. An unknown or finished
+ * game gets NO_SUCH_SESSION. Returns false once `s` is gone.
+ */
+inline bool resumeGame(Reactor &r, Session *s) {
+    std::unordered_map<uint64_t, Session*>::iterator it = r.resumable.find(s->resumeToken);
+    if (it == r.resumable.end() || it->second->state == GAME_OVER) {
+        queueLine(*s, "NO_SUCH_SESSION");
+        s->state = GAME_OVER;
+        return true;
+    }
+    Session *g = it->second;
+    if (!isParked(*g)) {
+        logMessage(LOG_INFO, "Game {} taken over from [{}].", g->gameId, LogIp{g->addr.sin_addr, ntohs(g->addr.sin_port)});
+        releaseSocket(r, g);
+        count(*r.metrics, COUNT_CLOSED);
+        clearOutput(g->conn);
+    }
+    int fd = s->conn.fd;
+    initConnection(g->conn, fd);
+    moveOutput(s->conn, g->conn);
+    fillInputFrom(g->conn, s->conn.in + s->conn.inHead, s->conn.inTail - s->conn.inHead);
+    g->io = std::move(s->io);
+    g->addr = s->addr;
+    g->binary = s->binary;
+    g->seq = s->seq;
+    g->heard = true;
+    g->analyzing = false;
+    g->replyStart = 0;
+    r.sessions[fd] = g;
+    cancelTimer(r.timers, s->timer);
+    delete s;
+    count(*r.metrics, COUNT_RESUMED);
+    logMessage(LOG_INFO, "Game {} resumed by [{}].", g->gameId, LogIp{g->addr.sin_addr, ntohs(g->addr.sin_port)});
+    sendResumed(*g);
+    deferRead(r, g); // Sends it, and reads what came in behind the RESUME.
+    return false;
+}
+
+/*
+ * Function: startResume
+ *
+ * Handles "RESUME <token>" (the game `s` was offered never started):
+ * resumes the game here if the token is one of ours, else hands `s`
+ * to the token's reactor to do it there. Returns false if `s` has left
+ * this reactor or been freed and mustn't be touched.
+ */
+inline bool startResume(Reactor &r, Session *s) {
+    r.games.erase(s->gameId);
+    s->gameId = 0;
+    if (s->token != 0) {
+        r.resumable.erase(s->token);
+        s->token = 0;
+    }
+    s->state = RESUMING;
+    s->replyStart = 0;
+    int home = gameReactor(s->resumeToken);
+    HandoffInbox *inbox = reactorInbox(home);
+    if (home == r.id || inbox == nullptr)
+        return resumeGame(r, s);
+    handOff(r, s, *inbox);
+    return false;
+}
+
+/*
+ * Function: expireSession
+ *
+ * A session's deadline passed. A client that was taking too long
+ * forfeits with GAMEOVER TIMEOUT; a finished game that still hasn't
+ * drained is simply dropped, as is a parked game nobody resumed.
+ */
+inline void expireSession(Reactor &r, Session *s) {
+    if (s->timerKind == TIMER_IDLE) {
+        count(*r.metrics, COUNT_REAPED);
+        logMessage(LOG_WARN, "Client stopped reading its final board, dropping it.");
+        closeSession(r, s);
+        return;
+    }
+    if (s->timerKind == TIMER_RESUME) {
+        count(*r.metrics, COUNT_TIMEOUTS);
+        logMessage(LOG_INFO, "Game {} wasn't resumed in time.", s->gameId);
+        closeSession(r, s);
+        return;
+    }
+    count(*r.metrics, COUNT_TIMEOUTS);
+    logMessage(LOG_INFO, "Client timed out.");
+    if (s->opponent)
+        deferRead(r, s->opponent); // Wins by forfeit.
+    timeOutSession(*s);
+    scheduleTimeout(r, s);
+    flushSession(r, s);
+}
+
+// Plays the move a search picked for the server.
+inline void playSearchedMove(Reactor &r, Session *s, const SearchResult &result) {
+    record(*r.metrics, HIST_AI_SEARCH, (uint64_t)(result.ms * 1e6));
+    count(*r.metrics, COUNT_TT_PROBES, result.probes);
+    count(*r.metrics, COUNT_TT_HITS, result.hits);
+    logMessage(LOG_INFO, "[AI] depth {}, score {}, {} nodes in {} ms ({} nodes/sec, {} threads)",
+               result.depth, result.score, result.nodes, result.ms,
+               (uint64_t)(result.nodes / (result.ms / 1000.0 + 1e-9)), result.threads);
+    applyServerMove(*s, result.column + 1);
+    count(*r.metrics, COUNT_MOVES);
+}
+
+/*
+ * Function: playEngineMove
+ *
+ * Lets the engine pick the server's move, within the --ai budget. A
+ * book move is played straight away, unless it won't go on the board;
+ * anything else is searched on the pool's move threads and played by
+ * handleAnalyses() when it comes back, with the session left in
+ * AWAIT_SERVER_MOVE meanwhile. Only if the pool isn't running is the
+ * search done here, blocking the loop.
+ */
+inline void playEngineMove(Reactor &r, Session *s) {
+    int col = bookMove(r.book, s->board);
+    if (col >= 0 && applyServerMove(*s, col + 1)) {
+        logMessage(LOG_INFO, "[AI] book move");
+        count(*r.metrics, COUNT_MOVES);
+        return;
+    }
+    uint64_t id = ++r.nextAnalysisId;
+    if (submitMove(r.inbox, s->gameId, id, s->board, r.opts->aiMs, r.opts->threads)) {
+        s->engineId = id;
+        return;
+    }
+    playSearchedMove(r, s, searchMove(sharedTable(), s->board, r.opts->aiMs, r.opts->threads));
+}
+
+inline void answerAnalysis(Reactor &r, Session *s, const Analysis &analysis) {
+    int16_t scores[COLS];
+    analysisWireScores(analysis, s->board.moves, scores);
+    sendAnalysis(*s, analysis.depth, scores);
+    count(*r.metrics, COUNT_ANALYSES);
+    logMessage(LOG_INFO, "[ANALYZE] depth {}, {} nodes in {} ms", analysis.depth, analysis.nodes, analysis.ms);
+}
+
+/*
+ * Function: requestAnalysis
+ *
+ * Handles "ANALYZE <ms>": answers from the cache if it can, otherwise
+ * queues the search on the analysis pool and marks the session as
+ * waiting, or answers "busy" if the pool's queue is full.
+ */
+inline void requestAnalysis(Reactor &r, Session *s) {
+    Analysis analysis;
+    if (lookupAnalysis(s->board, s->analyzeMs, analysis)) {
+        count(*r.metrics, COUNT_ANALYSIS_HITS);
+        answerAnalysis(r, s, analysis);
+        return;
+    }
+    uint64_t id = ++r.nextAnalysisId;
+    int fd = s->link ? s->link->conn.fd : s->conn.fd;
+    if (!submitAnalysis(r.inbox, fd, s->channel, id, s->board, s->analyzeMs)) {
+        const int16_t none[COLS] = {};
+        count(*r.metrics, COUNT_ANALYSIS_BUSY);
+        sendAnalysis(*s, 0, none);
+        return;
+    }
+    s->analyzing = true;
+    s->analysisId = id;
+}
+
+// Replays the move `s` just made on its PvP opponent's session.
+inline void relayMove(Reactor &r, Session *s) {
+    Session *o = s->opponent;
+    applyServerMove(*o, recordedMove(s->record, s->record.moveCount - 1) + 1);
+    deferRead(r, o); // Sends it, and o may have its next move buffered already.
+}
+
+inline void leaveMatch(Reactor &r, Session *s);
+inline void startMux(Reactor &r, Session *s);
+inline void processMux(Reactor &r, Session *l);
+
+/*
+ * Function: processInput
+ *
+ * Feeds complete lines to the session while it's the client's turn.
+ * Lines that arrive during the server's turn, or while an ANALYZE is
+ * out on the pool, stay buffered until it's the client's turn again,
+ * the same as they used to sit in the socket. So do lines from a
+ * client whose replies have backed up (`stalled`, until flushSession()
+ * gets them out). A player in the lobby
+ * only has its first line looked at, for WATCH, as does one paired
+ * before it could say so; spectators' lines are ignored. A multiplexed
+ * connection hands its lines out to its games (processMux()). Returns
+ * false if the session went to another reactor, or was freed because
+ * its connection resumed another game.
+ */
+inline bool processInput(Reactor &r, Session *s) {
+    std::string_view line;
+    if (s->state == MULTIPLEXED) {
+        processMux(r, s);
+        return true;
+    }
+    if (s->state == SPECTATING) {
+        while (nextLine(s->conn, line)) {
+        }
+        return true;
+    }
+    if ((s->state == LOBBY || (s->opponent && s->board.moves == 0)) && peekLine(s->conn, line)
+        && parseWatch(line, s->watchId)) {
+        nextLine(s->conn, line);
+        if (s->opponent)
+            leaveMatch(r, s);
+        return startWatching(r, s);
+    }
+    while (s->state == AWAIT_MOVE && !s->analyzing && hasLine(s->conn)) {
+        if (backlogged(*s)) {
+            s->stalled = true;
+            break;
+        }
+        nextLine(s->conn, line);
+        bool timing = s->replyStart == 0;
+        if (timing)
+            s->replyStart = monotonicNs();
+        LineResult result = handleClientLine(*s, line);
+        if (result == LINE_MOVE)
+            count(*r.metrics, COUNT_MOVES);
+        if (result == LINE_MOVE && s->opponent)
+            relayMove(r, s);
+        else if (result == LINE_INVALID)
+            count(*r.metrics, COUNT_INVALID_MOVES);
+        else if (result == LINE_ANALYZE) {
+            if (timing)
+                s->replyStart = 0; // Not a move; HIST_ANALYSIS times these.
+            requestAnalysis(r, s);
+        } else if (result == LINE_TOKEN) {
+            if (timing)
+                s->replyStart = 0;
+            issueToken(r, s);
+        } else if (result == LINE_WATCH) {
+            return startWatching(r, s);
+        } else if (result == LINE_RESUME) {
+            return startResume(r, s);
+        } else if (result == LINE_VARIANT) {
+            if (timing)
+                s->replyStart = 0;
+            chooseVariant(r, s);
+        } else if (result == LINE_MUX) {
+            startMux(r, s);
+            processMux(r, s); // Its first channels may be right behind.
+            return true;
+        }
+        if (s->state == AWAIT_SERVER_MOVE && r.opts->aiMs > 0) {
+            playEngineMove(r, s);
+        } else if (s->state == AWAIT_SERVER_MOVE) {
+            r.serverQueue.push_back(s);
+            if (r.serverQueue.size() == 1)
+                promptConsole(r);
+        }
+    }
+    return true;
+}
+
+/*
+ * Function: readSession
+ *
+ * Edge-triggered, so keep reading until recv() says EAGAIN (under
+ * --io uring: until the bytes the ring received run out). One
+ * exception is a receive buffer full of moves sent ahead of the
+ * server's turn: we stop there and handleConsole() calls us again
+ * once the server has moved and those lines can be consumed. The
+ * same goes for lines from a client that doesn't read its replies,
+ * until flushSession() has got them out (`stalled`). A
+ * multiplexed game has no socket: it just takes the lines its link
+ * has fed it; a parked one has nothing to read at all. A connection
+ * that drops is parked if its game can be resumed (dropConnection()).
+ */
+inline void readSession(Reactor &r, Session *s) {
+    while (true) {
+        if (!processInput(r, s))
+            return;
+        if (s->state == GAME_OVER || s->link || isParked(*s))
+            break;
+        if (inputFull(s->conn)) {
+            if (!hasLine(s->conn)) {
+                logMessage(LOG_WARN, "Client sent an overlong line, dropping it.");
+                closeSession(r, s);
+                return;
+            }
+            break;
+        }
+        ssize_t n = pullInput(r, s);
+        if (n > 0)
+            continue;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0)
+            logMessage(LOG_ERROR, "[ERROR] recv(): {}", LogErrno{errno});
+        logMessage(LOG_WARN, "Client disconnected or error occurred.");
+        dropConnection(r, s);
+        return;
+    }
+    scheduleTimeout(r, s);
+    flushSession(r, s);
+}
+
+// Makes `s` a multiplexed connection: the game it was offered never
+// started, and from here on its lines belong to its channels' games.
+inline void startMux(Reactor &r, Session *s) {
+    r.games.erase(s->gameId);
+    s->gameId = 0;
+    s->state = MULTIPLEXED;
+    s->replyStart = 0;
+    queueLine(*s, "PROTOCOL MUX OK");
+    logMessage(LOG_INFO, "[{}] multiplexes its games.", LogIp{s->addr.sin_addr, ntohs(s->addr.sin_port)});
+}
+
+// Starts a game against the server on link `l`'s `channel`.
+inline void openChannel(Reactor &r, Session *l, uint32_t channel) {
+    Session *g = new Session();
+    initConnection(g->conn, -1);
+    initTimerNode(g->timer, g);
+    g->timerKind = TIMER_NONE;
+    g->addr = l->addr;
+    g->acceptedNs = monotonicNs();
+    g->link = l;
+    g->channel = channel;
+    l->channels[channel] = g;
+    count(*r.metrics, COUNT_MUX_GAMES);
+    startSession(*g);
+    registerGame(r, g);
+    scheduleTimeout(r, g);
+    flushSession(r, g);
+}
+
+/*
+ * Function: muxLine
+ *
+ * Carries out one "<channel> <message>" line of link `l` (protocol.h):
+ * opens or closes a channel, or feeds the line to the channel's game
+ * and lets it play. Returns false, leaving the line where it is, if
+ * the game's input buffer is full (it isn't taking lines right now);
+ * the game wakes the link again when it next sends something.
+ */
+inline bool muxLine(Reactor &r, Session *l, std::string_view line) {
+    uint32_t channel;
+    std::string_view message;
+    if (!parseChannel(line, channel, message)) {
+        muxNotice(l, 0, "INVALID_MESSAGE");
+        return true;
+    }
+    std::unordered_map<uint32_t, Session*>::iterator it = l->channels.find(channel);
+    if (message == "OPEN") {
+        if (it != l->channels.end())
+            muxNotice(l, channel, "CHANNEL_IN_USE");
+        else if (l->channels.size() >= MUX_MAX_CHANNELS || !reserveMuxGame())
+            muxNotice(l, channel, "TOO_MANY_CHANNELS");
+        else
+            openChannel(r, l, channel);
+        return true;
+    }
+    if (it == l->channels.end()) {
+        muxNotice(l, channel, "NO_SUCH_CHANNEL");
+        return true;
+    }
+    Session *g = it->second;
+    if (message == "CLOSE") {
+        closeSession(r, g);
+        muxNotice(l, channel, "CLOSED");
+        return true;
+    }
+    if (!feedLine(g->conn, message))
+        return false;
+    readSession(r, g);
+    return true;
+}
+
+/*
+ * Function: processMux
+ *
+ * Hands link `l`'s complete lines to its channels, in order. Stops
+ * early, marking the link stalled, once MUX_OUTPUT_LIMIT of frames
+ * are waiting or its socket hasn't taken the last lot: flushSession()
+ * picks the lines up again when it has. Until then they wait in the
+ * receive buffer and then the socket, so a client that pipelines far
+ * ahead of what it reads is held back by TCP, not by our memory.
+ */
+inline void processMux(Reactor &r, Session *l) {
+    std::string_view line;
+    l->muxWoken = false;
+    l->muxReading = true;
+    while (peekLine(l->conn, line)) {
+        if (muxBacklogged(*l)) {
+            l->stalled = true;
+            break;
+        }
+        if (!muxLine(r, l, line))
+            break;
+        nextLine(l->conn, line);
+    }
+    l->muxReading = false;
+}
+
+// Puts a session's socket in this reactor's epoll set (or arms its
+// recv on the ring) and in the session table.
+inline bool addSession(Reactor &r, Session *s) {
+    int fd = s->conn.fd;
+    if ((size_t)fd >= r.sessions.size())
+        r.sessions.resize(fd + 1, nullptr);
+    if (r.io == IO_URING) {
+        s->io.tag = r.nextTag++ & URING_TAG_MASK;
+        if (!s->io.peerClosed && !armRecv(r, s)) {
+            logMessage(LOG_ERROR, "[ERROR] io_uring recv: {}", LogErrno{errno});
+            return false;
+        }
+    } else {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        count(*r.metrics, COUNT_IO_SYSCALLS);
+        if (epoll_ctl(r.epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            logMessage(LOG_ERROR, "[ERROR] epoll_ctl(): {}", LogErrno{errno});
+            return false;
+        }
+    }
+    r.sessions[fd] = s;
+    return true;
+}
+
+// Starts a PvP game between two players on this reactor; `first` moves first.
+inline void pairPlayers(Reactor &r, Session *first, Session *second) {
+    startMatch(*first, *second);
+    count(*r.metrics, COUNT_MATCHES);
+    logMessage(LOG_INFO, "Paired [{}] with [{}].", LogIp{first->addr.sin_addr, ntohs(first->addr.sin_port)},
+               LogIp{second->addr.sin_addr, ntohs(second->addr.sin_port)});
+    registerGame(r, first);
+    deferRead(r, first);
+    deferRead(r, second);
+}
+
+/*
+ * Function: joinLobby
+ *
+ * Puts a --pvp player in the lobby (lobby.h). If someone is waiting
+ * on this reactor the game starts here; if they're on another one,
+ * `s` leaves this reactor and is handed over to theirs.
+ */
+inline void joinLobby(Reactor &r, Session *s) {
+    LobbyTicket *mine = new LobbyTicket{ &r.handoffs, s };
+    LobbyTicket *waiting = enterLobby(mine);
+    if (waiting == nullptr) {
+        s->ticket = mine;
+        logMessage(LOG_INFO, "Waiting for an opponent.");
+        return;
+    }
+    delete mine;
+    if (waiting->inbox != &r.handoffs) {
+        s->claimed = waiting;
+        handOff(r, s, *waiting->inbox);
+        return;
+    }
+    // Ours, so it can't have left without taking its ticket back.
+    Session *first = waiting->session;
+    delete waiting;
+    first->ticket = nullptr;
+    pairPlayers(r, first, s);
+}
+
+/*
+ * Function: leaveMatch
+ *
+ * Takes `s` out of a PvP game nobody has moved in yet: it was paired
+ * on connecting, but its first line asks to WATCH. The game is
+ * forgotten and the opponent goes back into the lobby.
+ */
+inline void leaveMatch(Reactor &r, Session *s) {
+    Session *o = s->opponent;
+    Session *first = s->seat == 0 ? s : o;
+    logMessage(LOG_INFO, "Game {} called off: a player wants to watch instead.", first->gameId);
+    r.games.erase(first->gameId);
+    first->gameId = 0;
+    s->opponent = nullptr;
+    o->opponent = nullptr;
+    s->seat = o->seat = 0;
+    o->state = LOBBY;
+    scheduleTimeout(r, o);
+    joinLobby(r, o); // May hand it to another reactor; don't touch it after this.
+}
+
+/*
+ * Function: handleHandoffs
+ *
+ * Adopts the sessions other reactors handed over: spectators of our
+ * games, connections resuming one, and players paired with one of
+ * ours, whose games start here. If ours left in the meantime, the
+ * newcomer goes back into the lobby from here.
+ */
+inline void handleHandoffs(Reactor &r) {
+    Session *s = takeHandoffs(r.handoffs);
+    while (s) {
+        Session *next = s->nextHandoff;
+        if (s->state == SPECTATING || s->state == RESUMING) {
+            if (!addSession(r, s)) {
+                count(*r.metrics, COUNT_CLOSED);
+                close(s->conn.fd);
+                delete s;
+            } else if (s->state == SPECTATING) {
+                attachSpectator(r, s);
+                deferRead(r, s);
+            } else if (resumeGame(r, s)) {
+                deferRead(r, s); // NO_SUCH_SESSION.
+            }
+            s = next;
+            continue;
+        }
+        LobbyTicket *ticket = s->claimed;
+        Session *first = ticket->session;
+        s->claimed = nullptr;
+        delete ticket;
+        if (first)
+            first->ticket = nullptr;
+        if (!addSession(r, s)) {
+            count(*r.metrics, COUNT_CLOSED);
+            close(s->conn.fd);
+            delete s;
+            if (first)
+                joinLobby(r, first);
+        } else if (first) {
+            pairPlayers(r, first, s);
+        } else {
+            joinLobby(r, s); // May hand it on again; don't touch it after this.
+        }
+        s = next;
+    }
+}
+
+/*
+ * Function: runReady
+ *
+ * Reads the sessions deferRead() queued, until none are left (one
+ * player's move can make the other ready in turn).
+ */
+inline void runReady(Reactor &r) {
+    while (!r.ready.empty()) {
+        r.readyNow.swap(r.ready);
+        for (size_t i = 0; i < r.readyNow.size(); i++) {
+            int fd = r.readyNow[i];
+            if ((size_t)fd < r.sessions.size() && r.sessions[fd] != nullptr)
+                readSession(r, r.sessions[fd]);
+        }
+        r.readyNow.clear();
+    }
+}
+
+// Makes a newly accepted connection a session: a game against the
+// server, or a place in the lobby under --pvp.
+inline void adoptClient(Reactor &r, int client, const struct sockaddr_in &client_addr) {
+    count(*r.metrics, COUNT_ACCEPTED);
+    logMessage(LOG_INFO, "Connection accepted from: [{}]!", LogIp{client_addr.sin_addr, ntohs(client_addr.sin_port)});
+
+    Session *s = new Session();
+    initConnection(s->conn, client);
+    initTimerNode(s->timer, s);
+    s->timerKind = TIMER_NONE;
+    s->addr = client_addr;
+    s->acceptedNs = monotonicNs();
+    if (!addSession(r, s)) {
+        close(client);
+        delete s;
+        return;
+    }
+    if (r.opts->pvp) {
+        s->state = LOBBY;
+        joinLobby(r, s);
+        return;
+    }
+    startSession(*s);
+    registerGame(r, s);
+    scheduleTimeout(r, s);
+    flushSession(r, s);
+}
+
+inline void acceptClients(Reactor &r) {
+    while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t client_length = sizeof(client_addr);
+        count(*r.metrics, COUNT_IO_SYSCALLS);
+        int client = accept4(r.listenfd, (struct sockaddr*)&client_addr, &client_length, SOCK_NONBLOCK);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                logMessage(LOG_ERROR, "[ERROR] accept(): {}", LogErrno{errno});
+            return;
+        }
+        adoptClient(r, client, client_addr);
+    }
+}
+
+// Stops taking new connections: they wait in the listener's backlog for the new server.
+inline void stopAccepting(Reactor &r) {
+    r.accepting = false;
+    if (r.io == IO_URING) {
+        if (r.acceptArmed)
+            prepCancel(r.ring, uringData(URING_ACCEPT, r.listenfd, 0), uringData(URING_CANCEL, r.listenfd, 0));
+    } else {
+        epoll_ctl(r.epfd, EPOLL_CTL_DEL, r.listenfd, nullptr);
+    }
+}
+
+inline void resumeAccepting(Reactor &r) {
+    r.accepting = true;
+    if (r.io == IO_URING)
+        return; // runUring() re-arms the accept.
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = r.listenfd;
+    epoll_ctl(r.epfd, EPOLL_CTL_ADD, r.listenfd, &ev);
+    acceptClients(r); // Edge-triggered: what queued up meanwhile raises no new edge.
+}
+
+// A session that can go to a new server as it stands: a game against
+// the server (parked or not) or a player in the lobby, with nothing
+// half-read, half-written or owed by the analysis pool.
+inline bool canMigrate(const Session &s) {
+    if (s.state != AWAIT_MOVE && s.state != AWAIT_SERVER_MOVE && s.state != LOBBY)
+        return false;
+    return !s.opponent && !s.link && !s.claimed && !s.variant && s.watchers.empty() && !s.analyzing && !outputPending(s)
+        && s.conn.inHead == s.conn.inTail && s.io.spill.empty() && !s.io.peerClosed;
+}
+
+/*
+ * Function: leaveReactor
+ *
+ * Takes `s` off this reactor's books for a new server: no timer, no
+ * place in the lobby, the console queue or the game and token tables,
+ * and its socket out of the epoll set. Under --io uring its recv is
+ * cancelled and it waits in `departing` until that completes. Nothing
+ * touches it again unless readmitSession() takes it back.
+ */
+inline void leaveReactor(Reactor &r, Session *s) {
+    cancelTimer(r.timers, s->timer);
+    s->timerKind = TIMER_NONE;
+    if (s->state == LOBBY)
+        quitLobby(s);
+    if (s->gameId != 0)
+        r.games.erase(s->gameId);
+    if (s->token != 0)
+        r.resumable.erase(s->token);
+    std::deque<Session*>::iterator it = std::find(r.serverQueue.begin(), r.serverQueue.end(), s);
+    bool wasFront = it == r.serverQueue.begin();
+    if (it != r.serverQueue.end())
+        r.serverQueue.erase(it);
+    if (!isParked(*s)) {
+        int fd = s->conn.fd;
+        r.sessions[fd] = nullptr;
+        if (r.io == IO_EPOLL) {
+            epoll_ctl(r.epfd, EPOLL_CTL_DEL, fd, nullptr);
+            count(*r.metrics, COUNT_IO_SYSCALLS);
+        } else if (s->io.recvArmed) {
+            prepCancel(r.ring, uringData(URING_RECV, fd, s->io.tag), uringData(URING_CANCEL, fd, s->io.tag));
+            r.departing[fd] = Departure{ s, nullptr };
+        }
+    }
+    r.leaving.push_back(s);
+    if (wasFront)
+        promptConsole(r);
+}
+
+/*
+ * Function: readmitSession
+ *
+ * Puts a session that's off the books back on them: one that was
+ * leaving when the restart failed or that had bytes come in while it
+ * settled, or one restored from a predecessor's checkpoint. Its game
+ * carries on from where it stands.
+ */
+inline void readmitSession(Reactor &r, Session *s) {
+    if (s->gameId != 0)
+        r.games[s->gameId] = s;
+    if (s->token != 0)
+        r.resumable[s->token] = s;
+    if (!isParked(*s)) {
+        r.departing.erase(s->conn.fd);
+        if (!addSession(r, s)) {
+            closeSession(r, s);
+            return;
+        }
+    }
+    if (s->state == LOBBY) {
+        joinLobby(r, s); // May hand it to another reactor; don't touch it after this.
+        return;
+    }
+    if (s->state == AWAIT_SERVER_MOVE && r.opts->aiMs > 0) {
+        playEngineMove(r, s);
+    } else if (s->state == AWAIT_SERVER_MOVE) {
+        r.serverQueue.push_back(s);
+        if (r.serverQueue.size() == 1)
+            promptConsole(r);
+    }
+    if (isParked(*s))
+        readSession(r, s); // Nothing to read, but the engine's move may have ended it.
+    else
+        deferRead(r, s);
+}
+
+/*
+ * Function: beginUpgrade
+ *
+ * The first step of a SIGUSR2 restart (upgrade.h): stops accepting
+ * and takes every session that can go to the new server off the
+ * books. Under --io uring they then settle until their recvs are
+ * cancelled; under epoll they're ready at once.
+ */
+inline void beginUpgrade(Reactor &r) {
+    logMessage(LOG_INFO, "[UPGRADE] Restart requested.");
+    r.upgrade = UPGRADE_SETTLING;
+    stopAccepting(r);
+    std::vector<Session*> picked;
+    for (size_t fd = 0; fd < r.sessions.size(); fd++)
+        if (r.sessions[fd] != nullptr && canMigrate(*r.sessions[fd]))
+            picked.push_back(r.sessions[fd]);
+    for (std::unordered_map<uint64_t, Session*>::iterator it = r.resumable.begin(); it != r.resumable.end(); ++it)
+        if (isParked(*it->second) && canMigrate(*it->second))
+            picked.push_back(it->second);
+    for (size_t i = 0; i < picked.size(); i++)
+        leaveReactor(r, picked[i]);
+}
+
+// Whether every leaving session's requests on the ring have completed.
+inline bool leavingSettled(const Reactor &r) {
+    for (size_t i = 0; i < r.leaving.size(); i++)
+        if (r.leaving[i]->io.recvArmed || r.leaving[i]->io.sending)
+            return false;
+    return true;
+}
+
+/*
+ * Function: postUpgrade
+ *
+ * Snapshots the leaving sessions and hands them in for the new server
+ * (postSnapshots()). One that was sent something or hung up while it
+ * settled stays here instead: its bytes are in our spill, not the
+ * socket.
+ */
+inline void postUpgrade(Reactor &r) {
+    std::vector<Session*> going;
+    std::vector<SessionSnapshot> snapshots;
+    for (size_t i = 0; i < r.leaving.size(); i++) {
+        Session *s = r.leaving[i];
+        if (!s->io.spill.empty() || s->io.peerClosed) {
+            readmitSession(r, s);
+            continue;
+        }
+        r.departing.erase(s->conn.fd);
+        going.push_back(s);
+        snapshots.push_back(SessionSnapshot());
+        snapshotSession(*s, snapshots.back());
+    }
+    r.leaving.swap(going);
+    r.upgrade = UPGRADE_POSTED;
+    r.upgradeRound = postSnapshots(r.id, r.listenfd, snapshots);
+}
+
+/*
+ * Function: finishUpgrade
+ *
+ * The new server is running with our leaving sessions (`handedOver`):
+ * close our copies of their sockets, free them and drain. Or it isn't:
+ * take them back and accept again.
+ */
+inline void finishUpgrade(Reactor &r, bool handedOver) {
+    std::vector<Session*> leaving;
+    leaving.swap(r.leaving);
+    if (!handedOver) {
+        r.upgrade = UPGRADE_NONE;
+        for (size_t i = 0; i < leaving.size(); i++)
+            readmitSession(r, leaving[i]);
+        resumeAccepting(r);
+        return;
+    }
+    for (size_t i = 0; i < leaving.size(); i++) {
+        Session *s = leaving[i];
+        if (!isParked(*s)) {
+            close(s->conn.fd); // The new server has its own.
+            count(*r.metrics, COUNT_CLOSED);
+        }
+        count(*r.metrics, COUNT_MIGRATED);
+        delete s;
+    }
+    r.upgrade = UPGRADE_DRAINING;
+    logMessage(LOG_INFO, "[UPGRADE] {} sessions handed over; draining the rest.", leaving.size());
+}
+
+/*
+ * Function: drainIdle
+ *
+ * While draining, closes what would otherwise keep the old server up
+ * for good: players waiting in the lobby, which nobody new will join,
+ * and multiplexed connections with no games left. Returns whether
+ * anything at all is left on this reactor, an analysis still being
+ * worked out for it included.
+ */
+inline bool drainIdle(Reactor &r) {
+    bool busy = !r.games.empty() || !r.departing.empty() || r.inbox.pending.load(std::memory_order_acquire) > 0;
+    for (size_t fd = 0; fd < r.sessions.size(); fd++) {
+        Session *s = r.sessions[fd];
+        if (s == nullptr)
+            continue;
+        if (s->state == LOBBY || (s->state == MULTIPLEXED && s->channels.empty() && !outputPending(*s)))
+            closeSession(r, s);
+        else
+            busy = true;
+    }
+    return busy;
+}
+
+/*
+ * Function: checkUpgrade
+ *
+ * Moves this reactor through a SIGUSR2 restart (upgrade.h), as far as
+ * it can go for now; called once per pass of its event loop. Returns
+ * false once it has drained and its loop should end.
+ */
+inline bool checkUpgrade(Reactor &r) {
+    if (r.upgrade == UPGRADE_NONE && upgradeState().requested.load(std::memory_order_acquire))
+        beginUpgrade(r);
+    if (r.upgrade == UPGRADE_SETTLING && leavingSettled(r))
+        postUpgrade(r);
+    bool handedOver;
+    if (r.upgrade == UPGRADE_POSTED && upgradeOutcome(r.upgradeRound, handedOver))
+        finishUpgrade(r, handedOver);
+    if (r.upgrade == UPGRADE_DRAINING && !drainIdle(r))
+        return false;
+    runReady(r);
+    return true;
+}
+
+/*
+ * Function: restoreSessions
+ *
+ * Takes over the sessions a predecessor left in its checkpoint for the
+ * reactor with our id (upgrade.h): each game picks up where it stood,
+ * on the same socket, with the same id and resume token. A snapshot
+ * that doesn't add up is dropped, socket and all. Then reports in, so
+ * the old server lets go once every reactor has.
+ */
+inline void restoreSessions(Reactor &r) {
+    const std::vector<SessionSnapshot> &snapshots = upgradeState().restored;
+    size_t restored = 0;
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        const SessionSnapshot &snap = snapshots[i];
+        if (gameReactor(snap.gameId) != r.id)
+            continue;
+        Session *s = new Session();
+        initConnection(s->conn, snap.fd);
+        initTimerNode(s->timer, s);
+        s->timerKind = TIMER_NONE;
+        s->acceptedNs = monotonicNs();
+        if (!restoreSession(*s, snap)) {
+            logMessage(LOG_WARN, "[UPGRADE] Game {} doesn't add up, dropping it.", snap.gameId);
+            if (snap.fd != -1)
+                close(snap.fd);
+            delete s;
+            continue;
+        }
+        if (s->gameId != 0)
+            r.nextGameSerial = std::max(r.nextGameSerial, s->gameId / handoffDirectory().count);
+        if (snap.fd != -1) {
+            count(*r.metrics, COUNT_ACCEPTED); // So it's counted once when it closes.
+            if (r.io == IO_EPOLL)
+                setNonBlocking(snap.fd);
+        }
+        readmitSession(r, s);
+        restored++;
+    }
+    if (restored > 0)
+        logMessage(LOG_INFO, "[UPGRADE] Restored {} sessions.", restored);
+    reportRestored();
+}
+
+// Stops watching the console once it has hit end of file.
+inline void unwatchConsole(Reactor &r) {
+    if (r.io == IO_URING) {
+        r.consoleClosed = true;
+        prepCancel(r.ring, uringData(URING_POLL, STDIN_FILENO, 0), uringData(URING_CANCEL, STDIN_FILENO, 0));
+    } else {
+        epoll_ctl(r.epfd, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+    }
+}
+
+/*
+ * Function: handleConsole
+ *
+ * Reads whatever was typed at the console and applies each complete
+ * line as the server's move in the game at the front of the queue.
+ */
+inline void handleConsole(Reactor &r) {
+    char buffer[256];
+    ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (n <= 0) {
+        if (n < 0 && errno == EINTR)
+            return;
+        unwatchConsole(r);
+        logMessage(LOG_WARN, "Console closed; games waiting on a server move will stall.");
+        return;
+    }
+    r.console.append(buffer, n);
+
+    size_t nl;
+    while ((nl = r.console.find('\n')) != std::string::npos) {
+        std::string line = r.console.substr(0, nl);
+        r.console.erase(0, nl + 1);
+        if (r.serverQueue.empty()) {
+            logMessage(LOG_CONSOLE, "No game is waiting for a server move.");
+            continue;
+        }
+        Session *s = r.serverQueue.front();
+        std::istringstream iss(line);
+        int col;
+        iss >> col;
+        if (iss.fail() || col < 1 || col > (s->variant ? s->variant->cols : COLS)) {
+            logMessage(LOG_CONSOLE, "Invalid input, try again.");
+            promptConsole(r);
+            continue;
+        }
+        if (!applyServerMove(*s, col)) {
+            logMessage(LOG_CONSOLE, "Column full, pick another.");
+            promptConsole(r);
+            continue;
+        }
+        count(*r.metrics, COUNT_MOVES);
+        r.serverQueue.pop_front();
+        bool othersWaiting = !r.serverQueue.empty();
+        readSession(r, s); // The client may have pipelined its next move already.
+        if (othersWaiting)
+            promptConsole(r);
+    }
+}
+
+// A move the pool searched: played if its game is still here and still
+// waiting for it, wherever its connection is now (or parked without one).
+inline void finishEngineMove(Reactor &r, const AnalysisDone &done) {
+    std::unordered_map<uint64_t, Session*>::iterator it = r.games.find(done.gameId);
+    if (it == r.games.end())
+        return;
+    Session *s = it->second;
+    if (s->state != AWAIT_SERVER_MOVE || s->engineId != done.id)
+        return;
+    s->engineId = 0;
+    playSearchedMove(r, s, done.move);
+    readSession(r, s); // Sends it, and the client may have its next move buffered already.
+}
+
+/*
+ * Function: handleAnalyses
+ *
+ * Sends the results the analysis pool has posted to this reactor, then
+ * lets each session get on with any lines it held back meanwhile.
+ * Results for sessions that have closed or moved on are dropped. The
+ * server moves searched for --ai are played (finishEngineMove()).
+ */
+inline void handleAnalyses(Reactor &r) {
+    takeAnalyses(r.inbox, r.analyses);
+    for (size_t i = 0; i < r.analyses.size(); i++) {
+        const AnalysisDone &done = r.analyses[i];
+        if (done.kind == SEARCH_MOVE) {
+            finishEngineMove(r, done);
+            continue;
+        }
+        if ((size_t)done.fd >= r.sessions.size())
+            continue;
+        Session *s = r.sessions[done.fd];
+        if (s != nullptr && done.channel != 0) {
+            std::unordered_map<uint32_t, Session*>::iterator it = s->channels.find(done.channel);
+            s = it == s->channels.end() ? nullptr : it->second;
+        }
+        if (s == nullptr || !s->analyzing || s->analysisId != done.id)
+            continue;
+        s->analyzing = false;
+        if (s->state == AWAIT_MOVE)
+            answerAnalysis(r, s, done.analysis);
+        readSession(r, s);
+    }
+}
+
+// The console plays the server's side, so stdin is an event source too.
+inline bool watchesConsole(const Reactor &r) {
+    return r.opts->aiMs == 0 && !r.opts->pvp;
+}
+
+/*
+ * Function: runEpoll
+ *
+ * The readiness-based event loop (--io epoll, the default). Only
+ * returns if epoll itself fails, or with 0 once a SIGUSR2 restart has
+ * handed over or drained everything.
+ */
+inline int runEpoll(Reactor &r) {
+    r.epfd = epoll_create1(0);
+    if (r.epfd == -1) {
+        logMessage(LOG_ERROR, "[ERROR] epoll_create1(): {}", LogErrno{errno});
+        return errno;
+    }
+    int listenfd = r.listenfd;
+    setNonBlocking(listenfd);
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listenfd;
+    epoll_ctl(r.epfd, EPOLL_CTL_ADD, listenfd, &ev);
+    ev.events = EPOLLIN;
+    ev.data.fd = r.inbox.eventfd;
+    epoll_ctl(r.epfd, EPOLL_CTL_ADD, r.inbox.eventfd, &ev);
+    ev.data.fd = r.handoffs.eventfd;
+    epoll_ctl(r.epfd, EPOLL_CTL_ADD, r.handoffs.eventfd, &ev);
+
+    // Level-triggered on purpose: we only read() once per wakeup so the
+    // console never has to be put in non-blocking mode.
+    if (watchesConsole(r)) {
+        ev.events = EPOLLIN;
+        ev.data.fd = STDIN_FILENO;
+        epoll_ctl(r.epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev);
+    }
+    restoreSessions(r);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (true) {
+        if (!checkUpgrade(r)) {
+            close(r.epfd);
+            return 0;
+        }
+        int n = epoll_wait(r.epfd, events, MAX_EVENTS, timerWaitMs(r.timers));
+        count(*r.metrics, COUNT_IO_SYSCALLS);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            logMessage(LOG_ERROR, "[ERROR] epoll_wait(): {}", LogErrno{errno});
+            close(r.epfd);
+            return errno;
+        }
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenfd) {
+                acceptClients(r);
+            } else if (fd == STDIN_FILENO) {
+                handleConsole(r);
+            } else if (fd == r.inbox.eventfd) {
+                handleAnalyses(r);
+            } else if (fd == r.handoffs.eventfd) {
+                handleHandoffs(r);
+            } else if ((size_t)fd < r.sessions.size() && r.sessions[fd] != nullptr) {
+                // (A session closed earlier in this batch can leave a stale event behind.)
+                Session *s = r.sessions[fd];
+                bool open = true;
+                if (events[i].events & EPOLLOUT)
+                    open = flushSession(r, s);
+                if (open && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                    readSession(r, s);
+            }
+            runReady(r);
+        }
+        advanceTimers(r.timers, [&r](TimerNode &node) { expireSession(r, (Session*)node.owner); });
+        runReady(r);
+    }
+}
+
+/*
+ * Function: completionSession
+ *
+ * The session a recv or send completion belongs to: one of ours, or
+ * one waiting in `departing` (then `departing` is set). nullptr if it
+ * has closed since; a later socket on the same fd has another tag.
+ */
+inline Session *completionSession(Reactor &r, int fd, uint32_t tag, bool &departing) {
+    departing = false;
+    if ((size_t)fd < r.sessions.size() && r.sessions[fd] != nullptr && r.sessions[fd]->io.tag == tag)
+        return r.sessions[fd];
+    std::unordered_map<int, Departure>::iterator it = r.departing.find(fd);
+    if (it == r.departing.end() || it->second.session->io.tag != tag)
+        return nullptr;
+    departing = true;
+    return it->second.session;
+}
+
+// Posts a departing session to its new reactor once nothing of it is left on our ring.
+inline void finishDeparture(Reactor &r, Session *s) {
+    if (s->io.recvArmed || s->io.sending)
+        return;
+    std::unordered_map<int, Departure>::iterator it = r.departing.find(s->conn.fd);
+    HandoffInbox *inbox = it->second.inbox;
+    if (!inbox)
+        return; // Going to a new server; postUpgrade() sees to it.
+    r.departing.erase(it);
+    postHandoff(*inbox, s);
+}
+
+/*
+ * Function: received
+ *
+ * A multishot recv completion. The bytes go on the session's spill and
+ * the buffer straight back to the kernel; readSession() then takes
+ * them as if recv() had just returned them. A recv that ended without
+ * an error of its own (no free buffer, or cancelled) is re-armed -
+ * unless the spill has passed SPILL_LIMIT, which pauses it until
+ * readSession() has drained the spill, so a client that sends far
+ * ahead waits in its socket buffer, as it does under epoll.
+ */
+inline void received(Reactor &r, const struct io_uring_cqe &cqe) {
+    int fd = (int)(uint32_t)cqe.user_data;
+    uint32_t tag = (uint32_t)(cqe.user_data >> 32) & URING_TAG_MASK;
+    bool departing;
+    Session *s = completionSession(r, fd, tag, departing);
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (s && cqe.res > 0) {
+            s->io.spill.append(bufferData(r.buffers, bid), cqe.res);
+            count(*r.metrics, COUNT_BYTES_IN, cqe.res);
+        }
+        provideBuffer(r.buffers, bid);
+    }
+    if (!s)
+        return;
+    UringIo &io = s->io;
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        io.recvArmed = false;
+        if (cqe.res == 0) {
+            io.peerClosed = true;
+        } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            io.peerClosed = true;
+            io.recvError = -cqe.res;
+        }
+    }
+    if (departing) {
+        finishDeparture(r, s);
+        return;
+    }
+    if (io.recvArmed && !io.recvPaused && io.spill.size() > SPILL_LIMIT) {
+        io.recvPaused = true;
+        prepCancel(r.ring, cqe.user_data, uringData(URING_CANCEL, fd, tag));
+    }
+    if (!io.recvArmed && !io.recvPaused && !io.peerClosed && !armRecv(r, s)) {
+        logMessage(LOG_ERROR, "[ERROR] io_uring recv: {}", LogErrno{errno});
+        closeSession(r, s);
+        return;
+    }
+    readSession(r, s);
+}
+
+/*
+ * Function: sent
+ *
+ * A send completion: a short send goes again from where it stopped;
+ * a finished one lets flushSession() send what queued up meanwhile,
+ * or close a finished game.
+ */
+inline void sent(Reactor &r, const struct io_uring_cqe &cqe) {
+    int fd = (int)(uint32_t)cqe.user_data;
+    uint32_t tag = (uint32_t)(cqe.user_data >> 32) & URING_TAG_MASK;
+    bool departing;
+    Session *s = completionSession(r, fd, tag, departing);
+    if (!s) {
+        r.orphanSends.erase(cqe.user_data);
+        return;
+    }
+    UringIo &io = s->io;
+    if (cqe.res > 0) {
+        io.sendOffset += cqe.res;
+        s->conn.bytesSent += cqe.res;
+        count(*r.metrics, COUNT_BYTES_OUT, cqe.res);
+    }
+    bool ok = cqe.res >= 0;
+    if (ok && io.sendOffset < io.sendBuf.size()) {
+        if (prepSend(r.ring, fd, io.sendBuf.data() + io.sendOffset, io.sendBuf.size() - io.sendOffset,
+                     cqe.user_data))
+            return;
+        ok = false;
+    } else if (!ok) {
+        errno = -cqe.res;
+    }
+    io.sending = false;
+    if (departing) {
+        finishDeparture(r, s); // A broken socket fails again on the new reactor.
+    } else if (!ok) {
+        logMessage(LOG_ERROR, "[ERROR] send(): {}", LogErrno{errno});
+        dropConnection(r, s);
+    } else {
+        flushSession(r, s);
+    }
+}
+
+// An eventfd or the console is readable; the multishot poll is re-armed if it ended.
+inline void polled(Reactor &r, const struct io_uring_cqe &cqe) {
+    int fd = (int)(uint32_t)cqe.user_data;
+    if (fd == STDIN_FILENO && r.consoleClosed)
+        return;
+    if (cqe.res > 0) {
+        if (fd == STDIN_FILENO)
+            handleConsole(r);
+        else if (fd == r.inbox.eventfd)
+            handleAnalyses(r);
+        else if (fd == r.handoffs.eventfd)
+            handleHandoffs(r);
+    }
+    if (!(cqe.flags & IORING_CQE_F_MORE) && !(fd == STDIN_FILENO && r.consoleClosed))
+        prepMultishotPoll(r.ring, fd, POLLIN, cqe.user_data);
+}
+
+// The multishot accept produced a connection, or ended.
+inline void accepted(Reactor &r, const struct io_uring_cqe &cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+        r.acceptArmed = false;
+    if (cqe.res < 0) {
+        if (cqe.res != -ECONNABORTED && cqe.res != -EINTR && cqe.res != -ECANCELED) {
+            logMessage(LOG_ERROR, "[ERROR] accept(): {}", LogErrno{-cqe.res});
+            r.acceptRetryNs = monotonicNs() + TIMER_TICK_MS * 1000000ULL; // Don't spin on EMFILE.
+        }
+        return;
+    }
+    struct sockaddr_in client_addr;
+    socklen_t client_length = sizeof(client_addr);
+    count(*r.metrics, COUNT_IO_SYSCALLS);
+    if (getpeername(cqe.res, (struct sockaddr*)&client_addr, &client_length) != 0)
+        memset(&client_addr, 0, sizeof(client_addr));
+    adoptClient(r, cqe.res, client_addr);
+}
+
+/*
+ * Function: runUring
+ *
+ * The completion-based event loop (--io uring). Sockets stay blocking;
+ * the kernel waits for them. A multishot accept and one multishot
+ * recv per session deliver input without being asked again, into
+ * buffers the kernel takes from the provided-buffer ring; sends are
+ * queued by flushSession(). Everything queued while handling one
+ * batch of completions - every session's sends, re-arms and cancels -
+ * goes to the kernel in the single io_uring_enter() that also waits
+ * for the next batch. Only returns if the ring fails, or with 0 once
+ * a SIGUSR2 restart has handed over or drained everything.
+ */
+inline int runUring(Reactor &r) {
+    if (!initUring(r.ring) || !initBufferRing(r.ring, r.buffers)) {
+        int error = errno;
+        logMessage(LOG_ERROR, "[ERROR] io_uring setup: {}", LogErrno{error});
+        if (r.ring.fd != -1) {
+            closeUring(r.ring);
+            freeBufferRing(r.buffers); // Already freed if it failed itself; safe again.
+        }
+        return error;
+    }
+    r.nextTag = 0;
+    r.acceptArmed = false;
+    r.acceptRetryNs = 0;
+    r.consoleClosed = false;
+    prepMultishotPoll(r.ring, r.inbox.eventfd, POLLIN, uringData(URING_POLL, r.inbox.eventfd, 0));
+    prepMultishotPoll(r.ring, r.handoffs.eventfd, POLLIN, uringData(URING_POLL, r.handoffs.eventfd, 0));
+    if (watchesConsole(r))
+        prepMultishotPoll(r.ring, STDIN_FILENO, POLLIN, uringData(URING_POLL, STDIN_FILENO, 0));
+    restoreSessions(r);
+
+    uint64_t enters = 0;
+    while (true) {
+        if (!checkUpgrade(r)) {
+            closeUring(r.ring);
+            freeBufferRing(r.buffers);
+            return 0;
+        }
+        if (r.accepting && !r.acceptArmed && monotonicNs() >= r.acceptRetryNs)
+            r.acceptArmed = prepMultishotAccept(r.ring, r.listenfd, 0, uringData(URING_ACCEPT, r.listenfd, 0));
+        int waitMs = timerWaitMs(r.timers);
+        if (r.accepting && !r.acceptArmed && (waitMs < 0 || waitMs > TIMER_TICK_MS))
+            waitMs = TIMER_TICK_MS;
+        bool ok = submitAndWait(r.ring, 1, waitMs);
+        count(*r.metrics, COUNT_IO_SYSCALLS, r.ring.enters - enters);
+        enters = r.ring.enters;
+        if (!ok) {
+            int error = errno;
+            logMessage(LOG_ERROR, "[ERROR] io_uring_enter(): {}", LogErrno{error});
+            closeUring(r.ring);
+            freeBufferRing(r.buffers);
+            return error;
+        }
+        struct io_uring_cqe *next;
+        while ((next = peekCqe(r.ring)) != nullptr) {
+            struct io_uring_cqe cqe = *next;
+            seenCqe(r.ring);
+            switch ((UringOp)(cqe.user_data >> 56)) {
+            case URING_ACCEPT: accepted(r, cqe); break;
+            case URING_RECV:   received(r, cqe); break;
+            case URING_SEND:   sent(r, cqe); break;
+            case URING_POLL:   polled(r, cqe); break;
+            case URING_CANCEL: break;
+            }
+            runReady(r);
+        }
+        advanceTimers(r.timers, [&r](TimerNode &node) { expireSession(r, (Session*)node.owner); });
+        runReady(r);
+    }
+}
+
+/*
+ * Function: runReactor
+ *
+ * Runs the event loop on an already listening socket, with the I/O
+ * backend opts.io names. Only returns if the loop fails, or once a
+ * SIGUSR2 restart is over for it.
+ */
+inline int runReactor(int listenfd, const ServerOptions &opts, int id = 0) {
+    Reactor r;
+    r.id = id;
+    r.listenfd = listenfd;
+    r.opts = &opts;
+    r.io = opts.io;
+    r.book.header = nullptr;
+    r.book.count = 0;
+    initTimerWheel(r.timers);
+    r.metrics = newThreadMetrics();
+    r.nextAnalysisId = 0;
+    r.nextGameSerial = 0;
+    r.upgrade = UPGRADE_NONE;
+    r.upgradeRound = 0;
+    r.accepting = true;
+    if (opts.bookPath && !openBook(r.book, opts.bookPath))
+        return 1;
+    if (!initInbox(r.inbox) || !initHandoffs(r.handoffs)) {
+        logMessage(LOG_ERROR, "[ERROR] eventfd(): {}", LogErrno{errno});
+        return errno;
+    }
+    handoffDirectory().inboxes[id].store(&r.handoffs, std::memory_order_release);
+    int status = r.io == IO_URING ? runUring(r) : runEpoll(r);
+    handoffDirectory().inboxes[id].store(nullptr, std::memory_order_release);
+    std::lock_guard<std::mutex> guard(r.inbox.lock); // The last pool thread to post to us may not have let go yet.
+    return status;
+}
+
+/*
+ * Function: openListener
+ *
+ * Another SO_REUSEPORT listener on `port`, for the second and later
+ * reactors. Returns the socket, or -1 with the error printed.
+ */
+inline int openListener(int port, int backlog) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        std::cerr << "[ERROR] socket(): " << strerror(errno) << std::endl;
+        return -1;
+    }
+    int on = 1;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0
+        || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(fd, backlog) != 0) {
+        std::cerr << "[ERROR] listener on port " << port << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// How many reactors --reactors asks for, resolving "auto" (0).
+inline int reactorCount(const ServerOptions &opts) {
+    if (opts.reactors > 0)
+        return opts.reactors;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+/*
+ * Function: runReactors
+ *
+ * Runs reactorCount() event loops. The first one takes `listenfd`,
+ * which main() opened with SO_REUSEPORT already set when there's more
+ * than one; the rest open their own listeners on the same port, or
+ * take over the ones a predecessor passed down (--inherit). Each
+ * thread is pinned to its own CPU (wrapping if there are more reactors
+ * than CPUs). --io uring is tried once here, and every reactor falls
+ * back to epoll if this kernel can't do it: sessions move between
+ * reactors, so they all have to use the same backend. Only returns if
+ * a reactor fails to start or its event loop fails.
+ */
+inline int runReactors(int listenfd, const ServerOptions &requested, int backlog) {
+    ServerOptions opts = requested;
+    if (opts.io == IO_URING && !uringAvailable()) {
+        logMessage(LOG_WARN, "[WARN] io_uring unavailable ({}), using epoll.", LogErrno{errno});
+        opts.io = IO_EPOLL;
+    }
+    logMessage(LOG_INFO, "[INFO] I/O backend: {}", opts.io == IO_URING ? "io_uring" : "epoll");
+    int count = reactorCount(opts);
+    initHandoffDirectory(count);
+    if (count == 1)
+        return runReactor(listenfd, opts);
+
+    struct sockaddr_in bound;
+    socklen_t length = sizeof(bound);
+    if (getsockname(listenfd, (struct sockaddr*)&bound, &length) != 0) {
+        std::cerr << "[ERROR] getsockname(): " << strerror(errno) << std::endl;
+        return errno;
+    }
+    std::vector<int> listeners(1, listenfd);
+    for (int i = 1; i < count; i++) {
+        int fd = (size_t)i < opts.inherited.size() ? opts.inherited[i] : openListener(ntohs(bound.sin_port), backlog);
+        if (fd == -1) {
+            for (int j = 1; j < i; j++)
+                close(listeners[j]);
+            return 1;
+        }
+        listeners.push_back(fd);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    std::vector<int> status(count, 0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; i++) {
+        threads.emplace_back([&, i]() { status[i] = runReactor(listeners[i], opts, i); });
+        if (cpus > 0) {
+            cpu_set_t cpu;
+            CPU_ZERO(&cpu);
+            CPU_SET(i % cpus, &cpu);
+            pthread_setaffinity_np(threads[i].native_handle(), sizeof(cpu), &cpu);
+        }
+    }
+    logMessage(LOG_INFO, "[INFO] {} reactors sharing port {}", count, (int)ntohs(bound.sin_port));
+    for (int i = 0; i < count; i++)
+        threads[i].join();
+    for (int i = 1; i < count; i++)
+        close(listeners[i]);
+    for (int i = 0; i < count; i++)
+        if (status[i] != 0)
+            return status[i];
+    return 0;
+}
+
+#endif // REACTOR_H
@@ -0,0 +1,211 @@
+/*
+ *  replay.cpp
+ *
+ *  -------------------------------------------------------------------
+ *  Reads the game archive the server writes with --archive (format in
+ *  archive.h), replays every game through the rule engine to check it,
+ *  and prints aggregate stats.
+ *
+ *      g++ -O2 -pthread replay.cpp -o run_replay.x
+ *      run_replay.x <archive> [--threads <n>] [--game <n>]
+ *
+ *  The file is mmap()ed and split into --threads equal runs of records
+ *  (default: one per online CPU), each replayed and tallied on its own
+ *  thread, then merged. Reports games/sec, how many games failed to
+ *  replay (with the first few indexes), results, the client's/server's
+ *  win and draw rates by the client's opening column, mean game length
+ *  and duration, and a histogram of game lengths in plies.
+ *
+ *  --game <n> instead prints game n (0-based): when and who, result,
+ *  the move list as column digits (the form playSequence() and the
+ *  server's BENCH_POSITIONS take) and the final board.
+ *  -------------------------------------------------------------------
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+
+#include "archive.h"
+#include "bitboard.h"
+
+const int MAX_PLIES = ROWS * COLS;
+const int MAX_BAD_SHOWN = 10;
+
+struct ReplayStats {
+    uint64_t games;
+    uint64_t bad;
+    uint64_t firstBad[MAX_BAD_SHOWN]; // Indexes of the first few bad games.
+    uint64_t byResult[RESULT_COUNT];
+    uint64_t byOpening[COLS][RESULT_COUNT]; // Client's first column -> results.
+    uint64_t lengths[MAX_PLIES + 1];
+    uint64_t plies;
+    uint64_t durationMs;
+};
+
+// Replays games [begin, end) into `stats`.
+void replayRange(const MappedArchive &archive, uint64_t begin, uint64_t end, ReplayStats &stats) {
+    Board board;
+    for (uint64_t g = begin; g < end; g++) {
+        const GameRecord &rec = archive.games[g];
+        stats.games++;
+        if (!replayGame(rec, board)) {
+            if (stats.bad < MAX_BAD_SHOWN)
+                stats.firstBad[stats.bad] = g;
+            stats.bad++;
+            continue;
+        }
+        stats.byResult[rec.result]++;
+        if (rec.moveCount > 0)
+            stats.byOpening[recordedMove(rec, 0)][rec.result]++;
+        stats.lengths[rec.moveCount]++;
+        stats.plies += rec.moveCount;
+        stats.durationMs += rec.durationMs;
+    }
+}
+
+// Adds `part` (a later run of games) into `total`.
+void mergeStats(ReplayStats &total, const ReplayStats &part) {
+    for (uint64_t i = 0; i < part.bad && total.bad + i < MAX_BAD_SHOWN; i++)
+        total.firstBad[total.bad + i] = part.firstBad[i];
+    total.games += part.games;
+    total.bad += part.bad;
+    for (int r = 0; r < RESULT_COUNT; r++) {
+        total.byResult[r] += part.byResult[r];
+        for (int c = 0; c < COLS; c++)
+            total.byOpening[c][r] += part.byOpening[c][r];
+    }
+    for (int p = 0; p <= MAX_PLIES; p++)
+        total.lengths[p] += part.lengths[p];
+    total.plies += part.plies;
+    total.durationMs += part.durationMs;
+}
+
+int showGame(const MappedArchive &archive, uint64_t g) {
+    if (g >= archive.count) {
+        std::cerr << "No game " << g << ": the archive has " << archive.count << ".\n";
+        return 1;
+    }
+    const GameRecord &rec = archive.games[g];
+    char when[32], ip[INET_ADDRSTRLEN];
+    time_t start = rec.startSec;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", gmtime(&start));
+    struct in_addr addr;
+    addr.s_addr = rec.peerAddr;
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+
+    Board board;
+    bool valid = replayGame(rec, board);
+    printf("game %llu: %s UTC, %s:%u, %.3f s\n", (unsigned long long)g, when, ip, rec.peerPort,
+           rec.durationMs / 1000.0);
+    printf("result: %s, %d plies%s\n", rec.result < RESULT_COUNT ? RESULT_NAMES[rec.result] : "?",
+           rec.moveCount, valid ? "" : " (DOES NOT REPLAY)");
+    printf("moves:  ");
+    for (int i = 0; i < rec.moveCount && i < MAX_PLIES; i++)
+        putchar('1' + recordedMove(rec, i));
+    printf("\n\n");
+    fflush(stdout);
+    printBoard(board);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <archive> [--threads <n>] [--game <n>]\n";
+        return 1;
+    }
+    const char *path = argv[1];
+    long threads = std::max(1L, (long)std::thread::hardware_concurrency());
+    long long game = -1;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atol(argv[++i]);
+        else if (strcmp(argv[i], "--game") == 0 && i + 1 < argc)
+            game = atoll(argv[++i]);
+        else {
+            std::cerr << "Bad or unknown option: " << argv[i] << "\n";
+            return 1;
+        }
+    }
+    if (threads <= 0) {
+        std::cerr << "--threads must be positive.\n";
+        return 1;
+    }
+
+    MappedArchive archive;
+    if (!mapArchive(archive, path))
+        return 1;
+    if (game >= 0) {
+        int status = showGame(archive, (uint64_t)game);
+        unmapArchive(archive);
+        return status;
+    }
+
+    if ((uint64_t)threads > archive.count)
+        threads = archive.count > 0 ? (long)archive.count : 1;
+    std::vector<ReplayStats> parts(threads, ReplayStats());
+    std::vector<uint64_t> begins(threads + 1);
+    for (long t = 0; t <= threads; t++)
+        begins[t] = archive.count * t / threads;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (long t = 0; t < threads; t++)
+        workers.emplace_back(replayRange, std::cref(archive), begins[t], begins[t + 1], std::ref(parts[t]));
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ReplayStats stats = ReplayStats();
+    for (long t = 0; t < threads; t++)
+        mergeStats(stats, parts[t]);
+    unmapArchive(archive);
+
+    printf("%llu games replayed in %.3f s (%ld threads, %.2f M games/sec)\n",
+           (unsigned long long)stats.games, seconds, threads, stats.games / (seconds + 1e-9) / 1e6);
+    printf("%llu failed to replay", (unsigned long long)stats.bad);
+    for (uint64_t i = 0; i < stats.bad && i < MAX_BAD_SHOWN; i++)
+        printf("%s%llu", i == 0 ? ": " : ", ", (unsigned long long)stats.firstBad[i]);
+    printf("%s\n", stats.bad > MAX_BAD_SHOWN ? ", ..." : "");
+
+    uint64_t good = stats.games - stats.bad;
+    if (good == 0)
+        return stats.bad ? 2 : 0;
+    printf("\nresult       games        share\n");
+    for (int r = 0; r < RESULT_COUNT; r++)
+        printf("%-12s %-12llu %6.2f%%\n", RESULT_NAMES[r], (unsigned long long)stats.byResult[r],
+               100.0 * stats.byResult[r] / good);
+    printf("\nmean length %.2f plies, mean duration %.3f s\n", (double)stats.plies / good,
+           stats.durationMs / 1000.0 / good);
+
+    // Finished games only: a timeout or a hang-up says nothing about the opening.
+    printf("\nfirst move   games        client    server    draws\n");
+    for (int c = 0; c < COLS; c++) {
+        const uint64_t *o = stats.byOpening[c];
+        uint64_t n = o[RESULT_CLIENT_WIN] + o[RESULT_SERVER_WIN] + o[RESULT_TIE];
+        if (n == 0)
+            continue;
+        printf("    %d        %-12llu %6.2f%%   %6.2f%%   %6.2f%%\n", c + 1, (unsigned long long)n,
+               100.0 * o[RESULT_CLIENT_WIN] / n, 100.0 * o[RESULT_SERVER_WIN] / n, 100.0 * o[RESULT_TIE] / n);
+    }
+
+    printf("\nplies  games        share\n");
+    for (int p = 0; p <= MAX_PLIES; p++) {
+        if (stats.lengths[p] == 0)
+            continue;
+        double share = 100.0 * stats.lengths[p] / good;
+        printf("%5d  %-12llu %6.2f%% ", p, (unsigned long long)stats.lengths[p], share);
+        for (int bar = 0; bar < (int)(share * 4 + 0.5); bar++)
+            putchar('#');
+        putchar('\n');
+    }
+    return stats.bad ? 2 : 0;
+}
@@ -0,0 +1,665 @@
+/*
+ *  search.h
+ *
+ *  -------------------------------------------------------------------
+ *  Built-in AI opponent so the server can play without someone typing
+ *  moves at the console (run_server.x <port> --ai <ms>).
+ *
+ *  Negamax with alpha-beta pruning on top of the bitboard engine:
+ *   • moves are tried center-first, with the transposition table's
+ *     best move from an earlier iteration tried before all of them;
+ *   • iterative deepening, so whenever the time budget runs out we
+ *     still have the best move of the last fully searched depth;
+ *   • a fixed-size transposition table, allocated once.
+ *
+ *  With --threads N the search is "lazy SMP": N threads run the same
+ *  iterative deepening on the same root and share nothing but the
+ *  transposition table and a stop flag. Helpers start at staggered
+ *  depths and root orders so they fill the table with results the
+ *  main thread then picks up. Helper threads are started the first
+ *  time a thread searches with --threads > 1 and then park on a
+ *  condition variable between moves (searchHelpers()), so an AI move
+ *  costs a wakeup rather than thread creation. The table is lock-free: each slot is two
+ *  64-bit words written independently, with the key stored XORed with
+ *  the data, so a torn write from two threads just reads as a miss.
+ *
+ *  In the server that table is process-wide (sharedTable(), --tt-mb):
+ *  every reactor's AI moves and every ANALYZE search read and write
+ *  the same one, so an opening or middlegame position searched for one
+ *  game is already there for the next. Positions are keyed by
+ *  canonicalKey(), so a position and its mirror share an entry. Each
+ *  bucket keeps a depth-preferred and an always-replace slot, and
+ *  searches count probes and hits so the size can be tuned from the
+ *  tt_hit_rate stat.
+ *
+ *  Scores are from the side to move's point of view. A win is worth
+ *  WIN_SCORE plus the number of empty cells left when it lands, so
+ *  quicker wins score higher; anything else is a heuristic well below
+ *  WIN_SCORE.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+
+#include "bitboard.h"
+
+const int WIN_SCORE = 1000;
+const int INF_SCORE = 10000;
+const int TT_MEGABYTES = 64; // Default size; the server takes --tt-mb.
+const int TT_MAX_MEGABYTES = 65536; // Largest --tt-mb we accept.
+const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+const int MOVE_ORDER[COLS] = { 3, 2, 4, 1, 5, 0, 6 }; // Center columns first.
+
+enum TTFlag {
+    TT_EMPTY = 0,
+    TT_EXACT,
+    TT_LOWER, // Failed high: real score >= stored score.
+    TT_UPPER  // Failed low:  real score <= stored score.
+};
+
+// Unpacked form of a table slot.
+struct TTEntry {
+    int  score;
+    int  depth;
+    int  flag;
+    int  move; // Best column found, -1 if none.
+};
+
+// data = score:16 | depth:8 | flag:8 | (move + 1):8, check = key ^ data.
+struct TTSlot {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+};
+
+// Two slots per bucket, two buckets per cache line. slots[0] keeps the
+// deepest result seen for its positions, slots[1] always takes the
+// latest, so shallow churn from every game in flight can't push out
+// the expensive entries near the top of the tree.
+struct alignas(32) TTBucket {
+    TTSlot slots[2];
+};
+
+struct TranspositionTable {
+    TTBucket *buckets = nullptr;
+    uint64_t mask = 0;      // Bucket count - 1, the count is a power of two.
+    size_t mappedBytes = 0;
+    bool hugePages = false; // Backed by MAP_HUGETLB pages rather than THP hints.
+};
+
+struct SearchContext {
+    TranspositionTable *tt;
+    std::chrono::steady_clock::time_point deadline;
+    const std::atomic<bool> *stop; // Shared by every thread in one search.
+    uint64_t nodes;
+    uint64_t probes; // Table lookups, and how many found their position.
+    uint64_t hits;
+    bool canStop; // The main thread's depth 1 always finishes so we never return without a move.
+    bool stopped;
+};
+
+struct SearchResult {
+    int column;     // 0-based, -1 if the board is full.
+    int score;
+    int depth;      // Deepest fully searched depth.
+    uint64_t nodes;
+    uint64_t probes;
+    uint64_t hits;
+    double ms;
+    int threads;
+};
+
+inline void freeTable(TranspositionTable &tt) {
+    if (tt.buckets)
+        munmap(tt.buckets, tt.mappedBytes);
+    tt.buckets = nullptr;
+    tt.mask = 0;
+    tt.mappedBytes = 0;
+}
+
+/*
+ * Function: initTable
+ *
+ * (Re)allocates the table as the largest power-of-two bucket count
+ * that fits in `megabytes`, zeroed and already faulted in so searches
+ * never take page faults on it. With
+ * hugePages it first asks for explicit 2 MB pages (MAP_HUGETLB, needs
+ * vm.nr_hugepages) and otherwise falls back to normal pages with a
+ * transparent huge page hint. Returns false if there's no memory.
+ */
+inline bool initTable(TranspositionTable &tt, size_t megabytes, bool hugePages = false) {
+    freeTable(tt);
+    size_t count = 1;
+    while (count * 2 * sizeof(TTBucket) <= megabytes * 1024 * 1024)
+        count *= 2;
+    size_t bytes = count * sizeof(TTBucket);
+    void *mem = MAP_FAILED;
+    tt.hugePages = false;
+    if (hugePages) {
+        tt.mappedBytes = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        mem = mmap(nullptr, tt.mappedBytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        tt.hugePages = mem != MAP_FAILED;
+    }
+    if (mem == MAP_FAILED) {
+        tt.mappedBytes = bytes;
+        mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            return false;
+        if (hugePages)
+            madvise(mem, bytes, MADV_HUGEPAGE); // Best effort, before the pages are touched.
+        madvise(mem, bytes, MADV_WILLNEED);
+        memset(mem, 0, bytes); // Fault it all in now, not mid-search.
+    }
+    tt.buckets = (TTBucket*)mem; // Anonymous memory is zeroed: every slot empty.
+    tt.mask = count - 1;
+    return true;
+}
+
+// Empties the table without giving its memory back.
+inline void clearTable(TranspositionTable &tt) {
+    memset((void*)tt.buckets, 0, (tt.mask + 1) * sizeof(TTBucket));
+}
+
+/*
+ * Function: sharedTable
+ *
+ * The server's one position cache, used by every reactor's AI moves
+ * and by the ANALYZE pool. Allocated once at startup with initTable().
+ */
+inline TranspositionTable &sharedTable() {
+    static TranspositionTable tt;
+    return tt;
+}
+
+inline TTBucket &tableBucket(TranspositionTable &tt, uint64_t key) {
+    return tt.buckets[((key * 0x9E3779B97F4A7C15ULL) >> 32) & tt.mask];
+}
+
+inline bool readSlot(const TTSlot &slot, uint64_t key, TTEntry &out) {
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    uint64_t check = slot.check.load(std::memory_order_relaxed);
+    if (data == 0 || (check ^ data) != key)
+        return false;
+    out.score = (int16_t)(data & 0xFFFF);
+    out.depth = (data >> 16) & 0xFF;
+    out.flag = (data >> 24) & 0xFF;
+    out.move = (int)((data >> 32) & 0xFF) - 1;
+    return true;
+}
+
+// `key` is a canonicalKey(); moves are stored in its orientation.
+inline bool probeTable(TranspositionTable &tt, uint64_t key, TTEntry &out) {
+    TTBucket &bucket = tableBucket(tt, key);
+    return readSlot(bucket.slots[0], key, out) || readSlot(bucket.slots[1], key, out);
+}
+
+inline void storeTable(TranspositionTable &tt, uint64_t key, int score, int depth, int flag, int move) {
+    uint64_t data = (uint64_t)(uint16_t)score | (uint64_t)depth << 16 | (uint64_t)flag << 24 | (uint64_t)(move + 1) << 32;
+    TTBucket &bucket = tableBucket(tt, key);
+    TTSlot &deep = bucket.slots[0];
+    uint64_t old = deep.data.load(std::memory_order_relaxed);
+    bool same = (deep.check.load(std::memory_order_relaxed) ^ old) == key;
+    TTSlot &slot = same || (int)((old >> 16) & 0xFF) <= depth ? deep : bucket.slots[1];
+    slot.check.store(key ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+}
+
+// Win for the side that just moved, when it lands on move number `moves`.
+inline int winScore(int moves) {
+    return WIN_SCORE + (ROWS * COLS - moves);
+}
+
+/*
+ * Function: winningCells
+ *
+ * Every empty cell that would complete four in a row for `pos`,
+ * checked in all four directions at once with shifts.
+ */
+inline uint64_t winningCells(uint64_t pos, uint64_t mask) {
+    // Vertical: three stacked stones with the cell above them.
+    uint64_t r = (pos << 1) & (pos << 2) & (pos << 3);
+
+    const int shifts[3] = { COL_BITS, COL_BITS - 1, COL_BITS + 1 };
+    for (int i = 0; i < 3; i++) {
+        int d = shifts[i];
+        uint64_t p = (pos << d) & (pos << (2 * d));
+        r |= p & (pos << (3 * d)); // _XXX
+        r |= p & (pos >> d);       // X_XX
+        p = (pos >> d) & (pos >> (2 * d));
+        r |= p & (pos << d);       // XX_X
+        r |= p & (pos >> (3 * d)); // XXX_
+    }
+    return r & (FULL_MASK ^ mask);
+}
+
+inline int popcount(uint64_t x) {
+    return __builtin_popcountll(x);
+}
+
+// Open threats plus a nudge towards the center column.
+inline int evaluate(const Board &b) {
+    int side = b.moves & 1;
+    uint64_t me = b.pieces[side], opp = b.pieces[side ^ 1];
+    uint64_t mask = me | opp;
+    int score = 4 * (popcount(winningCells(me, mask)) - popcount(winningCells(opp, mask)));
+    score += popcount(me & columnMask(3)) - popcount(opp & columnMask(3));
+    return score;
+}
+
+inline void playColumn(Board &b, int col) {
+    b.pieces[b.moves & 1] |= uint64_t(1) << (col * COL_BITS + b.heights[col]);
+    b.heights[col]++;
+    b.moves++;
+}
+
+inline bool timeUp(SearchContext &ctx) {
+    if (ctx.canStop && (ctx.nodes & 1023) == 0) {
+        if (ctx.stop->load(std::memory_order_relaxed) || std::chrono::steady_clock::now() >= ctx.deadline)
+            ctx.stopped = true;
+    }
+    return ctx.stopped;
+}
+
+/*
+ * Function: negamax
+ *
+ * Alpha-beta negamax to `depth` plies. Returns 0 once the deadline
+ * has passed; the caller throws away any iteration that got stopped.
+ */
+inline int negamax(SearchContext &ctx, const Board &b, int depth, int alpha, int beta) {
+    ctx.nodes++;
+    if (timeUp(ctx))
+        return 0;
+    if (b.moves >= ROWS * COLS)
+        return 0;
+
+    int side = b.moves & 1;
+    uint64_t me = b.pieces[side], opp = b.pieces[side ^ 1];
+    uint64_t mask = me | opp;
+    uint64_t playable = (mask + BOTTOM_MASK) & FULL_MASK;
+
+    if (winningCells(me, mask) & playable)
+        return winScore(b.moves + 1);
+
+    // Must block an immediate threat; two of them can't both be blocked.
+    uint64_t oppWins = winningCells(opp, mask);
+    uint64_t forced = playable & oppWins;
+    if (forced) {
+        if (forced & (forced - 1))
+            return -winScore(b.moves + 2);
+        playable = forced;
+    }
+    // Never play directly underneath one of the opponent's winning cells.
+    playable &= ~(oppWins >> 1);
+    if (!playable)
+        return -winScore(b.moves + 2);
+
+    if (depth == 0)
+        return evaluate(b);
+
+    int alphaOrig = alpha;
+    bool mirrored;
+    uint64_t key = canonicalKey(b, mirrored);
+    TTEntry hit;
+    int ttMove = -1;
+    ctx.probes++;
+    if (probeTable(*ctx.tt, key, hit)) {
+        ctx.hits++;
+        ttMove = hit.move >= 0 && mirrored ? COLS - 1 - hit.move : hit.move;
+        if (hit.depth >= depth) {
+            if (hit.flag == TT_EXACT)
+                return hit.score;
+            if (hit.flag == TT_LOWER && hit.score > alpha)
+                alpha = hit.score;
+            else if (hit.flag == TT_UPPER && hit.score < beta)
+                beta = hit.score;
+            if (alpha >= beta)
+                return hit.score;
+        }
+    }
+
+    int best = -INF_SCORE;
+    int bestMove = -1;
+    for (int i = -1; i < COLS; i++) {
+        int col = i < 0 ? ttMove : MOVE_ORDER[i];
+        if (col < 0 || (i >= 0 && col == ttMove))
+            continue;
+        if (!(playable & columnMask(col)))
+            continue;
+        Board child = b;
+        playColumn(child, col);
+        int score = -negamax(ctx, child, depth - 1, -beta, -alpha);
+        if (ctx.stopped)
+            return 0;
+        if (score > best) {
+            best = score;
+            bestMove = col;
+        }
+        if (score > alpha)
+            alpha = score;
+        if (alpha >= beta)
+            break;
+    }
+
+    int flag = best <= alphaOrig ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT;
+    storeTable(*ctx.tt, key, best, depth, flag, bestMove >= 0 && mirrored ? COLS - 1 - bestMove : bestMove);
+    return best;
+}
+
+/*
+ * Function: iterativeDeepening
+ *
+ * One thread's share of the search: depth firstDepth, firstDepth + 1,
+ * ... until solved, out of board, out of time, maxDepth reached (0 =
+ * no limit), or another thread raises the stop flag. `result` always
+ * holds the deepest completed iteration.
+ */
+inline void iterativeDeepening(SearchContext &ctx, const Board &board, const int *order, int legal,
+                               int firstDepth, int maxDepth, SearchResult &result) {
+    int rootOrder[COLS];
+    for (int i = 0; i < legal; i++)
+        rootOrder[i] = order[i];
+
+    int lastDepth = ROWS * COLS - board.moves;
+    if (maxDepth > 0 && maxDepth < lastDepth)
+        lastDepth = maxDepth;
+
+    for (int depth = firstDepth; depth <= lastDepth; depth++) {
+        int alpha = -INF_SCORE;
+        int bestCol = -1;
+        for (int i = 0; i < legal; i++) {
+            Board child = board;
+            playColumn(child, rootOrder[i]);
+            int score = -negamax(ctx, child, depth - 1, -INF_SCORE, -alpha);
+            if (ctx.stopped)
+                break;
+            if (score > alpha) {
+                alpha = score;
+                bestCol = i;
+            }
+        }
+        if (ctx.stopped)
+            break;
+        ctx.canStop = true;
+
+        result.column = rootOrder[bestCol];
+        result.score = alpha;
+        result.depth = depth;
+
+        // Search last iteration's best move first next time.
+        int moved = rootOrder[bestCol];
+        for (int i = bestCol; i > 0; i--)
+            rootOrder[i] = rootOrder[i - 1];
+        rootOrder[0] = moved;
+
+        if (alpha >= WIN_SCORE || alpha <= -WIN_SCORE)
+            break; // Solved, deeper search can't change the result.
+    }
+}
+
+// One searching thread's lazy-SMP helpers. The team only grows, up to
+// the largest --threads that thread has asked for, and is joined when
+// the owning thread exits.
+struct SearchHelpers {
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::vector<std::thread> threads;
+    std::function<void(int)> job;
+    uint64_t round = 0;
+    int wanted = 0;   // Helpers 1..wanted take part in this round.
+    int finished = 0;
+    bool quit = false;
+
+    ~SearchHelpers() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+};
+
+// One helper: parks on `wake` until the next round, runs job(t) if
+// index t takes part in it, and reports on `done`.
+inline void runSearchHelper(SearchHelpers &team, int t, uint64_t seen) {
+    std::unique_lock<std::mutex> guard(team.lock);
+    for (;;) {
+        team.wake.wait(guard, [&]() { return team.quit || team.round != seen; });
+        if (team.quit)
+            return;
+        seen = team.round;
+        if (t > team.wanted)
+            continue;
+        guard.unlock();
+        team.job(t);
+        guard.lock();
+        if (++team.finished == team.wanted)
+            team.done.notify_one();
+    }
+}
+
+/*
+ * Function: searchHelpers
+ *
+ * The calling thread's helper team: each reactor, each ANALYZE worker
+ * and the benches get their own, so searches from different threads
+ * never wait on each other's helpers.
+ */
+inline SearchHelpers &searchHelpers() {
+    thread_local SearchHelpers team;
+    return team;
+}
+
+/*
+ * Function: runHelpers
+ *
+ * Runs job(1..count) on the calling thread's helpers, growing the team
+ * if needed, while the caller runs `main`; returns once every helper
+ * has finished its part.
+ */
+inline void runHelpers(int count, const std::function<void(int)> &job, const std::function<void()> &main) {
+    SearchHelpers &team = searchHelpers();
+    {
+        std::lock_guard<std::mutex> guard(team.lock);
+        while ((int)team.threads.size() < count) {
+            int t = (int)team.threads.size() + 1;
+            team.threads.emplace_back(runSearchHelper, std::ref(team), t, team.round);
+        }
+        team.job = job;
+        team.wanted = count;
+        team.finished = 0;
+        team.round++;
+    }
+    team.wake.notify_all();
+    main();
+    std::unique_lock<std::mutex> guard(team.lock);
+    team.done.wait(guard, [&]() { return team.finished == team.wanted; });
+    team.job = nullptr;
+}
+
+/*
+ * Function: searchMove
+ *
+ * Picks the side to move's best column within budgetMs (or to exactly
+ * maxDepth plies if maxDepth > 0), using `threads` lazy-SMP threads.
+ * The calling thread is the main thread; its deepest completed
+ * iteration wins unless a helper got strictly deeper.
+ */
+inline SearchResult searchMove(TranspositionTable &tt, const Board &board, int budgetMs,
+                               int threads = 1, int maxDepth = 0) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = maxDepth > 0
+        ? std::chrono::steady_clock::time_point::max()
+        : start + std::chrono::milliseconds(budgetMs);
+    std::atomic<bool> stop(false);
+
+    SearchResult result;
+    result.column = -1;
+    result.score = 0;
+    result.depth = 0;
+    result.nodes = 0;
+    result.probes = 0;
+    result.hits = 0;
+    result.threads = threads;
+
+    int rootOrder[COLS];
+    int legal = 0;
+    for (int i = 0; i < COLS; i++)
+        if (board.heights[MOVE_ORDER[i]] < ROWS)
+            rootOrder[legal++] = MOVE_ORDER[i];
+
+    // Take an immediate win without searching.
+    for (int i = 0; i < legal; i++) {
+        Board child = board;
+        playColumn(child, rootOrder[i]);
+        if (hasFour(child.pieces[board.moves & 1])) {
+            result.column = rootOrder[i];
+            result.score = winScore(child.moves);
+            legal = 0;
+            break;
+        }
+    }
+
+    if (legal > 0) {
+        std::vector<SearchContext> contexts(threads);
+        std::vector<SearchResult> results(threads, result);
+        for (int t = 0; t < threads; t++) {
+            contexts[t].tt = &tt;
+            contexts[t].deadline = deadline;
+            contexts[t].stop = &stop;
+            contexts[t].nodes = 0;
+            contexts[t].probes = 0;
+            contexts[t].hits = 0;
+            contexts[t].canStop = t > 0;
+            contexts[t].stopped = false;
+        }
+
+        if (threads > 1) {
+            runHelpers(threads - 1, [&](int t) {
+                // Rotate the root order and stagger the start depth so
+                // helpers don't all walk the same tree in lockstep.
+                int order[COLS];
+                for (int i = 0; i < legal; i++)
+                    order[i] = rootOrder[(i + t) % legal];
+                iterativeDeepening(contexts[t], board, order, legal, 1 + t % 2, maxDepth, results[t]);
+            }, [&]() {
+                iterativeDeepening(contexts[0], board, rootOrder, legal, 1, maxDepth, results[0]);
+                stop.store(true, std::memory_order_relaxed);
+            });
+        } else {
+            iterativeDeepening(contexts[0], board, rootOrder, legal, 1, maxDepth, results[0]);
+        }
+
+        result = results[0];
+        for (int t = 1; t < threads; t++)
+            if (results[t].depth > result.depth)
+                result = results[t];
+        result.nodes = 0;
+        result.probes = 0;
+        result.hits = 0;
+        for (int t = 0; t < threads; t++) {
+            result.nodes += contexts[t].nodes;
+            result.probes += contexts[t].probes;
+            result.hits += contexts[t].hits;
+        }
+        result.threads = threads;
+    }
+
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Per-column scores for ANALYZE (see analysis.h).
+struct Analysis {
+    int depth;         // Deepest iteration completed for every column.
+    int scores[COLS];  // Side to move's score for playing each column, NO_SCORE if full.
+    bool solved;       // Every score is an exact win, loss or draw; deeper won't change it.
+    uint64_t nodes;
+    uint64_t probes;
+    uint64_t hits;
+    double ms;
+};
+
+const int NO_SCORE = -INF_SCORE;
+
+/*
+ * Function: analyzePosition
+ *
+ * Scores every column for the side to move, not just the best one, so
+ * each root move gets a full-window search instead of the alpha-beta
+ * bound searchMove() uses. Iterative deepening makes it anytime: the
+ * result is the deepest depth that finished for all seven columns
+ * inside budgetMs (depth 1 always finishes). Single-threaded; the
+ * caller runs several of these side by side on one shared table.
+ */
+inline Analysis analyzePosition(TranspositionTable &tt, const Board &board, int budgetMs) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<bool> stop(false);
+    SearchContext ctx;
+    ctx.tt = &tt;
+    ctx.deadline = start + std::chrono::milliseconds(budgetMs);
+    ctx.stop = &stop;
+    ctx.nodes = 0;
+    ctx.probes = 0;
+    ctx.hits = 0;
+    ctx.canStop = false;
+    ctx.stopped = false;
+
+    Analysis result;
+    result.depth = 0;
+    result.solved = false;
+    for (int c = 0; c < COLS; c++)
+        result.scores[c] = NO_SCORE;
+
+    int scores[COLS];
+    int lastDepth = ROWS * COLS - board.moves;
+    for (int depth = 1; depth <= lastDepth; depth++) {
+        bool solved = true;
+        for (int c = 0; c < COLS && !ctx.stopped; c++) {
+            scores[c] = NO_SCORE;
+            if (board.heights[c] >= ROWS)
+                continue;
+            Board child = board;
+            playColumn(child, c);
+            if (hasFour(child.pieces[board.moves & 1])) {
+                scores[c] = winScore(child.moves);
+                continue;
+            }
+            scores[c] = -negamax(ctx, child, depth - 1, -INF_SCORE, INF_SCORE);
+            bool exact = scores[c] >= WIN_SCORE || scores[c] <= -WIN_SCORE || depth >= lastDepth;
+            solved = solved && exact;
+        }
+        if (ctx.stopped)
+            break;
+        ctx.canStop = true;
+        result.depth = depth;
+        result.solved = solved;
+        for (int c = 0; c < COLS; c++)
+            result.scores[c] = scores[c];
+        if (solved)
+            break;
+    }
+    result.nodes = ctx.nodes;
+    result.probes = ctx.probes;
+    result.hits = ctx.hits;
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+#endif // SEARCH_H
@@ -0,0 +1,767 @@
+/*
+ *  session.h
+ *
+ *  -------------------------------------------------------------------
+ *  One game = one Session. This is the old blocking game loop from
+ *  main() turned inside out into a state machine, so a single thread
+ *  can drive thousands of games: the reactor feeds it complete lines
+ *  from the socket and the console, and the session queues whatever
+ *  it wants to send on its Connection for the reactor to flush when
+ *  the socket is writable.
+ *
+ *  States (same steps as the old loop):
+ *    AWAIT_MOVE        - initial board sent, waiting for "MOVE <col>".
+ *    AWAIT_SERVER_MOVE - client's move applied, waiting on the server.
+ *    GAME_OVER         - final board queued, close once it's flushed.
+ *  and for player-vs-player games (--pvp, see lobby.h):
+ *    LOBBY             - connected, waiting to be paired; nothing sent.
+ *    AWAIT_OPPONENT    - the other player's turn.
+ *  and for spectators ("WATCH <game-id>"):
+ *    SPECTATING        - receives the watched game's frames; its own
+ *                        board is unused. GAME_OVER once the game ends.
+ *  and for multiplexed connections ("PROTOCOL MUX", see protocol.h):
+ *    MULTIPLEXED       - carries the games on its channels and plays
+ *                        none itself.
+ *  and for "RESUME <token>" naming a game on another reactor:
+ *    RESUMING          - on its way there; it's adopted into the game.
+ *
+ *  A multiplexed game is a Session of its own with no socket: `link`
+ *  is the connection carrying it. Its lines are fed into its input
+ *  buffer by the reactor and its output is taken off its queue and
+ *  framed onto the link's `muxOut`, so the state machine below can't
+ *  tell it from a game with a connection of its own.
+ *
+ *  In a PvP game each player has their own Session, both on the same
+ *  reactor and linked through `opponent`. Both hold the real board
+ *  (seat 0 moved first and plays 'C'); everything sent is from the
+ *  player's own point of view, so seat 1's frames swap the two colours.
+ *  A move is checked on the mover's session and replayed on the
+ *  opponent's with applyServerMove(), the same call a server move uses.
+ *
+ *  The reactor keeps a deadline on every session (see timer.h): a
+ *  client that takes too long over its move, or never says anything
+ *  at all, gets timeOutSession() and forfeits.
+ *
+ *  Each session keeps its "BOARD\n" + board text rendered in `frame`.
+ *  A move patches the one byte it changed and every send queues the
+ *  frame by reference, so a turn allocates nothing: no formatting, no
+ *  strings, and MOVE lines are parsed straight out of the receive
+ *  buffer.
+ *
+ *  A game whose first line was "VARIANT <name>" is played on that
+ *  variant's board (variants.h) instead: `variant` says which, and
+ *  `variantBoard` stands in for `board`, which stays empty. The frame
+ *  is sized for the largest board; `frameSize` is this game's.
+ *
+ *  Every move and the outcome also go into `record`, which the reactor
+ *  hands to the game archive (archive.h) when the session closes. A
+ *  PvP game is archived once, from seat 0, so there "client" means the
+ *  player who moved first and "server" the second.
+ *
+ *  A client that asks ("TOKEN") gets a `token` it can RESUME the game
+ *  with from a new connection. If its connection drops mid-game, the
+ *  reactor parks the session instead of closing it: no socket
+ *  (conn.fd == -1), nothing queued, the game exactly as it was. The
+ *  new connection's socket is then moved into the parked session, so
+ *  the game, its id and its spectators carry on. snapshotSession() and
+ *  restoreSession() turn a game into a SessionSnapshot (snapshot.h)
+ *  and back, for handing it to a restarted server.
+ *
+ *  Spectators hang off the game's seat 0 session (`watchers`). They
+ *  all get the same frame: seat 0's rendered board plus a spectator
+ *  turn line (WATCH_STATUS_TEXT), built once per change into an
+ *  immutable shared buffer (watchFrame) that every spectator queues by
+ *  reference. `watchStale` says the game has moved on since; the
+ *  reactor renders and fans out the new frame when it flushes the game.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+
+#include "analysis.h"
+#include "archive.h"
+#include "bitboard.h"
+#include "connection.h"
+#include "log.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "snapshot.h"
+#include "timer.h"
+#include "uring.h"
+#include "variants.h"
+
+enum SessionState {
+    AWAIT_MOVE,
+    AWAIT_SERVER_MOVE,
+    GAME_OVER,
+    LOBBY,
+    AWAIT_OPPONENT,
+    SPECTATING,
+    MULTIPLEXED,
+    RESUMING
+};
+
+struct LobbyTicket; // lobby.h
+
+// What handleClientLine() made of a line, for the reactor's metrics.
+enum LineResult {
+    LINE_MOVE,    // A legal move, now on the board.
+    LINE_INVALID, // Answered with INVALID_MOVE.
+    LINE_CONTROL, // PROTOCOL BINARY or RESYNC.
+    LINE_ANALYZE, // "ANALYZE <ms>": the reactor owes the client an answer.
+    LINE_WATCH,   // "WATCH <game-id>": the reactor makes it a spectator.
+    LINE_MUX,     // "PROTOCOL MUX": the reactor makes it a multiplexed connection.
+    LINE_TOKEN,   // "TOKEN": the reactor issues (or repeats) the game's resume token.
+    LINE_RESUME,  // "RESUME <token>": the reactor moves the connection into that game.
+    LINE_VARIANT  // "VARIANT <name>": the reactor switches the game to that board, or refuses.
+};
+
+enum TimerKind {
+    TIMER_NONE,      // Not armed (the server's turn).
+    TIMER_HANDSHAKE, // Connected, but hasn't sent a line yet.
+    TIMER_MOVE,      // The client's turn.
+    TIMER_IDLE,      // Game over, final frame not drained yet.
+    TIMER_RESUME     // Parked: the client has this long to RESUME.
+};
+
+const size_t FRAME_HEADER_TEXT = 6; // "BOARD\n"
+
+struct Session {
+    Connection conn;
+    UringIo io;           // The socket's io_uring state, under --io uring only.
+    struct sockaddr_in addr;
+    Board board;
+    const Variant *variant;    // The game's board if not Classic's, see variants.h...
+    VariantBoard variantBoard; // ...and where it's played instead of `board`.
+    const Variant *askedVariant; // The board a "VARIANT <name>" line asked for.
+    SessionState state;
+    bool binary;  // Switched to binary frames with "PROTOCOL BINARY".
+    uint32_t seq; // Next binary frame's sequence number.
+    bool heard;   // The client has sent at least one line.
+    TimerNode timer;      // The current deadline; the reactor arms it.
+    TimerKind timerKind;  // What `timer` is armed for.
+    int timerMoves;       // board.moves when the move deadline was armed.
+    uint64_t replyStart;  // When the line now being answered arrived (ns), 0 if none.
+    uint64_t acceptedNs;  // When the connection was accepted (ns), for the archive.
+    int analyzeMs;        // Budget of the ANALYZE request just read.
+    bool analyzing;       // An ANALYZE is out on the pool; hold further lines.
+    uint64_t analysisId;  // Which request that is, see analysis.h.
+    uint64_t engineId;    // AWAIT_SERVER_MOVE: the --ai search out on the pool for our move, 0 if none.
+    int seat;             // 0 = moves first ('C'), 1 = second; always 0 against the server.
+    Session *opponent;    // The other player's session in a PvP game, else nullptr.
+    LobbyTicket *ticket;  // Our place in the lobby while in LOBBY, see lobby.h.
+    LobbyTicket *claimed; // The waiting player we're being handed over to.
+    Session *nextHandoff; // Link in a reactor's HandoffInbox.
+    GameRecord record;    // Moves and result so far, see archive.h.
+    uint64_t gameId;      // What WATCH calls this game; 0 unless a game's seat 0 session.
+    std::vector<Session*> watchers; // Spectators of this game.
+    SharedFrame watchFrame; // Last frame rendered for them...
+    bool watchStale;        // ...and whether the game has changed since.
+    uint64_t watchId;     // Spectators: the game asked for.
+    Session *watching;    // Spectators: that game's session, once attached.
+    size_t watchIndex;    // Spectators: our place in watching->watchers.
+    Session *link;        // Multiplexed games: the connection carrying us, else nullptr...
+    uint32_t channel;     // ...and what the client calls us on it.
+    std::unordered_map<uint32_t, Session*> channels; // MULTIPLEXED: our games by channel.
+    std::vector<char> muxOut; // MULTIPLEXED: frames not yet queued on the socket.
+    bool muxReading;      // MULTIPLEXED: in the middle of our lines; our games needn't wake us.
+    bool muxWoken;        // MULTIPLEXED: a read is already deferred.
+    bool stalled;         // Stopped taking lines until the socket takes our output.
+    uint64_t token;       // What RESUME calls this game; 0 until the client asks for it.
+    uint64_t resumeToken; // The game a "RESUME <token>" line asked for.
+    char frame[FRAME_HEADER_TEXT + VARIANT_BOARD_TEXT]; // "BOARD\n" + rendered board...
+    size_t frameSize;                                   // ...this many bytes of it.
+};
+
+// A game whose connection dropped, waiting for RESUME. (A multiplexed
+// game has no socket either, but it has a link.)
+inline bool isParked(const Session &s) {
+    return s.conn.fd == -1 && !s.link;
+}
+
+// The session's own stones as 'C', whichever seat it's in.
+inline char viewPiece(const Session &s, char piece) {
+    return s.seat == 0 ? piece : piece == 'C' ? 'S' : 'C';
+}
+
+// Pieces on the board, whichever board the game is on.
+inline int movesPlayed(const Session &s) {
+    return s.variant ? s.variant->moves(s.variantBoard) : s.board.moves;
+}
+
+inline Board viewBoard(const Session &s) {
+    Board view = s.board;
+    if (s.seat == 1)
+        std::swap(view.pieces[0], view.pieces[1]);
+    return view;
+}
+
+inline void renderFrame(Session &s) {
+    memcpy(s.frame, "BOARD\n", FRAME_HEADER_TEXT);
+    if (s.variant) {
+        s.variant->render(s.variantBoard, s.frame + FRAME_HEADER_TEXT);
+        s.frameSize = FRAME_HEADER_TEXT + s.variant->rows * s.variant->cols * 2;
+        return;
+    }
+    renderBoard(viewBoard(s), s.frame + FRAME_HEADER_TEXT);
+    s.frameSize = FRAME_HEADER_TEXT + BOARD_TEXT;
+}
+
+// The game's board, Classic's or its variant's: drop a piece...
+inline int dropMove(Session &s, int col, char piece) {
+    if (s.variant)
+        return s.variant->drop(s.variantBoard, col, pieceIndex(piece));
+    return dropPiece(s.board, col, piece);
+}
+
+// ...did it win...
+inline bool wonWith(const Session &s, int row, int col, char piece) {
+    if (s.variant)
+        return s.variant->won(s.variantBoard, pieceIndex(piece));
+    return checkWin(s.board, row, col, piece);
+}
+
+// ...and is the board full.
+inline bool boardFull(const Session &s) {
+    return s.variant ? s.variant->full(s.variantBoard) : checkTie(s.board);
+}
+
+/*
+ * Function: markMove
+ *
+ * Patches the piece that just landed at (row, col) into the rendered
+ * frame and adds the move to the game's record (Classic games only:
+ * the archive stores seven columns). A frame still queued from an
+ * earlier turn is copied out first so it goes out as it was.
+ */
+inline void markMove(Session &s, int row, int col, char piece) {
+    if (hasPendingOutput(s.conn))
+        detachBorrowed(s.conn, s.frame, s.frameSize);
+    if (s.variant) {
+        s.frame[FRAME_HEADER_TEXT + (row * s.variant->cols + col) * 2] = viewPiece(s, piece);
+    } else {
+        s.frame[FRAME_HEADER_TEXT + cellOffset(row, col)] = viewPiece(s, piece);
+        recordMove(s.record, col);
+    }
+    s.watchStale = true;
+}
+
+/*
+ * Function: sendBoardAndTurn
+ *
+ * Queues a message consisting of:
+ *   - The header "BOARD"
+ *   - The current board state (the session's rendered frame)
+ *   - A message indicating whose turn it is or the game outcome.
+ * The pieces are queued by reference and leave in one writev() once
+ * the reactor flushes the connection.
+ */
+inline void sendBoardAndTurn(Session &s, const char *turnMsg) {
+    queueBorrowed(s.conn, s.frame, s.frameSize);
+    queueLiteral(s.conn, turnMsg);
+    queueLiteral(s.conn, "\n", 1);
+}
+
+inline void queueLine(Session &s, const char *line) {
+    queueLiteral(s.conn, line);
+    queueLiteral(s.conn, "\n", 1);
+}
+
+inline void sendSnapshot(Session &s, FrameStatus status) {
+    uint8_t frame[SNAPSHOT_FRAME_SIZE];
+    encodeSnapshotFrame(frame, viewBoard(s), status, s.seq++);
+    queueCopy(s.conn, (const char*)frame, sizeof(frame));
+}
+
+/*
+ * Function: sendUpdate
+ *
+ * Tells the client about a move (col 0-6, or -1 for none) and the
+ * resulting status: a full BOARD frame on the text protocol, an 8-byte
+ * move frame on the binary one (see protocol.h).
+ */
+inline void sendUpdate(Session &s, int col, int player, FrameStatus status) {
+    if (s.binary) {
+        uint8_t frame[MOVE_FRAME_SIZE];
+        encodeMoveFrame(frame, col, player, status, s.seq++);
+        queueCopy(s.conn, (const char*)frame, sizeof(frame));
+        return;
+    }
+    if (status == STATUS_INVALID_MOVE) {
+        queueLine(s, "INVALID_MOVE");
+        status = STATUS_TURN_CLIENT;
+    }
+    sendBoardAndTurn(s, STATUS_TEXT[status]);
+}
+
+// Spectators' turn lines: the side to move, or the result, as seat 0 sees it.
+const char *const WATCH_TURN_TEXT[2] = { "TURN CLIENT", "TURN SERVER" };
+const char *const WATCH_STATUS_TEXT[RESULT_COUNT] = {
+    "GAMEOVER CLIENT_WIN", "GAMEOVER SERVER_WIN", "GAMEOVER TIE", "GAMEOVER TIMEOUT", "GAMEOVER ABANDONED"
+};
+
+/*
+ * Function: renderWatchFrame
+ *
+ * The frame every spectator of seat 0's session `s` gets: the board
+ * and the spectator turn line, or the result once `over`. Built once
+ * and shared, never changed.
+ */
+inline SharedFrame renderWatchFrame(const Session &s, bool over) {
+    const char *status = over ? WATCH_STATUS_TEXT[s.record.result] : WATCH_TURN_TEXT[movesPlayed(s) & 1];
+    std::string text;
+    text.reserve(s.frameSize + 24);
+    text.append(s.frame, s.frameSize);
+    text.append(status);
+    text.push_back('\n');
+    return std::make_shared<const std::string>(std::move(text));
+}
+
+// Send the initial board to the client; the client (or seat 0) moves first.
+// Sessions start out zeroed; a PvP player sent back to the lobby before
+// anyone moved (see leaveMatch() in reactor.h) keeps its protocol.
+inline void startSession(Session &s) {
+    initBoard(s.board);
+    if (s.variant)
+        s.variant->init(s.variantBoard);
+    renderFrame(s);
+    s.state = s.seat == 0 ? AWAIT_MOVE : AWAIT_OPPONENT;
+    s.heard = false;
+    s.replyStart = 0;
+    s.analyzing = false;
+    s.analysisId = 0;
+    s.engineId = 0;
+    s.watchStale = true;
+    beginRecord(s.record, s.addr.sin_addr.s_addr, ntohs(s.addr.sin_port));
+    FrameStatus status = s.seat == 0 ? STATUS_TURN_CLIENT : STATUS_TURN_OPPONENT;
+    if (s.binary)
+        sendSnapshot(s, status);
+    else
+        sendBoardAndTurn(s, STATUS_TEXT[status]);
+}
+
+/*
+ * Function: startMatch
+ *
+ * Pairs two players from the lobby: `first` (who waited longest)
+ * moves first. Both get the empty board, with TURN CLIENT and TURN
+ * OPPONENT respectively.
+ */
+inline void startMatch(Session &first, Session &second) {
+    first.seat = 0;
+    second.seat = 1;
+    first.opponent = &second;
+    second.opponent = &first;
+    startSession(first);
+    startSession(second);
+}
+
+/*
+ * Function: startVariant
+ *
+ * Moves a game nobody has moved in yet onto `variant`'s board:
+ * "VARIANT <name> OK", then the empty board with TURN CLIENT. "7x6"
+ * is Classic itself and goes back to `board`.
+ */
+inline void startVariant(Session &s, const Variant &variant) {
+    s.variant = &variant == &VARIANTS[0] ? nullptr : &variant;
+    if (s.variant)
+        s.variant->init(s.variantBoard);
+    renderFrame(s);
+    s.watchStale = true;
+    queueLiteral(s.conn, "VARIANT ");
+    queueLiteral(s.conn, variant.name);
+    queueLine(s, " OK");
+    sendBoardAndTurn(s, STATUS_TEXT[STATUS_TURN_CLIENT]);
+}
+
+inline bool isSpace(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+}
+
+/*
+ * Function: parseMove
+ *
+ * Parses "MOVE <col>" the same way the old game loop's
+ * `iss >> command >> col` did - leading blanks skipped, trailing junk
+ * after the number ignored - but in place. Returns false unless the
+ * command is MOVE and col is 1-7 (1 to `cols` on a variant's board).
+ */
+inline bool parseMove(std::string_view clientMsg, int &col, int cols = COLS) {
+    size_t i = 0, n = clientMsg.size();
+    col = 0;
+    while (i < n && isSpace(clientMsg[i]))
+        i++;
+    size_t start = i;
+    while (i < n && !isSpace(clientMsg[i]))
+        i++;
+    if (clientMsg.substr(start, i - start) != "MOVE")
+        return false;
+    while (i < n && isSpace(clientMsg[i]))
+        i++;
+    bool negative = false;
+    if (i < n && (clientMsg[i] == '+' || clientMsg[i] == '-'))
+        negative = clientMsg[i++] == '-';
+    if (i == n || clientMsg[i] < '0' || clientMsg[i] > '9')
+        return false;
+    int value = 0;
+    for (; i < n && clientMsg[i] >= '0' && clientMsg[i] <= '9'; i++) {
+        if (value > cols)
+            break; // Already out of range; no need to read the rest.
+        value = value * 10 + (clientMsg[i] - '0');
+    }
+    col = negative ? -value : value;
+    return col >= 1 && col <= cols;
+}
+
+/*
+ * Function: parseAnalyze
+ *
+ * Parses "ANALYZE <ms>", ms a positive number of milliseconds (capped
+ * at ANALYZE_MAX_MS). Returns false for anything else.
+ */
+inline bool parseAnalyze(std::string_view clientMsg, int &ms) {
+    const std::string_view prefix = "ANALYZE ";
+    if (clientMsg.substr(0, prefix.size()) != prefix || clientMsg.size() == prefix.size())
+        return false;
+    ms = 0;
+    for (size_t i = prefix.size(); i < clientMsg.size(); i++) {
+        if (clientMsg[i] < '0' || clientMsg[i] > '9')
+            return false;
+        if (ms < ANALYZE_MAX_MS)
+            ms = ms * 10 + (clientMsg[i] - '0');
+    }
+    if (ms > ANALYZE_MAX_MS)
+        ms = ANALYZE_MAX_MS;
+    return ms > 0;
+}
+
+/*
+ * Function: parseWatch
+ *
+ * Parses "WATCH <game-id>", id a positive decimal number.
+ */
+inline bool parseWatch(std::string_view clientMsg, uint64_t &id) {
+    const std::string_view prefix = "WATCH ";
+    size_t digits = clientMsg.size() - prefix.size();
+    if (clientMsg.substr(0, prefix.size()) != prefix || digits == 0 || digits > 19)
+        return false; // 19 digits always fit in 64 bits.
+    id = 0;
+    for (size_t i = prefix.size(); i < clientMsg.size(); i++) {
+        if (clientMsg[i] < '0' || clientMsg[i] > '9')
+            return false;
+        id = id * 10 + (clientMsg[i] - '0');
+    }
+    return id > 0;
+}
+
+/*
+ * Function: parseResume
+ *
+ * Parses "RESUME <token>", the token as "TOKEN" gave it: up to 16 hex
+ * digits, not all zero.
+ */
+inline bool parseResume(std::string_view clientMsg, uint64_t &token) {
+    const std::string_view prefix = "RESUME ";
+    size_t digits = clientMsg.size() - prefix.size();
+    if (clientMsg.substr(0, prefix.size()) != prefix || digits == 0 || digits > 16)
+        return false;
+    token = 0;
+    for (size_t i = prefix.size(); i < clientMsg.size(); i++) {
+        char ch = clientMsg[i];
+        int digit = ch >= '0' && ch <= '9' ? ch - '0' : ch >= 'a' && ch <= 'f' ? ch - 'a' + 10
+                  : ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1;
+        if (digit < 0)
+            return false;
+        token = token << 4 | digit;
+    }
+    return token != 0;
+}
+
+/*
+ * Function: parseVariant
+ *
+ * Parses "VARIANT <name>", name one of variants.h's.
+ */
+inline bool parseVariant(std::string_view clientMsg, const Variant *&variant) {
+    const std::string_view prefix = "VARIANT ";
+    if (clientMsg.substr(0, prefix.size()) != prefix)
+        return false;
+    variant = findVariant(clientMsg.substr(prefix.size()));
+    return variant != nullptr;
+}
+
+/*
+ * Function: parseChannel
+ *
+ * Splits a multiplexed connection's "<channel> <message>" line. The
+ * channel is decimal, 1 to 2^32 - 1, and one space separates it from
+ * the message, which can't be empty.
+ */
+inline bool parseChannel(std::string_view clientMsg, uint32_t &channel, std::string_view &message) {
+    size_t space = clientMsg.find(' ');
+    if (space == 0 || space > 10 || space == std::string_view::npos || space + 1 == clientMsg.size())
+        return false;
+    uint64_t value = 0;
+    for (size_t i = 0; i < space; i++) {
+        if (clientMsg[i] < '0' || clientMsg[i] > '9')
+            return false;
+        value = value * 10 + (clientMsg[i] - '0');
+    }
+    if (value == 0 || value > UINT32_MAX)
+        return false;
+    channel = (uint32_t)value;
+    message = clientMsg.substr(space + 1);
+    return true;
+}
+
+/*
+ * Function: sendAnalysis
+ *
+ * Answers an ANALYZE with per-column scores in protocol.h's form, or
+ * "busy" if depth is 0.
+ */
+inline void sendAnalysis(Session &s, int depth, const int16_t scores[COLS]) {
+    if (s.binary) {
+        uint8_t frame[ANALYSIS_FRAME_SIZE];
+        encodeAnalysisFrame(frame, depth, scores, s.seq++);
+        queueCopy(s.conn, (const char*)frame, sizeof(frame));
+        return;
+    }
+    if (depth == 0) {
+        queueLine(s, "ANALYSIS BUSY");
+        return;
+    }
+    char line[16 + COLS * 8];
+    int length = snprintf(line, sizeof(line), "ANALYSIS %d", depth);
+    for (int c = 0; c < COLS; c++) {
+        char score[8];
+        formatColumnScore(scores[c], score, sizeof(score));
+        length += snprintf(line + length, sizeof(line) - length, " %s", score);
+    }
+    line[length++] = '\n';
+    queueCopy(s.conn, line, length);
+}
+
+/*
+ * Function: handleClientLine
+ *
+ * Validates and applies one line from the client while in AWAIT_MOVE.
+ * Anything other than a legal "MOVE <1-7>" gets INVALID_MOVE plus the
+ * unchanged board, exactly like the old loop. "PROTOCOL BINARY" and
+ * "RESYNC" are the binary protocol's handshake and recovery requests;
+ * "ANALYZE <ms>" is left to the reactor (analysis.h), except in PvP
+ * games where it's just an invalid move, and so is "TOKEN" in a game
+ * against the server on a connection of its own. So are
+ * "WATCH <game-id>", "RESUME <token>", "PROTOCOL MUX" and
+ * "VARIANT <name>", but only before that game's first move. A game on
+ * a variant's board has no binary frames and no analysis. Returns
+ * which of those the line was.
+ */
+inline LineResult handleClientLine(Session &s, std::string_view clientMsg) {
+    s.heard = true;
+    if (!s.variant && clientMsg == "PROTOCOL BINARY") {
+        queueLine(s, "PROTOCOL BINARY OK");
+        s.binary = true;
+        sendSnapshot(s, STATUS_TURN_CLIENT);
+        return LINE_CONTROL;
+    }
+    if (clientMsg == "RESYNC") {
+        if (s.binary)
+            sendSnapshot(s, STATUS_TURN_CLIENT);
+        else
+            sendBoardAndTurn(s, STATUS_TEXT[STATUS_TURN_CLIENT]);
+        return LINE_CONTROL;
+    }
+    if (!s.opponent && !s.variant && parseAnalyze(clientMsg, s.analyzeMs))
+        return LINE_ANALYZE; // Not in PvP games: the engine would be playing for you.
+    if (!s.opponent && !s.link && movesPlayed(s) == 0 && parseWatch(clientMsg, s.watchId))
+        return LINE_WATCH;
+    if (!s.opponent && !s.link && movesPlayed(s) == 0 && clientMsg == "PROTOCOL MUX")
+        return LINE_MUX;
+    if (!s.opponent && !s.link && movesPlayed(s) == 0 && parseResume(clientMsg, s.resumeToken))
+        return LINE_RESUME;
+    if (!s.opponent && !s.link && clientMsg == "TOKEN")
+        return LINE_TOKEN;
+    if (!s.opponent && movesPlayed(s) == 0 && parseVariant(clientMsg, s.askedVariant))
+        return LINE_VARIANT;
+    int col;
+    if (!parseMove(clientMsg, col, s.variant ? s.variant->cols : COLS)) {
+        sendUpdate(s, -1, 0, STATUS_INVALID_MOVE);
+        return LINE_INVALID;
+    }
+    char piece = s.seat == 0 ? 'C' : 'S';
+    int dropRow = dropMove(s, col - 1, piece);
+    if (dropRow == -1) {
+        sendUpdate(s, -1, 0, STATUS_INVALID_MOVE);
+        return LINE_INVALID;
+    }
+    markMove(s, dropRow, col - 1, piece);
+    logMessage(LOG_INFO, "Client dropped a piece in column {}.", col);
+    if (wonWith(s, dropRow, col - 1, piece)) {
+        sendUpdate(s, col - 1, 0, STATUS_CLIENT_WIN);
+        logMessage(LOG_INFO, "Client wins!");
+        s.record.result = RESULT_CLIENT_WIN;
+        s.state = GAME_OVER;
+    } else if (boardFull(s)) {
+        sendUpdate(s, col - 1, 0, STATUS_TIE);
+        logMessage(LOG_INFO, "Tie!");
+        s.record.result = RESULT_TIE;
+        s.state = GAME_OVER;
+    } else if (s.opponent) {
+        sendUpdate(s, col - 1, 0, STATUS_TURN_OPPONENT);
+        s.state = AWAIT_OPPONENT;
+    } else {
+        s.state = AWAIT_SERVER_MOVE;
+    }
+    return LINE_MOVE;
+}
+
+/*
+ * Function: applyServerMove
+ *
+ * Applies the server's move (col is 1-7, or 1 to the variant's
+ * columns) while in AWAIT_SERVER_MOVE, or in a PvP game the
+ * opponent's already checked move while in AWAIT_OPPONENT. Returns
+ * false if the column is full so the caller can ask again.
+ */
+inline bool applyServerMove(Session &s, int col) {
+    char piece = s.seat == 0 ? 'S' : 'C';
+    int dropRow = dropMove(s, col - 1, piece);
+    if (dropRow == -1)
+        return false;
+    markMove(s, dropRow, col - 1, piece);
+    if (!s.opponent)
+        logMessage(LOG_INFO, "Server dropped a piece in column {}.", col);
+    if (wonWith(s, dropRow, col - 1, piece)) {
+        sendUpdate(s, col - 1, 1, STATUS_SERVER_WIN);
+        if (!s.opponent)
+            logMessage(LOG_INFO, "Server wins!");
+        s.record.result = RESULT_SERVER_WIN;
+        s.state = GAME_OVER;
+    } else if (boardFull(s)) {
+        sendUpdate(s, col - 1, 1, STATUS_TIE);
+        if (!s.opponent)
+            logMessage(LOG_INFO, "Tie!");
+        s.record.result = RESULT_TIE;
+        s.state = GAME_OVER;
+    } else {
+        s.state = AWAIT_MOVE;
+        sendUpdate(s, col - 1, 1, STATUS_TURN_CLIENT);
+    }
+    return true;
+}
+
+/*
+ * Function: winByForfeit
+ *
+ * Ends a PvP game for the player whose opponent timed out or left:
+ * GAMEOVER CLIENT_WIN with no move. `result` is what the archive
+ * records (RESULT_TIMEOUT or RESULT_ABANDONED: the board has no four).
+ */
+inline void winByForfeit(Session &s, GameResult result) {
+    sendUpdate(s, -1, 1, STATUS_CLIENT_WIN);
+    logMessage(LOG_INFO, "Opponent forfeited.");
+    s.record.result = result;
+    s.state = GAME_OVER;
+    s.watchStale = true;
+}
+
+/*
+ * Function: timeOutSession
+ *
+ * Ends the game because the client ran out of time: the final board
+ * with "GAMEOVER TIMEOUT" (a move frame with STATUS_TIMEOUT in binary).
+ * A PvP opponent wins by forfeit; the caller still has to flush it.
+ */
+inline void timeOutSession(Session &s) {
+    sendUpdate(s, -1, 0, STATUS_TIMEOUT);
+    s.record.result = RESULT_TIMEOUT;
+    s.state = GAME_OVER;
+    s.watchStale = true;
+    if (s.opponent && s.opponent->state != GAME_OVER)
+        winByForfeit(*s.opponent, RESULT_TIMEOUT);
+}
+
+/*
+ * Function: sendResumed
+ *
+ * Greets the connection that just took the game over: "RESUMED
+ * <game-id>", then the board as it stands with TURN CLIENT, or TURN
+ * SERVER if the server still owes its move (a snapshot frame with
+ * STATUS_TURN_CLIENT or STATUS_TURN_OPPONENT on the binary protocol).
+ */
+inline void sendResumed(Session &s) {
+    char line[40];
+    int length = snprintf(line, sizeof(line), "RESUMED %llu\n", (unsigned long long)s.gameId);
+    queueCopy(s.conn, line, length);
+    bool clientsTurn = s.state == AWAIT_MOVE;
+    if (s.binary)
+        sendSnapshot(s, clientsTurn ? STATUS_TURN_CLIENT : STATUS_TURN_OPPONENT);
+    else
+        sendBoardAndTurn(s, clientsTurn ? STATUS_TEXT[STATUS_TURN_CLIENT] : WATCH_TURN_TEXT[1]);
+}
+
+// Freezes a game against the server, or a --pvp player in the lobby, into `out`.
+inline void snapshotSession(const Session &s, SessionSnapshot &out) {
+    memset(&out, 0, sizeof(out));
+    out.token = s.token;
+    out.gameId = s.gameId;
+    out.pieces[0] = s.board.pieces[0];
+    out.pieces[1] = s.board.pieces[1];
+    out.record = s.record;
+    out.record.peerAddr = s.addr.sin_addr.s_addr; // A lobby player's record hasn't begun.
+    out.record.peerPort = ntohs(s.addr.sin_port);
+    out.record.durationMs = (uint32_t)((monotonicNs() - s.acceptedNs) / 1000000);
+    out.fd = s.conn.fd;
+    out.seq = s.seq;
+    out.turn = s.state == AWAIT_SERVER_MOVE ? 1 : 0;
+    out.kind = s.state == LOBBY ? SNAPSHOT_LOBBY : SNAPSHOT_GAME;
+    out.flags = (s.binary ? SNAPSHOT_BINARY : 0) | (s.heard ? SNAPSHOT_HEARD : 0);
+}
+
+/*
+ * Function: restoreSession
+ *
+ * Rebuilds a snapshot's game on a fresh session, all but its socket:
+ * the board is replayed from the move list and has to match the
+ * stored bitmasks and turn. The state is AWAIT_MOVE, AWAIT_SERVER_MOVE
+ * or LOBBY. Returns false, leaving `s` half set up, for a snapshot
+ * that doesn't add up.
+ */
+inline bool restoreSession(Session &s, const SessionSnapshot &snap) {
+    s.binary = (snap.flags & SNAPSHOT_BINARY) != 0;
+    s.seq = snap.seq;
+    s.heard = (snap.flags & SNAPSHOT_HEARD) != 0;
+    s.addr.sin_family = AF_INET;
+    s.addr.sin_addr.s_addr = snap.record.peerAddr;
+    s.addr.sin_port = htons(snap.record.peerPort);
+    if (snap.kind == SNAPSHOT_LOBBY) {
+        s.state = LOBBY;
+        return true;
+    }
+    Board board;
+    if (snap.kind != SNAPSHOT_GAME || !replayGame(snap.record, board) || board.pieces[0] != snap.pieces[0]
+        || board.pieces[1] != snap.pieces[1] || snap.turn != (board.moves & 1))
+        return false;
+    uint64_t now = monotonicNs(), played = snap.record.durationMs * 1000000ULL;
+    s.board = board;
+    s.record = snap.record;
+    s.acceptedNs = now > played ? now - played : 0;
+    s.gameId = snap.gameId;
+    s.token = snap.token;
+    s.state = snap.turn ? AWAIT_SERVER_MOVE : AWAIT_MOVE;
+    s.watchStale = true;
+    renderFrame(s);
+    return true;
+}
+
+#endif // SESSION_H
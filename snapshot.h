@@ -0,0 +1,170 @@
+/*
+ *  snapshot.h
+ *
+ *  -------------------------------------------------------------------
+ *  A game against the server, frozen into 80 bytes so it can outlive
+ *  its connection or its process:
+ *
+ *    • a client that asked for a resume token ("TOKEN", see
+ *      protocol.h) and loses its connection mid-game can pick the game
+ *      up again from a new one with "RESUME <token>"; meanwhile the
+ *      game waits, parked, for --resume-timeout seconds.
+ *    • with --checkpoint <file>, SIGUSR2 snapshots the server's games
+ *      into <file> and hands them, their sockets and the listening
+ *      sockets to a fresh copy of the server (see upgrade.h).
+ *
+ *  Checkpoint file layout (little-endian, like archive.h: map it and
+ *  index it):
+ *
+ *      CheckpointHeader   16 bytes: magic "C4SNAPS1", record size, count
+ *      SessionSnapshot[]  80 bytes each
+ *
+ *  A SessionSnapshot:
+ *
+ *      token      RESUME token, 0 if the client never asked for one
+ *      gameId     what WATCH calls the game; also says which reactor
+ *                 it lives on (gameReactor() in lobby.h)
+ *      pieces[2]  the board's bitmasks, Board::pieces
+ *      record     the game so far as the archive keeps it: peer,
+ *                 start time, moves, client first; durationMs is how
+ *                 long it has been going
+ *      fd         the client's socket, left open across exec(); -1 if
+ *                 the game is parked, waiting for RESUME
+ *      seq        the next binary frame's sequence number
+ *      turn       0 = the client's move, 1 = the server's
+ *      kind       SNAPSHOT_GAME, or SNAPSHOT_LOBBY for a --pvp player
+ *                 not paired yet (then only fd, the flags and the
+ *                 record's peer mean anything)
+ *      flags      SNAPSHOT_BINARY, SNAPSHOT_HEARD
+ *
+ *  The board is in there twice on purpose: a restore replays the moves
+ *  through the rules (replayGame()) and refuses a snapshot whose
+ *  bitmasks don't come out the same.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "log.h"
+
+const char CHECKPOINT_MAGIC[8] = { 'C', '4', 'S', 'N', 'A', 'P', 'S', '1' };
+
+enum SnapshotKind : uint8_t {
+    SNAPSHOT_GAME,
+    SNAPSHOT_LOBBY
+};
+
+const uint8_t SNAPSHOT_BINARY = 1; // Switched to binary frames.
+const uint8_t SNAPSHOT_HEARD = 2;  // Has sent a line, so the handshake deadline is behind it.
+
+struct CheckpointHeader {
+    char     magic[8];
+    uint32_t recordSize;
+    uint32_t count;
+};
+
+struct SessionSnapshot {
+    uint64_t   token;
+    uint64_t   gameId;
+    uint64_t   pieces[2];
+    GameRecord record;
+    int32_t    fd;
+    uint32_t   seq;
+    uint8_t    turn;
+    uint8_t    kind;
+    uint8_t    flags;
+    uint8_t    reserved[5];
+};
+
+static_assert(sizeof(CheckpointHeader) == 16 && sizeof(SessionSnapshot) == 80, "checkpoint layout changed");
+
+/*
+ * Function: writeCheckpoint
+ *
+ * Writes `snapshots` to `path` through a shared mapping and syncs it
+ * before returning, replacing whatever was there. Returns false with
+ * the error logged.
+ */
+inline bool writeCheckpoint(const char *path, const std::vector<SessionSnapshot> &snapshots) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        logMessage(LOG_ERROR, "[ERROR] open({}): {}", path, LogErrno{errno});
+        return false;
+    }
+    size_t bytes = sizeof(CheckpointHeader) + snapshots.size() * sizeof(SessionSnapshot);
+    if (ftruncate(fd, bytes) != 0) {
+        logMessage(LOG_ERROR, "[ERROR] ftruncate({}): {}", path, LogErrno{errno});
+        close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file alive.
+    if (mapped == MAP_FAILED) {
+        logMessage(LOG_ERROR, "[ERROR] mmap({}): {}", path, LogErrno{errno});
+        return false;
+    }
+    CheckpointHeader *header = (CheckpointHeader*)mapped;
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header->recordSize = sizeof(SessionSnapshot);
+    header->count = (uint32_t)snapshots.size();
+    if (!snapshots.empty())
+        memcpy(header + 1, snapshots.data(), snapshots.size() * sizeof(SessionSnapshot));
+    bool ok = msync(mapped, bytes, MS_SYNC) == 0;
+    if (!ok)
+        logMessage(LOG_ERROR, "[ERROR] msync({}): {}", path, LogErrno{errno});
+    munmap(mapped, bytes);
+    return ok;
+}
+
+/*
+ * Function: readCheckpoint
+ *
+ * Maps a checkpoint and copies its snapshots into `out`. Returns false
+ * with the error printed if it can't be read or isn't a checkpoint.
+ */
+inline bool readCheckpoint(const char *path, std::vector<SessionSnapshot> &out) {
+    out.clear();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        std::cerr << "[ERROR] open(" << path << "): " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+        std::cerr << "[ERROR] " << path << " is not a checkpoint." << std::endl;
+        close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "[ERROR] mmap(" << path << "): " << strerror(errno) << std::endl;
+        return false;
+    }
+    const CheckpointHeader *header = (const CheckpointHeader*)mapped;
+    bool ok = memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0
+        && header->recordSize == sizeof(SessionSnapshot)
+        && sizeof(CheckpointHeader) + (uint64_t)header->count * sizeof(SessionSnapshot) <= (uint64_t)st.st_size;
+    if (ok) {
+        const SessionSnapshot *first = (const SessionSnapshot*)(header + 1);
+        out.assign(first, first + header->count);
+    } else {
+        std::cerr << "[ERROR] " << path << " is not a checkpoint." << std::endl;
+    }
+    munmap(mapped, st.st_size);
+    return ok;
+}
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,208 @@
+/*
+ *  stats.h
+ *
+ *  -------------------------------------------------------------------
+ *  Plain-text view of metrics.h, served two ways:
+ *
+ *    • --stats-port <port>: a listener on 127.0.0.1 that writes one
+ *      snapshot to whoever connects and hangs up, e.g.
+ *          nc 127.0.0.1 9100
+ *    • --stats-interval <s>: the same text on stdout every <s> seconds.
+ *
+ *  Both run on one background thread that only reads the reactors'
+ *  Metrics blocks, so the game threads never wait on it.
+ *
+ *  On a SIGUSR2 restart (upgrade.h) the port's listener goes to the
+ *  new server with the others, and releaseStatsPort() has this
+ *  process's thread stop serving it; the dumps carry on until it exits.
+ *
+ *  One "name value" pair per line. Counters come with a per-second
+ *  rate over the window (since startup for the port, since the last
+ *  dump for the interval); histograms give count, p50/p90/p99/p99.9
+ *  and max in microseconds. active_sessions is accepted - closed;
+ *  tt_hit_rate is tt_hits / tt_probes over the window, and
+ *  io_syscalls_per_move io_syscalls / moves.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <iostream>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "metrics.h"
+
+/*
+ * Function: formatStats
+ *
+ * Renders `now` as text. Rates are (now - before) / seconds.
+ */
+inline std::string formatStats(const MetricsSnapshot &now, const MetricsSnapshot &before, double seconds) {
+    std::string out;
+    char line[256];
+    snprintf(line, sizeof(line), "window_s %.3f\n", seconds);
+    out += line;
+    snprintf(line, sizeof(line), "active_sessions %llu\n",
+             (unsigned long long)(now.counters[COUNT_ACCEPTED] - now.counters[COUNT_CLOSED]));
+    out += line;
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        uint64_t delta = now.counters[c] - before.counters[c];
+        snprintf(line, sizeof(line), "%s %llu\n%s_per_s %.1f\n", COUNTER_NAMES[c],
+                 (unsigned long long)now.counters[c], COUNTER_NAMES[c], seconds > 0 ? delta / seconds : 0.0);
+        out += line;
+    }
+    uint64_t probes = now.counters[COUNT_TT_PROBES] - before.counters[COUNT_TT_PROBES];
+    snprintf(line, sizeof(line), "tt_hit_rate %.4f\n",
+             probes ? (double)(now.counters[COUNT_TT_HITS] - before.counters[COUNT_TT_HITS]) / probes : 0.0);
+    out += line;
+    uint64_t moves = now.counters[COUNT_MOVES] - before.counters[COUNT_MOVES];
+    snprintf(line, sizeof(line), "io_syscalls_per_move %.2f\n",
+             moves ? (double)(now.counters[COUNT_IO_SYSCALLS] - before.counters[COUNT_IO_SYSCALLS]) / moves : 0.0);
+    out += line;
+    for (int h = 0; h < HISTOGRAM_COUNT; h++) {
+        const uint64_t *buckets = now.histograms[h];
+        uint64_t total = 0;
+        int top = -1;
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            total += buckets[b];
+            if (buckets[b])
+                top = b;
+        }
+        snprintf(line, sizeof(line), "%s_us count=%llu p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+                 HISTOGRAM_NAMES[h], (unsigned long long)total,
+                 histPercentile(buckets, total, 0.50) / 1000.0, histPercentile(buckets, total, 0.90) / 1000.0,
+                 histPercentile(buckets, total, 0.99) / 1000.0, histPercentile(buckets, total, 0.999) / 1000.0,
+                 top < 0 ? 0.0 : histBucketTop(top) / 1000.0);
+        out += line;
+    }
+    return out;
+}
+
+// The stats thread's listener, and the eventfd that makes it let go of it.
+struct StatsPort {
+    int listenfd;
+    int wakefd;
+};
+
+inline StatsPort &statsPort() {
+    static StatsPort port = { -1, -1 };
+    return port;
+}
+
+inline int openStatsListener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        std::cerr << "[ERROR] socket(): " << strerror(errno) << std::endl;
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // Local only.
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        std::cerr << "[ERROR] stats port " << port << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Function: runStats
+ *
+ * The stats thread's loop: serves the port (if listenfd != -1) until
+ * releaseStatsPort(), and prints a dump every intervalSec seconds (if
+ * > 0). Never returns.
+ */
+inline void runStats(int listenfd, int wakefd, int intervalSec) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastDump = start;
+    std::unique_ptr<MetricsSnapshot> zero(new MetricsSnapshot());
+    std::unique_ptr<MetricsSnapshot> previous(new MetricsSnapshot());
+    std::unique_ptr<MetricsSnapshot> current(new MetricsSnapshot());
+
+    while (true) {
+        int waitMs = -1;
+        if (intervalSec > 0) {
+            std::chrono::steady_clock::time_point due = lastDump + std::chrono::seconds(intervalSec);
+            long long left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                due - std::chrono::steady_clock::now()).count();
+            waitMs = left > 0 ? (int)left : 0;
+        }
+        struct pollfd pfds[2] = { { listenfd, POLLIN, 0 }, { wakefd, POLLIN, 0 } };
+        int ready = poll(pfds, listenfd == -1 ? 0 : 2, waitMs);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        if (ready > 0 && (pfds[1].revents & POLLIN)) {
+            close(listenfd); // Our copy; the new server has its own.
+            listenfd = -1;
+        } else if (ready > 0 && (pfds[0].revents & POLLIN)) {
+            int client = accept(listenfd, nullptr, nullptr);
+            if (client != -1) {
+                takeSnapshot(*current);
+                std::string text = formatStats(*current, *zero, std::chrono::duration<double>(now - start).count());
+                send(client, text.data(), text.size(), MSG_NOSIGNAL);
+                close(client);
+            }
+        }
+        if (intervalSec > 0 && now - lastDump >= std::chrono::seconds(intervalSec)) {
+            takeSnapshot(*current);
+            std::cout << "---- stats ----\n"
+                      << formatStats(*current, *previous, std::chrono::duration<double>(now - lastDump).count())
+                      << std::flush;
+            previous.swap(current);
+            lastDump = now;
+        }
+    }
+}
+
+/*
+ * Function: startStats
+ *
+ * Starts the stats thread if either option asks for it, on `inherited`
+ * if a predecessor passed its stats listener down (-1 if not). Returns
+ * false if the stats port can't be opened.
+ */
+inline bool startStats(int port, int intervalSec, int inherited = -1) {
+    if (port == 0 && intervalSec == 0)
+        return true;
+    StatsPort &stats = statsPort();
+    if (port != 0) {
+        stats.listenfd = inherited != -1 ? inherited : openStatsListener(port);
+        if (stats.listenfd == -1)
+            return false;
+        stats.wakefd = eventfd(0, EFD_CLOEXEC);
+        if (stats.wakefd == -1) {
+            std::cerr << "[ERROR] eventfd(): " << strerror(errno) << std::endl;
+            return false;
+        }
+        std::cout << "[INFO] Stats on 127.0.0.1:" << port << std::endl;
+    }
+    std::thread(runStats, stats.listenfd, stats.wakefd, intervalSec).detach();
+    return true;
+}
+
+// Has the stats thread close its listener, which a new server has taken over.
+inline void releaseStatsPort() {
+    uint64_t one = 1;
+    if (statsPort().wakefd != -1 && write(statsPort().wakefd, &one, sizeof(one)) != sizeof(one))
+        logMessage(LOG_WARN, "[WARN] releasing the stats port: {}", LogErrno{errno});
+}
+
+#endif // STATS_H
@@ -0,0 +1,184 @@
+/*
+ *  timer.h
+ *
+ *  -------------------------------------------------------------------
+ *  Hierarchical timer wheel for the reactor's per-session deadlines
+ *  (move, handshake and idle timeouts).
+ *
+ *  Time is counted in ticks of TIMER_TICK_MS. Level 0 has one slot per
+ *  tick for the next 64 ticks, level 1 one slot per 64 ticks for the
+ *  next 64^2, and so on for WHEEL_LEVELS levels (~19 days at 100 ms).
+ *  Each slot is an intrusive doubly linked list of TimerNodes that live
+ *  inside the object being timed, so:
+ *
+ *    • armTimer() computes a slot from the expiry and links the node
+ *      in - O(1), no allocation.
+ *    • cancelTimer() unlinks it - O(1), no search.
+ *    • advanceTimers() walks level 0 one tick at a time; whenever a
+ *      level's index wraps to 0 the next level's current slot is
+ *      "cascaded", i.e. its nodes are re-filed one level down. Every
+ *      node is re-filed at most WHEEL_LEVELS - 1 times in its life.
+ *
+ *  This is the classic kernel timer design. Compared with a heap it
+ *  never compares deadlines; compared with SO_RCVTIMEO it works for
+ *  deadlines that span many reads and the console's turn.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <chrono>
+#include <cstdint>
+
+const int TIMER_TICK_MS = 100;
+const int WHEEL_BITS = 6;
+const int WHEEL_SLOTS = 1 << WHEEL_BITS;
+const int WHEEL_LEVELS = 4;
+const uint64_t WHEEL_MASK = WHEEL_SLOTS - 1;
+const uint64_t WHEEL_SPAN = uint64_t(1) << (WHEEL_BITS * WHEEL_LEVELS); // Longest delay, in ticks.
+
+struct TimerNode {
+    TimerNode *prev; // nullptr when not armed.
+    TimerNode *next;
+    uint64_t expires; // Absolute tick.
+    void *owner;      // Whatever the node is embedded in, for the expiry handler.
+};
+
+struct TimerWheel {
+    uint64_t base; // Next tick to process.
+    size_t armed;
+    std::chrono::steady_clock::time_point start;
+    TimerNode slots[WHEEL_LEVELS][WHEEL_SLOTS]; // List heads (sentinels).
+};
+
+inline void initTimerNode(TimerNode &node, void *owner) {
+    node.prev = node.next = nullptr;
+    node.expires = 0;
+    node.owner = owner;
+}
+
+inline bool timerArmed(const TimerNode &node) {
+    return node.prev != nullptr;
+}
+
+inline void initTimerWheel(TimerWheel &w) {
+    w.base = 0;
+    w.armed = 0;
+    w.start = std::chrono::steady_clock::now();
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+        for (int slot = 0; slot < WHEEL_SLOTS; slot++)
+            w.slots[level][slot].prev = w.slots[level][slot].next = &w.slots[level][slot];
+}
+
+// The tick the clock is in right now.
+inline uint64_t currentTick(const TimerWheel &w) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - w.start).count() / TIMER_TICK_MS;
+}
+
+inline uint64_t msToTicks(uint64_t ms) {
+    return (ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+}
+
+// Links a node into the slot its expiry falls in, relative to w.base.
+inline void fileTimer(TimerWheel &w, TimerNode &node) {
+    uint64_t delta = node.expires - w.base;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (uint64_t(1) << (WHEEL_BITS * (level + 1))))
+        level++;
+    TimerNode &head = w.slots[level][(node.expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+}
+
+inline void unlinkTimer(TimerNode &node) {
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = node.next = nullptr;
+}
+
+inline void cancelTimer(TimerWheel &w, TimerNode &node) {
+    if (!timerArmed(node))
+        return;
+    unlinkTimer(node);
+    w.armed--;
+}
+
+/*
+ * Function: armTimer
+ *
+ * (Re)arms `node` to expire no sooner than `ms` from now: rounded up
+ * to whole ticks, plus one for the part of the current tick already
+ * gone, and capped at WHEEL_SPAN - 1 ticks.
+ */
+inline void armTimer(TimerWheel &w, TimerNode &node, uint64_t ms) {
+    cancelTimer(w, node);
+    uint64_t now = currentTick(w);
+    if (now < w.base)
+        now = w.base;
+    uint64_t ticks = msToTicks(ms) + 1;
+    if (now + ticks - w.base >= WHEEL_SPAN)
+        ticks = WHEEL_SPAN - 1 - (now - w.base);
+    node.expires = now + ticks;
+    fileTimer(w, node);
+    w.armed++;
+}
+
+// Re-files every node in one slot of a higher level. Returns the slot index.
+inline uint64_t cascadeTimers(TimerWheel &w, int level) {
+    uint64_t index = (w.base >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    TimerNode &head = w.slots[level][index];
+    while (head.next != &head) {
+        TimerNode &node = *head.next;
+        unlinkTimer(node);
+        fileTimer(w, node);
+    }
+    return index;
+}
+
+/*
+ * Function: advanceTimers
+ *
+ * Processes every tick up to and including the current one, calling
+ * expire(node) for each node whose tick has come. The node is already
+ * unarmed when the handler runs, so the handler may re-arm it, arm or
+ * cancel others, or free its owner.
+ */
+template <typename Expire>
+inline void advanceTimers(TimerWheel &w, Expire expire) {
+    uint64_t now = currentTick(w);
+    if (w.armed == 0) {
+        if (now >= w.base)
+            w.base = now + 1; // Nothing to run; skip the idle ticks.
+        return;
+    }
+    while (w.base <= now) {
+        uint64_t index = w.base & WHEEL_MASK;
+        for (int level = 1; index == 0 && level < WHEEL_LEVELS; level++)
+            index = cascadeTimers(w, level);
+        TimerNode &head = w.slots[0][w.base & WHEEL_MASK];
+        while (head.next != &head) {
+            TimerNode &node = *head.next;
+            unlinkTimer(node);
+            w.armed--;
+            expire(node);
+        }
+        w.base++;
+    }
+}
+
+// Milliseconds until the next tick is due, or -1 (sleep forever) if
+// nothing is armed. Meant as epoll_wait()'s timeout.
+inline int timerWaitMs(const TimerWheel &w) {
+    if (w.armed == 0)
+        return -1;
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - w.start).count();
+    uint64_t next = w.base * TIMER_TICK_MS;
+    return next > elapsed ? (int)(next - elapsed) : 0;
+}
+
+#endif // TIMER_H
@@ -0,0 +1,343 @@
+/*
+ *  upgrade.h
+ *
+ *  -------------------------------------------------------------------
+ *  Zero-downtime restarts (run_server.x --checkpoint <file>):
+ *  `kill -USR2 <pid>` replaces a running server with a fresh copy of
+ *  the binary at argv[0] - so a rebuilt one takes over - without
+ *  dropping games or refusing connections:
+ *
+ *    1. Every reactor stops accepting and takes off its books the
+ *       sessions it can hand over as they stand: games against the
+ *       server, parked ones included, and --pvp players still in the
+ *       lobby, with nothing half-read, half-written or owed by the
+ *       analysis pool. Under --io uring their recvs are cancelled and
+ *       waited for first; one that brings in bytes meanwhile stays.
+ *    2. Each hands its snapshots (snapshot.h) in with postSnapshots().
+ *       The last one in writes them all to <file> and starts the new
+ *       server: the same arguments plus --inherit <fds>, the listening
+ *       sockets (and the stats port's) and a pipe back to us, with
+ *       those and the sessions' sockets left open across exec() and
+ *       every other fd closed.
+ *    3. The new server takes the listeners as they are - connections
+ *       that arrived meanwhile are waiting in their backlogs - reads
+ *       and deletes <file>, and each reactor restores the sessions
+ *       that lived on its namesake (restoreSessions() in reactor.h).
+ *       Once every one has, it says so on the pipe (reportRestored()).
+ *    4. Only then do the old reactors close their copies of what they
+ *       handed over and drain: the sessions they kept (PvP games,
+ *       spectators, multiplexed connections, anyone caught mid-line)
+ *       play on to the end, then the process exits.
+ *
+ *  If the new server can't be started, or exits or doesn't report
+ *  within UPGRADE_READY_MS, it's killed and everything goes back to
+ *  how it was: the old server never lets go of a game before the new
+ *  one holds it. The reactor that started it waits for it, so its own
+ *  remaining games pause for the new server's startup. One restart at
+ *  a time: a SIGUSR2 during one is dropped. Game ids and tokens name
+ *  reactors, so both servers need the same --reactors.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <iostream>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "lobby.h"
+#include "log.h"
+#include "metrics.h"
+#include "options.h"
+#include "snapshot.h"
+#include "stats.h"
+
+const int UPGRADE_READY_MS = 5000; // How long the new server gets to restore our games.
+
+// Where a reactor is in a restart.
+enum UpgradeStep {
+    UPGRADE_NONE,
+    UPGRADE_SETTLING, // Waiting for its leaving sessions' io_uring requests to finish.
+    UPGRADE_POSTED,   // Snapshots handed in; waiting to hear whether the new server started.
+    UPGRADE_DRAINING  // It did: serving what's left, then exiting.
+};
+
+struct UpgradeState {
+    std::atomic<bool> requested;    // SIGUSR2 arrived; cleared once a new server has been tried.
+    int argc;
+    char **argv;
+    const char *checkpointPath;
+    std::vector<SessionSnapshot> restored; // --inherit: what the old server handed down...
+    std::atomic<int> restoring;     // ...reactors yet to restore their share of it...
+    int readyFd;                    // ...and the pipe to tell it on once they all have, else -1.
+    std::mutex lock;                // Guards the rest.
+    std::vector<SessionSnapshot> snapshots; // This round's, so far.
+    std::vector<int> listeners;     // By reactor id.
+    int posted;                     // Reactors that have handed theirs in.
+    uint64_t round;                 // Restarts tried so far...
+    bool handedOver;                // ...and whether the last one started.
+};
+
+inline UpgradeState &upgradeState() {
+    static UpgradeState state;
+    return state;
+}
+
+// Every running reactor's handoff eventfd, to have them look at `requested` or the outcome.
+inline void wakeReactors() {
+    HandoffDirectory &directory = handoffDirectory();
+    for (int i = 0; i < directory.count; i++) {
+        HandoffInbox *inbox = directory.inboxes[i].load(std::memory_order_acquire);
+        uint64_t one = 1;
+        if (inbox) {
+            ssize_t n = write(inbox->eventfd, &one, sizeof(one));
+            (void)n; // Only fails if it's readable already.
+        }
+    }
+}
+
+inline void onUpgradeSignal(int) {
+    int saved = errno;
+    upgradeState().requested.store(true, std::memory_order_release);
+    wakeReactors();
+    errno = saved;
+}
+
+/*
+ * Function: installUpgradeHandler
+ *
+ * Makes SIGUSR2 restart the server with `argv`, if --checkpoint says
+ * where to leave its games; without it SIGUSR2 is ignored.
+ */
+inline void installUpgradeHandler(int argc, char *argv[], const ServerOptions &opts) {
+    UpgradeState &u = upgradeState();
+    u.argc = argc;
+    u.argv = argv;
+    u.checkpointPath = opts.checkpointPath;
+    u.posted = 0;
+    u.round = 0;
+    u.handedOver = false;
+    u.readyFd = -1;
+    u.requested.store(false, std::memory_order_relaxed);
+    if (!opts.checkpointPath) {
+        signal(SIGUSR2, SIG_IGN);
+        return;
+    }
+    struct sigaction action = {};
+    action.sa_handler = onUpgradeSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &action, nullptr);
+}
+
+/*
+ * Function: loadCheckpoint
+ *
+ * The new server's side, before its reactors start: checks --inherit
+ * has a listener per reactor, plus the stats port's if there is one,
+ * and the old server's pipe last; then reads the old server's
+ * snapshots into `restored` and deletes the file. Returns false if
+ * the fds don't add up or the checkpoint can't be read, and the old
+ * server, hearing nothing, carries on with its games.
+ */
+inline bool loadCheckpoint(const ServerOptions &opts, int reactors) {
+    size_t expected = reactors + (opts.statsPort != 0 ? 1 : 0) + 1;
+    if (opts.inherited.size() != expected) {
+        std::cerr << "[ERROR] --inherit has " << opts.inherited.size() << " fds, expected " << expected
+                  << ": the old server ran with other --reactors or --stats-port." << std::endl;
+        return false;
+    }
+    UpgradeState &u = upgradeState();
+    bool ok = readCheckpoint(opts.checkpointPath, u.restored);
+    unlink(opts.checkpointPath);
+    if (!ok)
+        return false;
+    std::cout << "[INFO] Taking over " << u.restored.size() << " sessions from " << opts.checkpointPath << std::endl;
+    u.readyFd = opts.inherited.back();
+    fcntl(u.readyFd, F_SETFD, FD_CLOEXEC);
+    u.restoring.store(reactors, std::memory_order_relaxed);
+    return true;
+}
+
+/*
+ * Function: reportRestored
+ *
+ * Called by each of the new server's reactors once it has restored
+ * its share of the old server's sessions; the last one tells the old
+ * server it can let go of them (awaitSuccessor()).
+ */
+inline void reportRestored() {
+    UpgradeState &u = upgradeState();
+    if (u.readyFd == -1 || u.restoring.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    int ready = 0;
+    ssize_t n = write(u.readyFd, &ready, sizeof(ready));
+    (void)n; // Nobody to tell if the old server has gone.
+    close(u.readyFd);
+}
+
+/*
+ * Function: awaitSuccessor
+ *
+ * Waits up to UPGRADE_READY_MS on the pipe from a new server for 0,
+ * its reportRestored(). Anything else - an exec() error from the
+ * child, end of file because it exited, or nothing in time - means it
+ * didn't take over: it's killed and reaped, and the reason logged.
+ */
+inline bool awaitSuccessor(int statusFd, pid_t pid, const char *path) {
+    int message = -1;
+    size_t got = 0;
+    uint64_t deadline = monotonicNs() + (uint64_t)UPGRADE_READY_MS * 1000000;
+    while (got < sizeof(message)) {
+        uint64_t now = monotonicNs();
+        if (now >= deadline)
+            break;
+        struct pollfd p = { statusFd, POLLIN, 0 };
+        int ready = poll(&p, 1, (int)((deadline - now) / 1000000) + 1);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            break;
+        ssize_t n = read(statusFd, (char*)&message + got, sizeof(message) - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    if (got == sizeof(message) && message == 0)
+        return true;
+    if (got == sizeof(message))
+        logMessage(LOG_ERROR, "[ERROR] exec({}): {}", path, LogErrno{message});
+    else
+        logMessage(LOG_ERROR, "[UPGRADE] pid {} {} before taking over.", (int)pid,
+                   got == 0 && monotonicNs() >= deadline ? "timed out" : "exited");
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return false;
+}
+
+/*
+ * Function: spawnSuccessor
+ *
+ * Starts the new server on this round's snapshots, already written to
+ * the checkpoint, and waits for it to restore them (awaitSuccessor()).
+ * Returns false with the error logged if it didn't.
+ */
+inline bool spawnSuccessor(UpgradeState &u) {
+    int status[2];
+    if (pipe2(status, O_CLOEXEC) != 0) {
+        logMessage(LOG_ERROR, "[ERROR] pipe2(): {}", LogErrno{errno});
+        return false;
+    }
+    std::vector<int> keep(u.listeners);
+    if (statsPort().listenfd != -1)
+        keep.push_back(statsPort().listenfd);
+    keep.push_back(status[1]);
+    std::string inherit;
+    for (size_t i = 0; i < keep.size(); i++)
+        inherit += (i == 0 ? "" : ",") + std::to_string(keep[i]);
+    for (size_t i = 0; i < u.snapshots.size(); i++)
+        if (u.snapshots[i].fd != -1)
+            keep.push_back(u.snapshots[i].fd);
+
+    std::vector<char*> args;
+    for (int i = 0; i < u.argc; i++) {
+        if (strcmp(u.argv[i], "--inherit") == 0) {
+            i++; // Our own predecessor's.
+            continue;
+        }
+        args.push_back(u.argv[i]);
+    }
+    args.push_back((char*)"--inherit");
+    args.push_back(&inherit[0]);
+    args.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only async-signal-safe calls from here on: the other threads'
+        // locks were copied in whatever state they were in.
+        close_range(3, ~0U, CLOSE_RANGE_CLOEXEC); // Sockets we keep serving must close when we do.
+        for (size_t i = 0; i < keep.size(); i++)
+            fcntl(keep[i], F_SETFD, 0);
+        execvp(args[0], args.data());
+        int error = errno;
+        ssize_t n = write(status[1], &error, sizeof(error));
+        (void)n; // The parent sees a short read as a failure too.
+        _exit(127);
+    }
+    close(status[1]);
+    if (pid == -1) {
+        logMessage(LOG_ERROR, "[ERROR] fork(): {}", LogErrno{errno});
+        close(status[0]);
+        return false;
+    }
+    bool ready = awaitSuccessor(status[0], pid, args[0]);
+    close(status[0]);
+    if (!ready)
+        return false;
+    logMessage(LOG_INFO, "[UPGRADE] {} sessions handed to pid {}.", u.snapshots.size(), (int)pid);
+    return true;
+}
+
+/*
+ * Function: postSnapshots
+ *
+ * Hands in one reactor's snapshots and listener for the current round
+ * and returns the round's number. The last reactor in writes the
+ * checkpoint and starts the new server, then wakes the others to find
+ * out how that went with upgradeOutcome(). It lets go of the lock
+ * meanwhile, so they can keep asking.
+ */
+inline uint64_t postSnapshots(int reactor, int listenfd, const std::vector<SessionSnapshot> &snapshots) {
+    UpgradeState &u = upgradeState();
+    std::unique_lock<std::mutex> guard(u.lock);
+    int reactors = handoffDirectory().count;
+    u.listeners.resize(reactors, -1);
+    u.listeners[reactor] = listenfd;
+    u.snapshots.insert(u.snapshots.end(), snapshots.begin(), snapshots.end());
+    uint64_t round = u.round;
+    if (++u.posted < reactors)
+        return round;
+    // Every reactor is in and waits for the round to end, so nothing
+    // else touches the snapshots or listeners until it has.
+    guard.unlock();
+    bool handedOver = writeCheckpoint(u.checkpointPath, u.snapshots) && spawnSuccessor(u);
+    if (handedOver) {
+        releaseStatsPort();
+    } else {
+        unlink(u.checkpointPath);
+        logMessage(LOG_ERROR, "[UPGRADE] Restart failed; carrying on as before.");
+    }
+    guard.lock();
+    u.handedOver = handedOver;
+    u.snapshots.clear();
+    u.posted = 0;
+    u.round++;
+    u.requested.store(false, std::memory_order_release);
+    wakeReactors();
+    return round;
+}
+
+// Whether round `round` is over, and if so whether the new server started.
+inline bool upgradeOutcome(uint64_t round, bool &handedOver) {
+    UpgradeState &u = upgradeState();
+    std::lock_guard<std::mutex> guard(u.lock);
+    if (u.round == round)
+        return false;
+    handedOver = u.handedOver;
+    return true;
+}
+
+#endif // UPGRADE_H
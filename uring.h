@@ -0,0 +1,387 @@
+/*
+ *  uring.h
+ *
+ *  -------------------------------------------------------------------
+ *  Minimal io_uring wrapper for the server's --io uring backend (see
+ *  reactor.h), on the raw io_uring_setup/io_uring_enter/
+ *  io_uring_register syscalls and <linux/io_uring.h>, so there is no
+ *  liburing to build against.
+ *
+ *  Only what the reactor uses is here:
+ *    • the submission and completion rings, mmap()ed once; queuing an
+ *      SQE is a few stores, and nothing reaches the kernel until
+ *      submitAndWait(), which submits everything queued since the last
+ *      call and waits for completions in the same io_uring_enter();
+ *    • prep helpers for multishot accept, multishot recv, multishot
+ *      poll, send and cancel;
+ *    • a provided-buffer ring (BufferRing): the kernel picks a free
+ *      buffer for each multishot recv completion, and the reactor hands
+ *      it straight back once the bytes are copied out.
+ *
+ *  UringIo is one socket's side of it: whether its recv is armed, the
+ *  send in flight and the bytes received but not yet taken into its
+ *  Connection. It lives in the Session, so it moves with it when a
+ *  session is handed to another reactor.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+const unsigned URING_ENTRIES = 4096;    // Submission queue size; the completion queue gets 4x.
+const unsigned URING_BUFFERS = 4096;    // Provided receive buffers (a power of two)...
+const unsigned URING_BUFFER_SIZE = 2048; // ...this big each.
+const uint16_t URING_BUFFER_GROUP = 0;
+
+struct Uring {
+    int fd;
+    unsigned *sqHead, *sqTail, sqMask, *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead, *cqTail, cqMask;
+    struct io_uring_cqe *cqes;
+    unsigned queued;     // SQEs filled in since the last submit.
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    uint64_t enters;     // io_uring_enter() calls, for metrics.
+};
+
+struct BufferRing {
+    struct io_uring_buf_ring *ring;
+    char *buffers;
+    size_t ringSize;
+    uint16_t tail;
+};
+
+// One socket's io_uring state, see the top of this file.
+struct UringIo {
+    uint32_t tag;            // Goes into user_data, so completions for an earlier socket on this fd are ignored.
+    bool recvArmed;          // A multishot recv is outstanding.
+    bool recvPaused;         // Cancelled because `spill` is full; re-armed once it drains.
+    bool peerClosed;         // The recv ended for good: EOF, or recvError.
+    int recvError;
+    bool sending;            // A send from `sendBuf` is in flight.
+    std::vector<char> sendBuf;
+    size_t sendOffset;       // Bytes of sendBuf already sent.
+    std::string spill;       // Received, not yet taken into the Connection.
+};
+
+inline int uringSetup(unsigned entries, struct io_uring_params &params) {
+    return (int)syscall(__NR_io_uring_setup, entries, &params);
+}
+
+inline int uringEnter(int fd, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t argSize) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, argSize);
+}
+
+inline int uringRegister(int fd, unsigned opcode, void *arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+inline void closeUring(Uring &u) {
+    if (u.sqes)
+        munmap(u.sqes, u.sqesSize);
+    if (u.cqRing && u.cqRing != u.sqRing)
+        munmap(u.cqRing, u.cqRingSize);
+    if (u.sqRing)
+        munmap(u.sqRing, u.sqRingSize);
+    if (u.fd != -1)
+        close(u.fd);
+    u.fd = -1;
+    u.sqRing = u.cqRing = u.sqes = nullptr;
+}
+
+/*
+ * Function: initUring
+ *
+ * Creates the ring and maps it. Asks for a single-issuer ring whose
+ * completion work runs only when we wait for it (the reactor is the
+ * one thread that ever touches it); older kernels that refuse those
+ * flags get a plain one. Needs IORING_FEAT_EXT_ARG (Linux 5.11) for
+ * timed waits. Returns false with errno set.
+ */
+inline bool initUring(Uring &u) {
+    memset(&u, 0, sizeof(u));
+    u.fd = -1;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER
+                 | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = URING_ENTRIES * 4;
+    u.fd = uringSetup(URING_ENTRIES, params);
+    if (u.fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = URING_ENTRIES * 4;
+        u.fd = uringSetup(URING_ENTRIES, params);
+    }
+    if (u.fd < 0)
+        return false;
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        closeUring(u);
+        errno = ENOSYS;
+        return false;
+    }
+
+    u.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    u.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+        u.sqRingSize = u.cqRingSize = std::max(u.sqRingSize, u.cqRingSize);
+    u.sqRing = mmap(nullptr, u.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u.fd,
+                    IORING_OFF_SQ_RING);
+    if (u.sqRing == MAP_FAILED) {
+        u.sqRing = nullptr;
+        closeUring(u);
+        return false;
+    }
+    u.cqRing = single ? u.sqRing
+                      : mmap(nullptr, u.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u.fd,
+                             IORING_OFF_CQ_RING);
+    u.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(nullptr, u.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u.fd,
+                      IORING_OFF_SQES);
+    if (u.cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        if (u.cqRing == MAP_FAILED)
+            u.cqRing = nullptr;
+        u.sqes = sqes == MAP_FAILED ? nullptr : (struct io_uring_sqe*)sqes;
+        closeUring(u);
+        return false;
+    }
+    u.sqes = (struct io_uring_sqe*)sqes;
+
+    char *sq = (char*)u.sqRing;
+    u.sqHead = (unsigned*)(sq + params.sq_off.head);
+    u.sqTail = (unsigned*)(sq + params.sq_off.tail);
+    u.sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    u.sqArray = (unsigned*)(sq + params.sq_off.array);
+    char *cq = (char*)u.cqRing;
+    u.cqHead = (unsigned*)(cq + params.cq_off.head);
+    u.cqTail = (unsigned*)(cq + params.cq_off.tail);
+    u.cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    u.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+/*
+ * Function: submitAndWait
+ *
+ * One io_uring_enter(): submits every queued SQE and waits until at
+ * least `wait` completions are in, or `timeoutMs` passes (-1 = no
+ * limit). Returns false with errno set on a real error; a timeout or
+ * a signal is not one.
+ */
+inline bool submitAndWait(Uring &u, unsigned wait, int timeoutMs) {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    unsigned flags = IORING_ENTER_EXT_ARG | (wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+    unsigned submit = u.queued;
+    u.enters++;
+    int n = uringEnter(u.fd, submit, wait, flags, &arg, sizeof(arg));
+    if (n < 0)
+        return errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY;
+    u.queued -= std::min((unsigned)n, u.queued);
+    return true;
+}
+
+/*
+ * Function: getSqe
+ *
+ * The next free submission entry, zeroed. If the queue is full, what's
+ * queued so far is submitted first. Returns nullptr if even that
+ * leaves no room (errno set).
+ */
+inline struct io_uring_sqe *getSqe(Uring &u) {
+    unsigned tail = *u.sqTail;
+    if (tail - __atomic_load_n(u.sqHead, __ATOMIC_ACQUIRE) > u.sqMask) {
+        if (!submitAndWait(u, 0, 0))
+            return nullptr;
+        if (tail - __atomic_load_n(u.sqHead, __ATOMIC_ACQUIRE) > u.sqMask) {
+            errno = EBUSY;
+            return nullptr;
+        }
+    }
+    unsigned slot = tail & u.sqMask;
+    struct io_uring_sqe *sqe = &u.sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    u.sqArray[slot] = slot;
+    __atomic_store_n(u.sqTail, tail + 1, __ATOMIC_RELEASE);
+    u.queued++;
+    return sqe;
+}
+
+// The oldest unreaped completion, or nullptr; seenCqe() releases it.
+inline struct io_uring_cqe *peekCqe(Uring &u) {
+    unsigned head = *u.cqHead;
+    if (head == __atomic_load_n(u.cqTail, __ATOMIC_ACQUIRE))
+        return nullptr;
+    return &u.cqes[head & u.cqMask];
+}
+
+inline void seenCqe(Uring &u) {
+    __atomic_store_n(u.cqHead, *u.cqHead + 1, __ATOMIC_RELEASE);
+}
+
+inline bool prepMultishotAccept(Uring &u, int listenfd, int flags, uint64_t data) {
+    struct io_uring_sqe *sqe = getSqe(u);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenfd;
+    sqe->accept_flags = flags;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = data;
+    return true;
+}
+
+// Receives into buffers the kernel takes from `group` (see BufferRing).
+inline bool prepMultishotRecv(Uring &u, int fd, uint16_t group, uint64_t data) {
+    struct io_uring_sqe *sqe = getSqe(u);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->user_data = data;
+    return true;
+}
+
+inline bool prepMultishotPoll(Uring &u, int fd, unsigned events, uint64_t data) {
+    struct io_uring_sqe *sqe = getSqe(u);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = data;
+    return true;
+}
+
+inline bool prepSend(Uring &u, int fd, const char *buf, size_t length, uint64_t data) {
+    struct io_uring_sqe *sqe = getSqe(u);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)length;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = data;
+    return true;
+}
+
+// Cancels the request submitted with user_data `target`; this one completes as `data`.
+inline bool prepCancel(Uring &u, uint64_t target, uint64_t data) {
+    struct io_uring_sqe *sqe = getSqe(u);
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = data;
+    return true;
+}
+
+// Hands buffer `bid` (back) to the kernel. The entries are indexed by
+// hand: in C++ the header's flexible `bufs` member lands 8 bytes in,
+// past the tail it is meant to overlay.
+inline void provideBuffer(BufferRing &b, uint16_t bid) {
+    struct io_uring_buf &buf = ((struct io_uring_buf*)b.ring)[b.tail & (URING_BUFFERS - 1)];
+    buf.addr = (uint64_t)(uintptr_t)(b.buffers + (size_t)bid * URING_BUFFER_SIZE);
+    buf.len = URING_BUFFER_SIZE;
+    buf.bid = bid;
+    b.tail++;
+    __atomic_store_n(&b.ring->tail, b.tail, __ATOMIC_RELEASE);
+}
+
+inline const char *bufferData(const BufferRing &b, uint16_t bid) {
+    return b.buffers + (size_t)bid * URING_BUFFER_SIZE;
+}
+
+// Frees what initBufferRing() set up, once the ring it was registered
+// with is closed (or it never was). Safe to call twice.
+inline void freeBufferRing(BufferRing &b) {
+    if (b.ring)
+        munmap(b.ring, b.ringSize);
+    delete[] b.buffers;
+    b.ring = nullptr;
+    b.buffers = nullptr;
+}
+
+/*
+ * Function: initBufferRing
+ *
+ * Registers URING_BUFFERS receive buffers of URING_BUFFER_SIZE bytes
+ * as buffer group URING_BUFFER_GROUP (Linux 5.19). Returns false with
+ * errno set and nothing left to free; otherwise freeBufferRing() once
+ * `u` is closed.
+ */
+inline bool initBufferRing(Uring &u, BufferRing &b) {
+    b.ring = nullptr;
+    b.buffers = nullptr;
+    b.ringSize = URING_BUFFERS * sizeof(struct io_uring_buf);
+    void *ring = mmap(nullptr, b.ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+    b.ring = (struct io_uring_buf_ring*)ring;
+    b.buffers = new char[(size_t)URING_BUFFERS * URING_BUFFER_SIZE];
+    b.tail = 0;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    int status = uringRegister(u.fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (status < 0) {
+        int saved = errno;
+        freeBufferRing(b);
+        errno = saved;
+        return false;
+    }
+    for (unsigned i = 0; i < URING_BUFFERS; i++)
+        provideBuffer(b, (uint16_t)i);
+    return true;
+}
+
+/*
+ * Function: uringAvailable
+ *
+ * Whether this kernel (and any seccomp filter in the way) gives us a
+ * ring with everything the backend needs. Tried once at startup.
+ */
+inline bool uringAvailable() {
+    Uring u;
+    if (!initUring(u))
+        return false;
+    BufferRing b;
+    bool ok = initBufferRing(u, b);
+    int saved = errno;
+    closeUring(u);
+    if (ok)
+        freeBufferRing(b);
+    errno = saved;
+    return ok;
+}
+
+#endif // URING_H
@@ -0,0 +1,166 @@
+/*
+ *  variants.h
+ *
+ *  -------------------------------------------------------------------
+ *  Board variants: a small table of Geometry instantiations
+ *  (bitboard.h), picked by name at runtime. Each entry carries
+ *  function pointers into its own compile-time-specialised engine, so
+ *  the choice costs one indirect call per operation, not a branch per
+ *  move.
+ *
+ *  Names are columns x rows, with "c<n>" when the run isn't four:
+ *
+ *      7x6     the classic game (what the server plays)
+ *      8x7     8 columns, 7 rows
+ *      9x7     9 columns, 7 rows (past 64 bits: 128-bit masks)
+ *      7x6c5   the classic board, five in a row to win
+ *
+ *  The binary protocol, the archive, the opening book and the search
+ *  are Classic-only (7 columns, 64-bit keys), so the server offers the
+ *  others to text clients only, and only while the console plays its
+ *  side: a game's first line can be "VARIANT <name>" (protocol.h).
+ *  Such a game keeps its variant's own Geometry::Board in a
+ *  VariantBoard and plays on it only through the entry's functions.
+ *  -------------------------------------------------------------------
+ */
+
+#ifndef VARIANTS_H
+#define VARIANTS_H
+
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+
+#include "bitboard.h"
+#include "perft.h"
+
+const int VARIANT_BOARD_TEXT = 7 * 18; // The largest board's rendered text, 9x7.
+
+// Room for any variant's Geometry::Board. Only that variant's
+// functions look inside, and init() puts the board there.
+struct VariantBoard {
+    alignas(16) unsigned char bytes[48];
+};
+
+struct Variant {
+    const char *name;
+    int rows, cols, connect;
+    bool canDedup; // Keys fit perft's 64-bit table.
+
+    // A live game on a VariantBoard, each its own Geometry's: init(),
+    // drop() (the row the piece landed in, or -1), hasWin() for
+    // `player`, isFull(), render() (rows * cols * 2 bytes), the ply
+    // count, and each side's stones widened to 128 bits.
+    void (*init)(VariantBoard &board);
+    int (*drop)(VariantBoard &board, int col, int player);
+    bool (*won)(const VariantBoard &board, int player);
+    bool (*full)(const VariantBoard &board);
+    void (*render)(const VariantBoard &board, char *out);
+    int (*moves)(const VariantBoard &board);
+    void (*stones)(const VariantBoard &board, uint128 out[2]);
+
+    // Plays `moves` (1-based column digits) from the empty board into
+    // `board` as G::render() text; returns the ply count, or -1 if the
+    // moves aren't legal.
+    int (*play)(const char *moves, std::string &board);
+
+    // runPerft() from the position after `moves`, which play() accepted.
+    PerftResult (*perft)(const char *moves, int depth, int threads, size_t hashMb);
+};
+
+template <class G>
+int playVariant(const char *moves, std::string &board) {
+    typename G::Board b;
+    G::init(b);
+    if (!G::play(b, moves))
+        return -1;
+    board.resize(G::BOARD_TEXT);
+    G::render(b, &board[0]);
+    return b.moves;
+}
+
+template <class G>
+PerftResult perftVariant(const char *moves, int depth, int threads, size_t hashMb) {
+    typename G::Board b;
+    G::init(b);
+    G::play(b, moves);
+    return runPerft<G>(b, depth, threads, hashMb);
+}
+
+template <class G>
+typename G::Board &variantBoard(VariantBoard &board) {
+    return *std::launder(reinterpret_cast<typename G::Board*>(board.bytes));
+}
+
+template <class G>
+const typename G::Board &variantBoard(const VariantBoard &board) {
+    return *std::launder(reinterpret_cast<const typename G::Board*>(board.bytes));
+}
+
+template <class G>
+void initVariant(VariantBoard &board) {
+    G::init(*new (board.bytes) typename G::Board);
+}
+
+template <class G>
+int dropVariant(VariantBoard &board, int col, int player) {
+    return G::drop(variantBoard<G>(board), col, player);
+}
+
+template <class G>
+bool wonVariant(const VariantBoard &board, int player) {
+    return G::hasWin(variantBoard<G>(board).pieces[player]);
+}
+
+template <class G>
+bool fullVariant(const VariantBoard &board) {
+    return G::isFull(variantBoard<G>(board));
+}
+
+template <class G>
+void renderVariant(const VariantBoard &board, char *out) {
+    G::render(variantBoard<G>(board), out);
+}
+
+template <class G>
+int movesVariant(const VariantBoard &board) {
+    return variantBoard<G>(board).moves;
+}
+
+template <class G>
+void stonesVariant(const VariantBoard &board, uint128 out[2]) {
+    out[0] = variantBoard<G>(board).pieces[0];
+    out[1] = variantBoard<G>(board).pieces[1];
+}
+
+template <int Rows, int Cols, int Connect>
+constexpr Variant makeVariant(const char *name) {
+    typedef Geometry<Rows, Cols, Connect> G;
+    static_assert(G::BOARD_TEXT <= VARIANT_BOARD_TEXT, "VARIANT_BOARD_TEXT is too small");
+    static_assert(sizeof(typename G::Board) <= sizeof(VariantBoard::bytes)
+                  && alignof(typename G::Board) <= alignof(VariantBoard), "G::Board doesn't fit a VariantBoard");
+    return Variant{ name, Rows, Cols, Connect, perftCanDedup<G>(),
+                    initVariant<G>, dropVariant<G>, wonVariant<G>, fullVariant<G>, renderVariant<G>,
+                    movesVariant<G>, stonesVariant<G>, playVariant<G>, perftVariant<G> };
+}
+
+const Variant VARIANTS[] = {
+    makeVariant<6, 7, 4>("7x6"),
+    makeVariant<7, 8, 4>("8x7"),
+    makeVariant<7, 9, 4>("9x7"),
+    makeVariant<6, 7, 5>("7x6c5"),
+};
+
+const int VARIANT_COUNT = sizeof(VARIANTS) / sizeof(VARIANTS[0]);
+
+// The entry called `name`, or nullptr.
+inline const Variant *findVariant(std::string_view name) {
+    for (int v = 0; v < VARIANT_COUNT; v++)
+        if (name == VARIANTS[v].name)
+            return &VARIANTS[v];
+    return nullptr;
+}
+
+#endif // VARIANTS_H